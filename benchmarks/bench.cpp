@@ -4,10 +4,29 @@
 
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/benchmark/catch_benchmark.hpp>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <queue>
 #include <thread>
+#include <unordered_map>
+#include <vector>
 
+#include <luavar/bundle.h>
+#include <luavar/channel.h>
+#include <luavar/environment.h>
 #include <luavar/luavar.h>
+#include <luavar/parallel.h>
+#include <luavar/property.h>
+#include <luavar/ref.h>
+#include <luavar/serialize.h>
+#include <luavar/shared_table.h>
 #include <luavar/state.h>
 
 int xyzcalc(int x, int y, int z)
@@ -137,3 +156,1159 @@ TEST_CASE("Benchmarks - lua2cpp", "lua2cpp")
         }
     }
 }
+
+// loads the script and runs it in 5 rounds, returns the time of the fastest round
+static std::chrono::nanoseconds BestLoopTime(lua_State *L, const char *script)
+{
+    REQUIRE(luaL_loadstring(L, script) == LUA_OK);
+    auto best = std::chrono::nanoseconds::max();
+    for (int round = 0; round < 5; ++round)
+    {
+        lua_pushvalue(L, -1);
+        auto start = std::chrono::steady_clock::now();
+        lua_call(L, 0, 0);
+        best = std::min(best, std::chrono::nanoseconds(std::chrono::steady_clock::now() - start));
+    }
+    lua_pop(L, 1);
+    return best;
+}
+
+TEST_CASE("Benchmarks - static bind overhead", "overhead")
+{
+    auto LS = LuaVar::LuaState();
+    lua_State *L = LS.Get();
+    lua_pushcfunction(L, xyzcalc2);
+    lua_setglobal(L, "xyzcalc2");
+    LuaVar::CppFunction<xyzcalc>("xyzcalc", xyzcalc).Bind(L);
+
+    auto base = std::chrono::nanoseconds::max();
+    auto luavar = std::chrono::nanoseconds::max();
+    // alternate both variants, so frequency scaling and noise affect them equally
+    for (int i = 0; i < 10; ++i)
+    {
+        base = std::min(base, BestLoopTime(L, "local s = 0 for i = 1, 200000 do s = s + xyzcalc2(3, 5, 7) end"));
+        luavar = std::min(luavar, BestLoopTime(L, "local s = 0 for i = 1, 200000 do s = s + xyzcalc(3, 5, 7) end"));
+    }
+    std::cout << "hand written: " << base.count() / 200000.0 << " ns per call, LuaVar: "
+            << luavar.count() / 200000.0 << " ns per call" << std::endl;
+    CHECK(luavar.count() <= base.count() * 105 / 100);
+}
+
+// item definitions used by shared table benchmarks
+static const char *ItemDefinitionsScript = R"lua(
+    items = {}
+    for i = 1, 20000 do
+        items["item" .. i] = { name = "Item number " .. i, damage = i % 100, weight = i * 0.5, stackable = (i % 2 == 0) }
+    end
+)lua";
+
+// keys are prepared up front, so the lookup loop itself doesn't allocate
+static const char *ItemKeysScript = R"lua(
+    keys = {}
+    for i = 1, 1000 do
+        keys[i] = "item" .. i
+    end
+)lua";
+
+static const char *ItemLookupScript = R"lua(
+    local total = 0
+    for i = 1, 1000 do
+        total = total + items[keys[i]].damage
+    end
+    res = total
+)lua";
+
+TEST_CASE("Benchmarks - shared table", "shared_table")
+{
+    SECTION("Base")
+    {
+        auto LS = LuaVar::LuaState();
+        lua_State *L = LS.Get();
+        auto emptyKb = lua_gc(L, LUA_GCCOUNT, 0);
+        luaL_dostring(L, ItemDefinitionsScript);
+        lua_gc(L, LUA_GCCOLLECT, 0);
+        std::cout << "native tables: " << lua_gc(L, LUA_GCCOUNT, 0) - emptyKb << " KB per state" << std::endl;
+        luaL_dostring(L, ItemKeysScript);
+
+        BENCHMARK("1000 lookups of native table")
+        {
+            luaL_dostring(L, ItemLookupScript);
+        };
+        lua_getglobal(L, "res");
+        REQUIRE(lua_tointeger(L, -1) == 49500);
+    }
+    SECTION("LuaVar")
+    {
+        std::shared_ptr<const LuaVar::SharedTable> items;
+        {
+            auto loader = LuaVar::LuaState();
+            luaL_dostring(loader, ItemDefinitionsScript);
+            lua_getglobal(loader, "items");
+            items = LuaVar::SharedTable::FromLua(loader, -1);
+        }
+        REQUIRE(items != nullptr);
+
+        auto LS = LuaVar::LuaState();
+        lua_State *L = LS.Get();
+        auto emptyKb = lua_gc(L, LUA_GCCOUNT, 0);
+        LuaVar::SharedTable::Bind(L, "items", items);
+        lua_gc(L, LUA_GCCOLLECT, 0);
+        std::cout << "shared table: " << lua_gc(L, LUA_GCCOUNT, 0) - emptyKb << " KB per state" << std::endl;
+        luaL_dostring(L, ItemKeysScript);
+
+        BENCHMARK("1000 lookups of shared table")
+        {
+            luaL_dostring(L, ItemLookupScript);
+        };
+        lua_getglobal(L, "res");
+        REQUIRE(lua_tointeger(L, -1) == 49500);
+    }
+}
+
+// request handler with a bit of startup work, similar to real scripts
+static const char *HandlerScript = R"lua(
+    local config = {}
+    for i = 1, 2000 do
+        config["option" .. i] = { value = i, name = "option number " .. i }
+    end
+    function handle(id)
+        request_id = id
+        local total = 0
+        for i = 1, 10 do
+            total = total + config["option" .. i].value
+        end
+        return total + id
+    end
+)lua";
+
+TEST_CASE("Benchmarks - request isolation", "isolation")
+{
+    auto handle = LuaVar::LuaFunction<int(*)(int)>("handle");
+    SECTION("Base")
+    {
+        BENCHMARK("new state per request")
+        {
+            auto LS = LuaVar::LuaState();
+            luaL_openlibs(LS);
+            luaL_dostring(LS, HandlerScript);
+            return handle(LS, 1);
+        };
+    }
+    SECTION("LuaVar")
+    {
+        auto LS = LuaVar::LuaState();
+        lua_State *L = LS.Get();
+        luaL_openlibs(L);
+        REQUIRE(LuaVar::Environment::LoadTemplate(L, HandlerScript));
+        LuaVar::Environment env(L);
+        BENCHMARK("environment per request")
+        {
+            int res;
+            {
+                LuaVar::Environment::Scope scope(env);
+                res = handle(L, 1);
+            }
+            env.Reset();
+            return res;
+        };
+        REQUIRE(handle(L, 1) == 56);
+    }
+}
+
+static const char *AllocatingScript = R"(
+function tick(n)
+    local parts = {}
+    for i = 1, n do
+        parts[i] = { id = i, name = "entity" .. i }
+    end
+    return #parts
+end
+)";
+
+// runs the tick function repeatedly and reports latency percentiles, `idle` runs between ticks
+template<typename Idle>
+static void TickLatency(const char *name, LuaVar::LuaState &LS, Idle &&idle)
+{
+    auto tick = LuaVar::LuaFunction<int(*)(int)>("tick");
+    std::vector<std::chrono::nanoseconds> samples;
+    samples.reserve(2000);
+    for (int i = 0; i < 2000; ++i)
+    {
+        auto start = std::chrono::steady_clock::now();
+        tick(LS, 200);
+        samples.push_back(std::chrono::steady_clock::now() - start);
+        idle();
+    }
+    std::sort(samples.begin(), samples.end());
+    auto stats = LS.GetGcStats();
+    std::cout << name << ": p50 " << samples[samples.size() / 2].count() / 1000
+            << " us, p99 " << samples[samples.size() * 99 / 100].count() / 1000
+            << " us, max " << samples.back().count() / 1000
+            << " us, collections " << stats.collections << std::endl;
+}
+
+TEST_CASE("Benchmarks - gc latency", "gc")
+{
+    auto LS = LuaVar::LuaState();
+    luaL_openlibs(LS);
+    REQUIRE(luaL_dostring(LS, AllocatingScript) == LUA_OK);
+    SECTION("Base")
+    {
+        TickLatency("incremental", LS, [] {});
+    }
+    SECTION("LuaVar")
+    {
+        SECTION("generational")
+        {
+            LS.UseGenerationalGc();
+            TickLatency("generational", LS, [] {});
+        }
+        SECTION("stepped in idle time")
+        {
+            LS.SetGcRunning(false);
+            TickLatency("idle steps", LS, [&LS] { LS.StepGc(std::chrono::microseconds(200)); });
+            LS.SetGcRunning(true);
+        }
+    }
+}
+
+// reads keyed table at the top of the stack the way it was done before maps were supported
+static std::unordered_map<std::string, int> ReadTableManually(lua_State *L)
+{
+    std::unordered_map<std::string, int> res;
+    lua_pushnil(L);
+    while (lua_next(L, -2) != 0)
+    {
+        lua_pushvalue(L, -2);
+        res[lua_tostring(L, -1)] = static_cast<int>(lua_tointeger(L, -2));
+        lua_pop(L, 2);
+    }
+    return res;
+}
+
+TEST_CASE("Benchmarks - map conversion", "maps")
+{
+    auto LS = LuaVar::LuaState();
+    lua_State *L = LS.Get();
+    luaL_openlibs(L);
+
+    for (int size: {10, 1000, 100000})
+    {
+        lua_settop(L, 0);
+        REQUIRE(luaL_dostring(L, ("local t = {} for i = 1, " + std::to_string(size) +
+            " do t['key' .. i] = i end return t").c_str()) == LUA_OK);
+        std::unordered_map<std::string, int> source = ReadTableManually(L);
+        REQUIRE(source.size() == static_cast<size_t>(size));
+        const auto suffix = " - " + std::to_string(size) + " keys";
+
+        SECTION("Base" + suffix)
+        {
+            BENCHMARK("read table into unordered_map" + suffix)
+            {
+                return ReadTableManually(L);
+            };
+            BENCHMARK("push unordered_map as table" + suffix)
+            {
+                lua_newtable(L);
+                for (auto &[key, value]: source)
+                {
+                    lua_pushinteger(L, value);
+                    lua_setfield(L, -2, key.c_str());
+                }
+                lua_pop(L, 1);
+            };
+        }
+        SECTION("LuaVar" + suffix)
+        {
+            BENCHMARK("read table into unordered_map" + suffix)
+            {
+                std::unordered_map<std::string, int> res;
+                LuaVar::Internal::Argument<decltype(res)>::get_argument<-1>(L, res);
+                return res;
+            };
+            BENCHMARK("read table into map" + suffix)
+            {
+                std::map<std::string, int> res;
+                LuaVar::Internal::Argument<decltype(res)>::get_argument<-1>(L, res);
+                return res;
+            };
+            BENCHMARK("read table into flat map" + suffix)
+            {
+                LuaVar::FlatMap<std::string, int> res;
+                LuaVar::Internal::Argument<decltype(res)>::get_argument<-1>(L, res);
+                return res;
+            };
+            BENCHMARK("push unordered_map as table" + suffix)
+            {
+                LuaVar::Internal::push_result(L, source);
+                lua_pop(L, 1);
+            };
+        }
+    }
+}
+
+TEST_CASE("Benchmarks - capture lambdas", "captures")
+{
+    auto LS = LuaVar::LuaState();
+    lua_State *L = LS.Get();
+    std::int64_t a = 3, b = 5;
+    // 16 bytes capture, stored in upvalues
+    auto small = [a, b](int x) { return static_cast<int>(a * x + b); };
+    // same capture padded over the inline limit, stored in heap allocated wrapper with finalizer
+    std::int64_t padding[2] = {0, 0};
+    auto large = [a, b, padding](int x) { return static_cast<int>(a * x + b + padding[0] + padding[1]); };
+
+    SECTION("Base")
+    {
+        BENCHMARK("create closure with 16 byte capture")
+        {
+            LuaVar::Internal::DynamicBind<decltype(large), LuaVar::DefaultLuaVarFlags>::PushFunctor(L, large);
+            lua_pop(L, 1);
+        };
+        LuaVar::CppFunction("f", large).Bind(L);
+        REQUIRE(luaL_loadstring(L, "local s = 0 for i = 1, 1000 do s = s + f(i) end return s") == LUA_OK);
+        BENCHMARK("1000 calls of closure with 16 byte capture")
+        {
+            lua_pushvalue(L, -1);
+            lua_call(L, 0, 1);
+            lua_pop(L, 1);
+        };
+    }
+    SECTION("LuaVar")
+    {
+        BENCHMARK("create closure with 16 byte capture")
+        {
+            LuaVar::Internal::DynamicBind<decltype(small), LuaVar::DefaultLuaVarFlags>::PushFunctor(L, small);
+            lua_pop(L, 1);
+        };
+        LuaVar::CppFunction("f", small).Bind(L);
+        REQUIRE(luaL_loadstring(L, "local s = 0 for i = 1, 1000 do s = s + f(i) end return s") == LUA_OK);
+        BENCHMARK("1000 calls of closure with 16 byte capture")
+        {
+            lua_pushvalue(L, -1);
+            lua_call(L, 0, 1);
+            lua_pop(L, 1);
+        };
+    }
+}
+
+static std::tuple<int, std::string, double, bool> FourResults(int x)
+{
+    return {x, "result", x * 0.5, x > 0};
+}
+
+static void FourResultsWriter(int x, LuaVar::Returns<int, std::string, double, bool> out)
+{
+    out(x, "result", x * 0.5, x > 0);
+}
+
+static const char *FourResultsLoop = "local s = 0 for i = 1, 1000 do local a, b, c, d = f(i) s = s + a + c end return s";
+
+TEST_CASE("Benchmarks - multiple results", "results")
+{
+    auto LS = LuaVar::LuaState();
+    lua_State *L = LS.Get();
+    REQUIRE(luaL_dostring(L, "function four(x) return x, 'result', x * 0.5, x > 0 end") == LUA_OK);
+
+    SECTION("Base")
+    {
+        LuaVar::CppFunction<FourResults>("f").Bind(L);
+        REQUIRE(luaL_loadstring(L, FourResultsLoop) == LUA_OK);
+        BENCHMARK("1000 calls of bound function returning 4 values")
+        {
+            lua_pushvalue(L, -1);
+            lua_call(L, 0, 1);
+            lua_pop(L, 1);
+        };
+        lua_pop(L, 1);
+
+        auto four = LuaVar::LuaFunction<std::tuple<int, std::string, double, bool>(*)(int)>("four");
+        BENCHMARK("call lua function returning 4 values")
+        {
+            return std::get<0>(four(L, 5));
+        };
+    }
+    SECTION("LuaVar")
+    {
+        LuaVar::CppFunction<FourResultsWriter>("f").Bind(L);
+        REQUIRE(luaL_loadstring(L, FourResultsLoop) == LUA_OK);
+        BENCHMARK("1000 calls of bound function returning 4 values")
+        {
+            lua_pushvalue(L, -1);
+            lua_call(L, 0, 1);
+            lua_pop(L, 1);
+        };
+        lua_pop(L, 1);
+
+        auto four = LuaVar::LuaFunction<void(*)(int)>("four");
+        int a;
+        std::string b;
+        double c;
+        bool d;
+        BENCHMARK("call lua function returning 4 values")
+        {
+            four.CallInto(L, std::tie(a, b, c, d), 5);
+            return a;
+        };
+    }
+}
+
+static int SumTable(LuaVar::Table values)
+{
+    int sum = 0;
+    const auto length = values.Length();
+    for (size_t i = 1; i <= length; ++i)
+        sum += values.Get<int>(i).value_or(0);
+    return sum;
+}
+
+static int SumVarargs(LuaVar::Varargs<int> values)
+{
+    int sum = 0;
+    for (int value : values)
+        sum += value;
+    return sum;
+}
+
+static int SumStack(LuaVar::StackView values)
+{
+    int sum = 0;
+    for (int i = 0; i < values.size(); ++i)
+        sum += static_cast<int>(lua_tointeger(values.State(), values.Index(i)));
+    return sum;
+}
+
+TEST_CASE("Benchmarks - varargs", "varargs")
+{
+    auto LS = LuaVar::LuaState();
+    lua_State *L = LS.Get();
+    std::string args;
+    for (int i = 1; i <= 32; ++i)
+        args += (i > 1 ? ", " : "") + std::to_string(i);
+
+    SECTION("Base")
+    {
+        LuaVar::CppFunction<SumTable>("sum").Bind(L);
+        const std::string script = "return sum({" + args + "})";
+        REQUIRE(luaL_loadstring(L, script.c_str()) == LUA_OK);
+        BENCHMARK("sum of 32 arguments packed in a table")
+        {
+            lua_pushvalue(L, -1);
+            lua_call(L, 0, 1);
+            const auto res = lua_tointeger(L, -1);
+            lua_pop(L, 1);
+            return res;
+        };
+    }
+    SECTION("LuaVar")
+    {
+        LuaVar::CppFunction<SumVarargs>("sum").Bind(L);
+        LuaVar::CppFunction<SumStack>("sum_stack").Bind(L);
+        const std::string script = "return sum(" + args + ")";
+        REQUIRE(luaL_loadstring(L, script.c_str()) == LUA_OK);
+        BENCHMARK("sum of 32 arguments as Varargs")
+        {
+            lua_pushvalue(L, -1);
+            lua_call(L, 0, 1);
+            const auto res = lua_tointeger(L, -1);
+            lua_pop(L, 1);
+            return res;
+        };
+        lua_pop(L, 1);
+
+        const std::string stackScript = "return sum_stack(" + args + ")";
+        REQUIRE(luaL_loadstring(L, stackScript.c_str()) == LUA_OK);
+        BENCHMARK("sum of 32 arguments through StackView")
+        {
+            lua_pushvalue(L, -1);
+            lua_call(L, 0, 1);
+            const auto res = lua_tointeger(L, -1);
+            lua_pop(L, 1);
+            return res;
+        };
+    }
+}
+
+TEST_CASE("Benchmarks - memory accounting", "memory")
+{
+    const char *script = "local t = {} for i = 1, 1000 do t[i] = { i, 'item' .. i } end";
+
+    SECTION("Base")
+    {
+        lua_State *L = luaL_newstate();
+        luaL_openlibs(L);
+        REQUIRE(luaL_loadstring(L, script) == LUA_OK);
+        BENCHMARK("allocate 2000 objects")
+        {
+            lua_pushvalue(L, -1);
+            lua_call(L, 0, 0);
+        };
+        lua_close(L);
+    }
+    SECTION("LuaVar")
+    {
+        auto LS = LuaVar::LuaState({
+            .memoryLimit = 256 * 1024 * 1024, .memoryThreshold = 128 * 1024 * 1024, .onMemoryThreshold = [](size_t) {}
+        });
+        lua_State *L = LS.Get();
+        luaL_openlibs(L);
+        REQUIRE(luaL_loadstring(L, script) == LUA_OK);
+        BENCHMARK("allocate 2000 objects")
+        {
+            lua_pushvalue(L, -1);
+            lua_call(L, 0, 0);
+        };
+    }
+}
+
+TEST_CASE("Benchmarks - execution budget", "budget")
+{
+    auto LS = LuaVar::LuaState();
+    lua_State *L = LS.Get();
+    const char *script = "local s = 0 for i = 1, 100000 do s = s + i % 7 end";
+
+    SECTION("Base")
+    {
+        BENCHMARK("100k iterations without budget")
+        {
+            return LS.Run(script);
+        };
+    }
+    SECTION("LuaVar")
+    {
+        for (int interval : {100, 1000, 10000})
+        {
+            const LuaVar::ExecutionBudget instructions{.instructions = 1'000'000'000, .checkInterval = interval};
+            BENCHMARK("100k iterations, instruction budget checked every " + std::to_string(interval))
+            {
+                return LS.Run(script, instructions);
+            };
+            const LuaVar::ExecutionBudget time{.wallTime = std::chrono::seconds(60), .checkInterval = interval};
+            BENCHMARK("100k iterations, wall time budget checked every " + std::to_string(interval))
+            {
+                return LS.Run(script, time);
+            };
+        }
+    }
+    CHECK(lua_gettop(L) == 0);
+}
+
+TEST_CASE("Benchmarks - state creation", "libraries")
+{
+    const auto create = [](const LuaVar::LuaStateOptions &options)
+    {
+        auto LS = LuaVar::LuaState(options);
+        return LS.GetMemoryStats().usedBytes;
+    };
+    const LuaVar::LuaStateOptions bare{};
+    const LuaVar::LuaStateOptions minimal{
+        .libraries = LuaVar::LuaLibraryBase | LuaVar::LuaLibraryString | LuaVar::LuaLibraryMath,
+        .lazyLibraries = LuaVar::LuaLibraryAll
+    };
+    const LuaVar::LuaStateOptions full{.libraries = LuaVar::LuaLibraryAll};
+
+    SECTION("Base")
+    {
+        BENCHMARK("full state with luaL_openlibs")
+        {
+            lua_State *L = luaL_newstate();
+            luaL_openlibs(L);
+            lua_close(L);
+        };
+    }
+    SECTION("LuaVar")
+    {
+        std::cout << "state memory: bare " << create(bare) << " B, minimal " << create(minimal) << " B, full "
+                << create(full) << " B" << std::endl;
+        BENCHMARK("bare state")
+        {
+            return create(bare);
+        };
+        BENCHMARK("minimal state")
+        {
+            return create(minimal);
+        };
+        BENCHMARK("full state")
+        {
+            return create(full);
+        };
+    }
+}
+
+struct BenchEntity
+{
+    int id = 0;
+};
+
+static BenchEntity BenchEntities[16];
+
+// the usual hand written binding: a new userdata holding the pointer on every push
+static int GetEntityManually(lua_State *L)
+{
+    const auto index = luaL_checkinteger(L, 1);
+    *static_cast<BenchEntity **>(lua_newuserdatauv(L, sizeof(BenchEntity *), 0)) = &BenchEntities[index % 16];
+    luaL_setmetatable(L, "BenchEntity");
+    return 1;
+}
+
+static BenchEntity *GetEntity(int index)
+{
+    return &BenchEntities[index % 16];
+}
+
+TEST_CASE("Benchmarks - object passing", "objects")
+{
+    auto LS = LuaVar::LuaState();
+    lua_State *L = LS.Get();
+    const char *script = "local e for i = 1, 1000 do e = entity(i) end return e";
+
+    SECTION("Base")
+    {
+        luaL_newmetatable(L, "BenchEntity");
+        lua_pop(L, 1);
+        lua_register(L, "entity", GetEntityManually);
+        REQUIRE(luaL_loadstring(L, script) == LUA_OK);
+        BENCHMARK("push 1000 pointers to 16 objects")
+        {
+            lua_pushvalue(L, -1);
+            lua_call(L, 0, 0);
+        };
+    }
+    SECTION("LuaVar")
+    {
+        LuaVar::CppFunction<GetEntity>("entity").Bind(L);
+        REQUIRE(luaL_loadstring(L, script) == LUA_OK);
+        BENCHMARK("push 1000 pointers to 16 objects")
+        {
+            lua_pushvalue(L, -1);
+            lua_call(L, 0, 0);
+        };
+    }
+}
+
+TEST_CASE("Benchmarks - validated lua functions", "validation")
+{
+    auto LS = LuaVar::LuaState();
+    lua_State *L = LS.Get();
+    REQUIRE(LS.Run("function on_update(dt) return dt end") == LUA_OK);
+    auto update = LuaVar::LuaFunction<int(*)(int)>("on_update");
+
+    SECTION("Base")
+    {
+        BENCHMARK("call looked up by name")
+        {
+            return update(L, 5);
+        };
+    }
+    SECTION("LuaVar")
+    {
+        auto validated = update.Flags(LuaVar::LuaFlags<LuaVar::LuaCallValidated>{});
+        REQUIRE(LuaVar::ValidateFunctions(L, validated).empty());
+        BENCHMARK("call validated function")
+        {
+            return validated(L, 5);
+        };
+    }
+}
+
+enum class BenchState
+{
+    Idle,
+    Walking,
+    Running,
+    Jumping,
+    Falling,
+    Swimming,
+    Climbing,
+    Dead
+};
+
+template<>
+struct LuaVar::EnumNames<BenchState>
+{
+    static constexpr std::array Values{
+        std::pair{BenchState::Idle, std::string_view("idle")},
+        std::pair{BenchState::Walking, std::string_view("walking")},
+        std::pair{BenchState::Running, std::string_view("running")},
+        std::pair{BenchState::Jumping, std::string_view("jumping")},
+        std::pair{BenchState::Falling, std::string_view("falling")},
+        std::pair{BenchState::Swimming, std::string_view("swimming")},
+        std::pair{BenchState::Climbing, std::string_view("climbing")},
+        std::pair{BenchState::Dead, std::string_view("dead")}
+    };
+};
+
+// the usual approach: the name is copied to std::string and looked up in a map
+static int StateFromString(std::string name)
+{
+    static const std::unordered_map<std::string, BenchState> states = {
+        {"idle", BenchState::Idle}, {"walking", BenchState::Walking}, {"running", BenchState::Running},
+        {"jumping", BenchState::Jumping}, {"falling", BenchState::Falling}, {"swimming", BenchState::Swimming},
+        {"climbing", BenchState::Climbing}, {"dead", BenchState::Dead}
+    };
+    auto it = states.find(name);
+    return it != states.end() ? static_cast<int>(it->second) : -1;
+}
+
+static int StateFromEnum(BenchState state)
+{
+    return static_cast<int>(state);
+}
+
+TEST_CASE("Benchmarks - enums", "enums")
+{
+    auto LS = LuaVar::LuaState();
+    lua_State *L = LS.Get();
+    const char *script = "local s = 0 for i = 1, 1000 do s = s + state('climbing') end return s";
+
+    SECTION("Base")
+    {
+        LuaVar::CppFunction<StateFromString>("state").Bind(L);
+        REQUIRE(luaL_loadstring(L, script) == LUA_OK);
+        BENCHMARK("1000 enums passed by name")
+        {
+            lua_pushvalue(L, -1);
+            lua_call(L, 0, 1);
+            lua_pop(L, 1);
+        };
+    }
+    SECTION("LuaVar")
+    {
+        LuaVar::CppFunction<StateFromEnum>("state").Bind(L);
+        REQUIRE(luaL_loadstring(L, script) == LUA_OK);
+        BENCHMARK("1000 enums passed by name")
+        {
+            lua_pushvalue(L, -1);
+            lua_call(L, 0, 1);
+            lua_pop(L, 1);
+        };
+    }
+}
+
+static double BenchSpeed = 2.5;
+static double BenchGravity = 9.81;
+
+static double GetSpeed()
+{
+    return BenchSpeed;
+}
+
+static double GetGravity()
+{
+    return BenchGravity;
+}
+
+TEST_CASE("Benchmarks - properties", "properties")
+{
+    auto LS = LuaVar::LuaState();
+    lua_State *L = LS.Get();
+    LuaVar::PropertyTable tunables("tunables", {
+                                       LuaVar::Property("speed", &BenchSpeed),
+                                       LuaVar::Property("gravity", &BenchGravity)
+                                   });
+
+    SECTION("Base")
+    {
+        LuaVar::CppFunction<GetSpeed>("get_speed").Bind(L);
+        LuaVar::CppFunction<GetGravity>("get_gravity").Bind(L);
+        REQUIRE(luaL_loadstring(L, "local s = 0 for i = 1, 1000 do s = s + get_speed() * get_gravity() end return s") ==
+                LUA_OK);
+        BENCHMARK("2000 variable reads")
+        {
+            lua_pushvalue(L, -1);
+            lua_call(L, 0, 1);
+            lua_pop(L, 1);
+        };
+    }
+    SECTION("LuaVar")
+    {
+        tunables.Bind(L);
+        REQUIRE(luaL_loadstring(L, "local s = 0 for i = 1, 1000 do s = s + tunables.speed * tunables.gravity end return s")
+                == LUA_OK);
+        BENCHMARK("2000 variable reads")
+        {
+            lua_pushvalue(L, -1);
+            lua_call(L, 0, 1);
+            lua_pop(L, 1);
+        };
+    }
+    SECTION("LuaVar - snapshot")
+    {
+        tunables.PushSnapshot(L);
+        lua_setglobal(L, "tunables");
+        REQUIRE(luaL_loadstring(L, "local s = 0 for i = 1, 1000 do s = s + tunables.speed * tunables.gravity end return s")
+                == LUA_OK);
+        BENCHMARK("2000 variable reads")
+        {
+            lua_getglobal(L, "tunables");
+            tunables.UpdateSnapshot(L, -1);
+            lua_pop(L, 1);
+            lua_pushvalue(L, -1);
+            lua_call(L, 0, 1);
+            lua_pop(L, 1);
+        };
+    }
+}
+
+TEST_CASE("Benchmarks - callbacks", "callbacks")
+{
+    auto LS = LuaVar::LuaState();
+    lua_State *L = LS.Get();
+    const char *script = "count = 0 for i = 1, 10000 do register_handler(function(event) count = count + event end) end";
+
+    SECTION("Base")
+    {
+        std::vector<int> handlers;
+        lua_pushlightuserdata(L, &handlers);
+        lua_pushcclosure(L, [](lua_State *L) -> int
+        {
+            auto *handlers = static_cast<std::vector<int> *>(lua_touserdata(L, lua_upvalueindex(1)));
+            luaL_checktype(L, 1, LUA_TFUNCTION);
+            lua_settop(L, 1);
+            handlers->push_back(luaL_ref(L, LUA_REGISTRYINDEX));
+            return 0;
+        }, 1);
+        lua_setglobal(L, "register_handler");
+        REQUIRE(luaL_dostring(L, script) == LUA_OK);
+        BENCHMARK("Dispatch event to 10000 callbacks")
+        {
+            for (int handler: handlers)
+            {
+                lua_rawgeti(L, LUA_REGISTRYINDEX, handler);
+                lua_pushinteger(L, 1);
+                lua_call(L, 1, 0);
+            }
+        };
+    }
+    SECTION("LuaVar")
+    {
+        std::vector<LuaVar::Callback<void(int)> > handlers;
+        auto register_handler = [&handlers](LuaVar::Callback<void(int)> handler) { handlers.push_back(handler); };
+        LuaVar::CppFunction("register_handler", register_handler).Bind(L);
+        REQUIRE(luaL_dostring(L, script) == LUA_OK);
+        BENCHMARK("Dispatch event to 10000 callbacks")
+        {
+            for (const auto &handler: handlers)
+            {
+                handler(1);
+            }
+        };
+    }
+}
+
+TEST_CASE("Benchmarks - parallel map", "parallel")
+{
+    const char *script = "function score(x) local s = 0 for i = 1, 50 do s = s + (x * i) % 7 end return s end";
+    constexpr auto Score = LuaVar::LuaFunction<int (*)(int)>("score");
+    std::vector<int> input(100000);
+    for (size_t i = 0; i < input.size(); ++i)
+    {
+        input[i] = static_cast<int>(i);
+    }
+    std::vector<int> results(input.size());
+
+    SECTION("Base")
+    {
+        auto LS = LuaVar::LuaState();
+        lua_State *L = LS.Get();
+        REQUIRE(luaL_dostring(L, script) == LUA_OK);
+        BENCHMARK("Score 100000 elements")
+        {
+            for (size_t i = 0; i < input.size(); ++i)
+            {
+                results[i] = Score(L, input[i]);
+            }
+        };
+    }
+    SECTION("LuaVar")
+    {
+        const unsigned hardware = std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned threads = 1; threads <= hardware; threads *= 2)
+        {
+            LuaVar::ParallelOptions options;
+            options.threads = threads;
+            LuaVar::ParallelMap scoring(script, Score, options);
+            REQUIRE(scoring.IsValid());
+            BENCHMARK("Score 100000 elements - " + std::to_string(threads) + " threads")
+            {
+                return scoring.Map(input, results);
+            };
+        }
+    }
+}
+
+// the usual approach: messages marshalled through strings and a mutex protected queue
+struct BenchStringQueue
+{
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::queue<std::string> messages;
+
+    void Push(std::string message)
+    {
+        {
+            std::lock_guard lock(mutex);
+            messages.push(std::move(message));
+        }
+        ready.notify_one();
+    }
+
+    std::string Pop()
+    {
+        std::unique_lock lock(mutex);
+        ready.wait(lock, [this] { return !messages.empty(); });
+        std::string message = std::move(messages.front());
+        messages.pop();
+        return message;
+    }
+};
+
+TEST_CASE("Benchmarks - channels", "channels")
+{
+    auto producer = LuaVar::LuaState();
+    auto consumer = LuaVar::LuaState();
+    luaL_openlibs(producer);
+    luaL_openlibs(consumer);
+
+    SECTION("Base")
+    {
+        BenchStringQueue queue;
+        auto push = [&queue](std::string message) { queue.Push(std::move(message)); };
+        auto pop = [&queue] { return queue.Pop(); };
+        LuaVar::CppFunction("push", push).Bind(producer);
+        LuaVar::CppFunction("pop", pop).Bind(consumer);
+        REQUIRE(luaL_loadstring(producer, "for i = 1, 10000 do push(i .. ',item,' .. i * 0.5) end") == LUA_OK);
+        REQUIRE(luaL_loadstring(consumer, "local sum = 0 for i = 1, 10000 do "
+                                "local id, name, weight = pop():match('([^,]+),([^,]+),([^,]+)') "
+                                "sum = sum + tonumber(id) + tonumber(weight) end return sum") == LUA_OK);
+        BENCHMARK("10000 messages between threads")
+        {
+            std::thread thread([&producer]
+            {
+                lua_pushvalue(producer, -1);
+                lua_call(producer, 0, 0);
+            });
+            lua_pushvalue(consumer, -1);
+            lua_call(consumer, 0, 1);
+            lua_pop(consumer, 1);
+            thread.join();
+        };
+    }
+    SECTION("LuaVar")
+    {
+        auto channel = LuaVar::Channel::Create(1024);
+        LuaVar::Channel::Bind(producer, "channel", channel);
+        LuaVar::Channel::Bind(consumer, "channel", channel);
+        REQUIRE(luaL_loadstring(producer, "for i = 1, 10000 do channel:send({id = i, name = 'item', weight = i * 0.5}) end")
+                == LUA_OK);
+        REQUIRE(luaL_loadstring(consumer, "local sum = 0 for i = 1, 10000 do local message = channel:recv() "
+                                "sum = sum + message.id + message.weight end return sum") == LUA_OK);
+        BENCHMARK("10000 messages between threads")
+        {
+            std::thread thread([&producer]
+            {
+                lua_pushvalue(producer, -1);
+                lua_call(producer, 0, 0);
+            });
+            lua_pushvalue(consumer, -1);
+            lua_call(consumer, 0, 1);
+            lua_pop(consumer, 1);
+            thread.join();
+        };
+    }
+}
+
+// the usual approach: serialize into lua source and load it back
+static const char *BenchLuaSerializer = R"(
+local format, concat, type, pairs, tostring = string.format, table.concat, type, pairs, tostring
+local function write(value, out)
+    local kind = type(value)
+    if kind == 'table' then
+        out[#out + 1] = '{'
+        for k, v in pairs(value) do
+            out[#out + 1] = '['
+            write(k, out)
+            out[#out + 1] = ']='
+            write(v, out)
+            out[#out + 1] = ','
+        end
+        out[#out + 1] = '}'
+    elseif kind == 'string' then
+        out[#out + 1] = format('%q', value)
+    elseif kind == 'number' then
+        out[#out + 1] = math.type(value) == 'integer' and tostring(value) or format('%.17g', value)
+    else
+        out[#out + 1] = tostring(value)
+    end
+end
+function serialize(value)
+    local out = {'return '}
+    write(value, out)
+    return concat(out)
+end
+function deserialize(data)
+    return load(data, '=data', 't', {})()
+end
+function make_players(count)
+    local players = {}
+    for i = 1, count do
+        players[i] = {id = i, name = 'player' .. i, level = i % 60, score = i * 1.25, online = i % 3 == 0,
+                      position = {x = i * 0.5, y = -i, z = 7}, inventory = {'sword', 'shield', 'potion'}}
+    end
+    return players
+end
+)";
+
+static void bench_serialization(std::initializer_list<int> players)
+{
+    auto LS = LuaVar::LuaState();
+    lua_State *L = LS.Get();
+    luaL_openlibs(L);
+    REQUIRE(luaL_dostring(L, BenchLuaSerializer) == LUA_OK);
+    auto make_players = [L](int count)
+    {
+        lua_settop(L, 0);
+        lua_getglobal(L, "make_players");
+        lua_pushinteger(L, count);
+        lua_call(L, 1, 1);
+        return " - " + std::to_string(count) + " players";
+    };
+
+    SECTION("Base")
+    {
+        for (int count: players)
+        {
+            const std::string suffix = make_players(count);
+            BENCHMARK("Serialize" + suffix)
+            {
+                lua_getglobal(L, "serialize");
+                lua_pushvalue(L, 1);
+                lua_call(L, 1, 1);
+                lua_pop(L, 1);
+            };
+            lua_getglobal(L, "serialize");
+            lua_pushvalue(L, 1);
+            lua_call(L, 1, 1);
+            BENCHMARK("Deserialize" + suffix)
+            {
+                lua_getglobal(L, "deserialize");
+                lua_pushvalue(L, 2);
+                lua_call(L, 1, 1);
+                lua_pop(L, 1);
+            };
+        }
+    }
+    SECTION("LuaVar")
+    {
+        std::string data;
+        std::array<char, 4096> buffer{};
+        for (int count: players)
+        {
+            const std::string suffix = make_players(count);
+            BENCHMARK("Serialize" + suffix)
+            {
+                data.clear();
+                return LuaVar::Serialize(L, 1, data);
+            };
+            BENCHMARK("Serialize streamed" + suffix)
+            {
+                return LuaVar::Serialize(L, 1, buffer, [](const char *, size_t) { return true; });
+            };
+            BENCHMARK("Deserialize" + suffix)
+            {
+                LuaVar::Deserialize(L, data);
+                lua_pop(L, 1);
+            };
+        }
+    }
+}
+
+TEST_CASE("Benchmarks - serialization", "serialization")
+{
+    // roughly 1KB and 100KB of serialized data
+    bench_serialization({8, 800});
+}
+
+// roughly 10MB, takes minutes with the default number of samples, run explicitly
+TEST_CASE("Benchmarks - serialization of large tables", "[.serialization]")
+{
+    bench_serialization({80000});
+}
+
+TEST_CASE("Benchmarks - script bundles", "bundles")
+{
+    // 200 modules of a few functions each, as loose files and as a bundle
+    constexpr int Scripts = 200;
+    const auto directory = std::filesystem::temp_directory_path() / "luavar_bench_scripts";
+    std::filesystem::create_directories(directory);
+    std::vector<std::string> paths;
+    std::vector<std::string> names;
+    LuaVar::ScriptBundleBuilder builder;
+    std::string error;
+    for (int i = 0; i < Scripts; ++i)
+    {
+        std::string source = "local M = {}\n";
+        for (int f = 0; f < 20; ++f)
+        {
+            source += "function M.f" + std::to_string(f) + "(a, b)\n  local t = {}\n  for i = 1, a do t[i] = i * b + " +
+                std::to_string(f) + " end\n  return #t > 0 and t[#t] or 'empty'\nend\n";
+        }
+        source += "module" + std::to_string(i) + " = M\n";
+        names.push_back("module" + std::to_string(i));
+        paths.push_back((directory / (names.back() + ".lua")).string());
+        std::ofstream(paths.back(), std::ios::binary) << source;
+        REQUIRE(builder.Add(names.back(), source, error));
+    }
+    const std::string bundlePath = (directory / "scripts.bundle").string();
+    REQUIRE(builder.Write(bundlePath, error));
+
+    SECTION("Base")
+    {
+        BENCHMARK("Start state and load 200 scripts")
+        {
+            auto LS = LuaVar::LuaState();
+            lua_State *L = LS.Get();
+            for (const auto &path: paths)
+            {
+                if (luaL_loadfilex(L, path.c_str(), "t") != LUA_OK || lua_pcall(L, 0, 0, 0) != LUA_OK)
+                {
+                    return false;
+                }
+            }
+            return true;
+        };
+    }
+    SECTION("LuaVar")
+    {
+        BENCHMARK("Start state and load 200 scripts")
+        {
+            auto bundle = LuaVar::ScriptBundle::Open(bundlePath, error);
+            auto LS = LuaVar::LuaState();
+            lua_State *L = LS.Get();
+            for (const auto &name: names)
+            {
+                if (bundle->Load(L, name) != LUA_OK || lua_pcall(L, 0, 0, 0) != LUA_OK)
+                {
+                    return false;
+                }
+            }
+            return true;
+        };
+        auto bundle = LuaVar::ScriptBundle::Open(bundlePath, error);
+        REQUIRE(bundle != nullptr);
+        BENCHMARK("Start state and load 200 scripts - bundle already open")
+        {
+            auto LS = LuaVar::LuaState();
+            lua_State *L = LS.Get();
+            for (const auto &name: names)
+            {
+                if (bundle->Load(L, name) != LUA_OK || lua_pcall(L, 0, 0, 0) != LUA_OK)
+                {
+                    return false;
+                }
+            }
+            return true;
+        };
+    }
+    std::filesystem::remove_all(directory);
+}
@@ -6,124 +6,1548 @@
 #define LUAVAR_PASSING_VALUES_H
 
 #include <lua.hpp>
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <new>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <variant>
 #include <luavar/config.h>
+#include <luavar/flat_map.h>
 #include <luavar/type_traits.h>
 
 namespace LuaVar
 {
+    /**
+     * @brief Names of enum values used in scripts, specialize it to pass the enum by name.
+     *
+     * `Values` lists value/name pairs, the table is known at compile time, so converting a name doesn't allocate
+     * nor hash the string. Enums without names are passed as integers.
+     * Setting `Flags` to true makes the enum a bitmask: a table of names is also accepted (the values are combined)
+     * and results are returned as integers.
+     *
+     * @code
+     * template<>
+     * struct LuaVar::EnumNames<Color>
+     * {
+     *     static constexpr std::array Values{
+     *         std::pair{Color::Red, std::string_view("red")},
+     *         std::pair{Color::Green, std::string_view("green")}
+     *     };
+     * };
+     * @endcode
+     */
+    template<typename E>
+    struct EnumNames;
+
+    namespace Internal
+    {
+        struct none_type
+        {
+        };
+
+        template<typename ArgType>
+        struct Argument
+        {
+            template<int Index>
+            static bool get_argument(lua_State */*L*/, ArgType &/*arg*/ = {})
+            {
+                return false;
+            }
+        };
+
+        // kinds of lua values used to pick std::variant alternatives: lua_type() + 1 (so LUA_TNONE is 0),
+        // numbers with integer representation get a separate kind
+        constexpr int IntegerKind = LUA_NUMTYPES + 1;
+        constexpr int KindsCount = LUA_NUMTYPES + 2;
+
+        constexpr unsigned KindBit(int luaType)
+        {
+            return 1u << (luaType + 1);
+        }
+
+        constexpr unsigned IntegerBit = 1u << IntegerKind;
+        constexpr unsigned NilBits = KindBit(LUA_TNONE) | KindBit(LUA_TNIL);
+
+        template<int Index>
+        int value_kind(lua_State *L)
+        {
+            const int type = lua_type(L, Index);
+            if (type == LUA_TNUMBER && lua_isinteger(L, Index))
+            {
+                return IntegerKind;
+            }
+            return type + 1;
+        }
+
+        // Argument specializations providing `check` and `read` can be converted straight into function parameters,
+        // without default constructing intermediate storage first
+        template<typename ArgType>
+        concept IsDirectArgument = requires(lua_State *L)
+        {
+            { Argument<ArgType>::template check<1>(L) } -> std::same_as<bool>;
+            { Argument<ArgType>::template read<1>(L) } -> std::convertible_to<ArgType>;
+        };
+
+        // specializations that also take the stack index at runtime, LuaVar::Varargs reads them in place
+        template<typename ArgType>
+        concept IsRuntimeIndexArgument = requires(lua_State *L, int index)
+        {
+            { Argument<ArgType>::check(L, index) } -> std::same_as<bool>;
+            { Argument<ArgType>::read(L, index) } -> std::convertible_to<ArgType>;
+        };
+
+        template<>
+        struct Argument<int>
+        {
+            // value kinds read without conversion and the ones that are converted, used by std::variant
+            static constexpr unsigned ExactKinds = IntegerBit;
+            static constexpr unsigned ConvertibleKinds = KindBit(LUA_TNUMBER);
+
+            template<int Index>
+            static bool check(lua_State *L)
+            {
+                return check(L, Index);
+            }
+
+            template<int Index>
+            static int read(lua_State *L)
+            {
+                return read(L, Index);
+            }
+
+            static bool check(lua_State *L, int index)
+            {
+                return lua_isnumber(L, index);
+            }
+
+            static int read(lua_State *L, int index)
+            {
+                return static_cast<int>(luaL_checkinteger(L, index));
+            }
+
+            template<int Index>
+            static bool get_argument(lua_State *L, int &arg)
+            {
+                if (!check<Index>(L))
+                {
+                    return false;
+                }
+                arg = read<Index>(L);
+                return true;
+            }
+        };
+
+        template<>
+        struct Argument<double>
+        {
+            // value kinds read without conversion and the ones that are converted, used by std::variant
+            static constexpr unsigned ExactKinds = KindBit(LUA_TNUMBER);
+            static constexpr unsigned ConvertibleKinds = IntegerBit;
+
+            template<int Index>
+            static bool check(lua_State *L)
+            {
+                return check(L, Index);
+            }
+
+            template<int Index>
+            static double read(lua_State *L)
+            {
+                return read(L, Index);
+            }
+
+            static bool check(lua_State *L, int index)
+            {
+                return lua_isnumber(L, index);
+            }
+
+            static double read(lua_State *L, int index)
+            {
+                return luaL_checknumber(L, index);
+            }
+
+            template<int Index>
+            static bool get_argument(lua_State *L, double &arg)
+            {
+                if (!check<Index>(L))
+                {
+                    return false;
+                }
+                arg = read<Index>(L);
+                return true;
+            }
+        };
+
+        template<>
+        struct Argument<std::string>
+        {
+            // value kinds read without conversion and the ones that are converted, used by std::variant
+            static constexpr unsigned ExactKinds = KindBit(LUA_TSTRING);
+            static constexpr unsigned ConvertibleKinds = IntegerBit | KindBit(LUA_TNUMBER);
+
+            template<int Index>
+            static bool check(lua_State *L)
+            {
+                return check(L, Index);
+            }
+
+            template<int Index>
+            static std::string read(lua_State *L)
+            {
+                return read(L, Index);
+            }
+
+            static bool check(lua_State *L, int index)
+            {
+                return lua_isstring(L, index);
+            }
+
+            static std::string read(lua_State *L, int index)
+            {
+                size_t length;
+                const char *s = luaL_checklstring(L, index, &length);
+                return {s, length};
+            }
+
+            template<int Index>
+            static bool get_argument(lua_State *L, std::string &arg)
+            {
+                if (!check<Index>(L))
+                {
+                    return false;
+                }
+                size_t length;
+                const char *s = luaL_checklstring(L, Index, &length);
+                arg.assign(s, length);
+                return true;
+            }
+        };
+
+        template<>
+        struct Argument<bool>
+        {
+            static constexpr unsigned ExactKinds = KindBit(LUA_TBOOLEAN);
+            static constexpr unsigned ConvertibleKinds = 0;
+
+            template<int Index>
+            static bool check(lua_State *L)
+            {
+                return check(L, Index);
+            }
+
+            template<int Index>
+            static bool read(lua_State *L)
+            {
+                return read(L, Index);
+            }
+
+            static bool check(lua_State *L, int index)
+            {
+                return lua_isboolean(L, index);
+            }
+
+            static bool read(lua_State *L, int index)
+            {
+                return lua_toboolean(L, index);
+            }
+
+            template<int Index>
+            static bool get_argument(lua_State *L, bool &arg)
+            {
+                if (!check<Index>(L))
+                {
+                    return false;
+                }
+                arg = read<Index>(L);
+                return true;
+            }
+        };
+
+        // nil (or missing argument), used mostly as std::variant alternative
+        template<typename ArgType> requires std::is_same_v<ArgType, std::monostate> || std::is_same_v<ArgType, std::nullptr_t>
+        struct Argument<ArgType>
+        {
+            static constexpr unsigned ExactKinds = NilBits;
+            static constexpr unsigned ConvertibleKinds = 0;
+
+            template<int Index>
+            static bool check(lua_State *L)
+            {
+                return check(L, Index);
+            }
+
+            template<int Index>
+            static ArgType read(lua_State */*L*/)
+            {
+                return {};
+            }
+
+            static bool check(lua_State *L, int index)
+            {
+                return lua_isnoneornil(L, index);
+            }
+
+            static ArgType read(lua_State */*L*/, int /*index*/)
+            {
+                return {};
+            }
+
+            template<int Index>
+            static bool get_argument(lua_State *L, ArgType &/*arg*/)
+            {
+                return check<Index>(L);
+            }
+        };
+
+        // nil or missing argument becomes std::nullopt
+        template<IsDirectArgument T>
+        struct Argument<std::optional<T> >
+        {
+            static constexpr unsigned ExactKinds = Argument<T>::ExactKinds | NilBits;
+            static constexpr unsigned ConvertibleKinds = Argument<T>::ConvertibleKinds;
+
+            template<int Index>
+            static bool check(lua_State *L)
+            {
+                return lua_isnoneornil(L, Index) || Argument<T>::template check<Index>(L);
+            }
+
+            template<int Index>
+            static std::optional<T> read(lua_State *L)
+            {
+                if (lua_isnoneornil(L, Index))
+                {
+                    return std::nullopt;
+                }
+                return Argument<T>::template read<Index>(L);
+            }
+
+            static bool check(lua_State *L, int index) requires IsRuntimeIndexArgument<T>
+            {
+                return lua_isnoneornil(L, index) || Argument<T>::check(L, index);
+            }
+
+            static std::optional<T> read(lua_State *L, int index) requires IsRuntimeIndexArgument<T>
+            {
+                if (lua_isnoneornil(L, index))
+                {
+                    return std::nullopt;
+                }
+                return Argument<T>::read(L, index);
+            }
+
+            template<int Index>
+            static bool get_argument(lua_State *L, std::optional<T> &arg)
+            {
+                if (!check<Index>(L))
+                {
+                    return false;
+                }
+                arg = read<Index>(L);
+                return true;
+            }
+        };
+
+        // alternative is picked by the kind of lua value through a table built at compile time,
+        // exact matches are preferred over conversions (e.g. 1.5 goes to double rather than int)
+        template<IsDirectArgument... Ts>
+        struct Argument<std::variant<Ts...> >
+        {
+            using VariantType = std::variant<Ts...>;
+
+            static constexpr unsigned ExactKinds = (Argument<Ts>::ExactKinds | ...);
+            static constexpr unsigned ConvertibleKinds = (Argument<Ts>::ConvertibleKinds | ...);
+
+            static constexpr std::array<int, KindsCount> Alternatives = []
+            {
+                constexpr std::array<unsigned, sizeof...(Ts)> exact = {Argument<Ts>::ExactKinds...};
+                constexpr std::array<unsigned, sizeof...(Ts)> convertible = {Argument<Ts>::ConvertibleKinds...};
+                std::array<int, KindsCount> table{};
+                for (int kind = 0; kind < KindsCount; ++kind)
+                {
+                    table[kind] = -1;
+                    for (const auto &kinds: {exact, convertible})
+                    {
+                        for (size_t i = 0; i < sizeof...(Ts) && table[kind] == -1; ++i)
+                        {
+                            if (kinds[i] & (1u << kind))
+                            {
+                                table[kind] = static_cast<int>(i);
+                            }
+                        }
+                    }
+                }
+                return table;
+            }();
+
+            template<int Index>
+            static bool check(lua_State *L)
+            {
+                return Alternatives[value_kind<Index>(L)] != -1;
+            }
+
+            template<int Index>
+            static VariantType read(lua_State *L)
+            {
+                return read_alternative<Index>(L, std::index_sequence_for<Ts...>{});
+            }
+
+            template<int Index>
+            static bool get_argument(lua_State *L, VariantType &arg)
+            {
+                if (!check<Index>(L))
+                {
+                    return false;
+                }
+                arg = read<Index>(L);
+                return true;
+            }
+
+        private:
+            template<int Index, size_t... I>
+            static VariantType read_alternative(lua_State *L, std::index_sequence<I...>)
+            {
+                using Reader = VariantType (*)(lua_State *);
+                static constexpr Reader readers[] = {
+                    [](lua_State *L) -> VariantType
+                    {
+                        return VariantType(std::in_place_index<I>,
+                                           Argument<std::variant_alternative_t<I, VariantType> >::template read<Index>(L));
+                    }...
+                };
+                return readers[Alternatives[value_kind<Index>(L)]](L);
+            }
+        };
+
+        template<typename T>
+        struct IsFlatMapT : std::false_type
+        {
+        };
+
+        template<typename K, typename V, typename C>
+        struct IsFlatMapT<FlatMap<K, V, C> > : std::true_type
+        {
+        };
+
+        // std::map, std::unordered_map, LuaVar::FlatMap and containers with the same interface
+        template<typename T>
+        concept IsMap = requires(T &map)
+        {
+            typename T::key_type;
+            typename T::mapped_type;
+            map.size();
+            map.begin()->second;
+            map.emplace(std::declval<typename T::key_type>(), std::declval<typename T::mapped_type>());
+        };
+
+        // converts table with keys and values of a single type each, the table is traversed twice: first to count
+        // entries so the container is allocated once, then to fill it
+        template<IsMap Map>
+        struct Argument<Map>
+        {
+            using Key = typename Map::key_type;
+            using Value = typename Map::mapped_type;
+
+            template<int Index>
+            static bool get_argument(lua_State *L, Map &arg)
+            {
+                if (!lua_istable(L, Index))
+                {
+                    return false;
+                }
+                const int table = lua_absindex(L, Index);
+
+                size_t count = 0;
+                lua_pushnil(L);
+                while (lua_next(L, table) != 0)
+                {
+                    lua_pop(L, 1);
+                    ++count;
+                }
+
+                arg.clear();
+                if constexpr (IsFlatMapT<Map>::value)
+                {
+                    typename Map::container_type entries;
+                    entries.reserve(count);
+                    if (!read_entries(L, table, [&entries](Key &&key, Value &&value)
+                    {
+                        entries.emplace_back(std::move(key), std::move(value));
+                    }))
+                    {
+                        return false;
+                    }
+                    arg = Map(std::move(entries));
+                    return true;
+                } else
+                {
+                    if constexpr (requires { arg.reserve(count); })
+                    {
+                        arg.reserve(count);
+                    }
+                    return read_entries(L, table, [&arg](Key &&key, Value &&value)
+                    {
+                        arg.emplace(std::move(key), std::move(value));
+                    });
+                }
+            }
+
+        private:
+            template<typename Sink>
+            static bool read_entries(lua_State *L, int table, Sink &&sink)
+            {
+                lua_pushnil(L);
+                while (lua_next(L, table) != 0)
+                {
+                    Key key{};
+                    Value value{};
+                    if (!Argument<Value>::template get_argument<-1>(L, value))
+                    {
+                        lua_pop(L, 2);
+                        return false;
+                    }
+                    lua_pop(L, 1);
+                    bool validKey;
+                    if (lua_type(L, -1) == LUA_TNUMBER)
+                    {
+                        // number keys are read from a copy, converting the original to string would break lua_next
+                        lua_pushvalue(L, -1);
+                        validKey = Argument<Key>::template get_argument<-1>(L, key);
+                        lua_pop(L, 1);
+                    } else
+                    {
+                        validKey = Argument<Key>::template get_argument<-1>(L, key);
+                    }
+                    if (!validKey)
+                    {
+                        lua_pop(L, 1);
+                        return false;
+                    }
+                    sink(std::move(key), std::move(value));
+                }
+                return true;
+            }
+        };
+
+        // object with unique address for every type, the address is fixed at link time, so it needs no
+        // synchronization and can be used as light userdata key of per-type registry entries from any thread;
+        // the object is writable, so identical code folding can't merge keys of different types
+        template<typename T>
+        struct TypeKey
+        {
+            static inline char Key;
+        };
+
+        template<typename T>
+        constexpr const void *GetTypeKey()
+        {
+            return &TypeKey<T>::Key;
+        }
+
+        // pushes metatable stored in the registry under `key`, returns true if it was just created
+        // (same contract as luaL_newmetatable, without formatting and hashing a name)
+        inline bool NewMetatable(lua_State *L, const void *key)
+        {
+            if (lua_rawgetp(L, LUA_REGISTRYINDEX, key) != LUA_TNIL)
+            {
+                return false;
+            }
+            lua_pop(L, 1);
+            lua_createtable(L, 0, 2);
+            lua_pushvalue(L, -1);
+            lua_rawsetp(L, LUA_REGISTRYINDEX, key);
+            return true;
+        }
+
+        // classes passed to lua by pointer as opaque userdata
+        template<typename T>
+        concept IsObjectType = !std::is_same_v<T, lua_State> && std::is_class_v<T> && !std::is_const_v<T>;
+
+        // userdata of an object, `ptr` is null once the object was moved out as std::unique_ptr;
+        // objects pushed as raw pointers are not owned
+        template<typename T>
+        struct ObjectHolder
+        {
+            T *ptr = nullptr;
+            std::shared_ptr<T> shared;
+            std::unique_ptr<T> unique;
+
+            [[nodiscard]] bool IsOwned() const
+            {
+                return shared != nullptr || unique != nullptr;
+            }
+        };
+
+        template<typename T>
+        struct ObjectCache
+        {
+        };
+
+        // holder of T at given index, nullptr if the value is not a userdata created for T
+        template<typename T>
+        ObjectHolder<T> *to_object(lua_State *L, int index)
+        {
+            if (lua_type(L, index) != LUA_TUSERDATA || !lua_getmetatable(L, index))
+            {
+                return nullptr;
+            }
+            lua_rawgetp(L, LUA_REGISTRYINDEX, GetTypeKey<ObjectHolder<T> >());
+            const bool same = lua_rawequal(L, -1, -2);
+            lua_pop(L, 2);
+            return same ? static_cast<ObjectHolder<T> *>(lua_touserdata(L, index)) : nullptr;
+        }
+
+        // pushes weak-valued table mapping object addresses to their userdata, creates it if needed
+        template<typename T>
+        void push_object_cache(lua_State *L)
+        {
+            if (NewMetatable(L, GetTypeKey<ObjectCache<T> >()))
+            {
+                lua_createtable(L, 0, 1);
+                lua_pushliteral(L, "v");
+                lua_setfield(L, -2, "__mode");
+                lua_setmetatable(L, -2);
+            }
+        }
+
+        template<typename T>
+        int destroy_object(lua_State *L)
+        {
+            static_cast<ObjectHolder<T> *>(lua_touserdata(L, 1))->~ObjectHolder<T>();
+            return 0;
+        }
+
+        // pushes the single userdata of the object, it is created on first push and reused while lua holds it,
+        // so scripts can compare objects and no allocation happens when the same object is pushed again
+        template<typename T>
+        ObjectHolder<T> *push_object(lua_State *L, T *ptr)
+        {
+            push_object_cache<T>(L);
+            if (lua_rawgetp(L, -1, ptr) == LUA_TUSERDATA)
+            {
+                lua_remove(L, -2);
+                return static_cast<ObjectHolder<T> *>(lua_touserdata(L, -1));
+            }
+            lua_pop(L, 1);
+
+            auto *holder = new(lua_newuserdatauv(L, sizeof(ObjectHolder<T>), 0)) ObjectHolder<T>{ptr, nullptr, nullptr};
+            if (NewMetatable(L, GetTypeKey<ObjectHolder<T> >()))
+            {
+                lua_pushcfunction(L, destroy_object<T>);
+                lua_setfield(L, -2, "__gc");
+            }
+            lua_setmetatable(L, -2);
+            lua_pushvalue(L, -1);
+            lua_rawsetp(L, -3, ptr);
+            lua_remove(L, -2);
+            return holder;
+        }
+
+        // raw pointers are never owned by lua, nil becomes nullptr; objects moved out of their userdata are rejected
+        template<IsObjectType T>
+        struct Argument<T *>
+        {
+            template<int Index>
+            static bool check(lua_State *L)
+            {
+                return check(L, Index);
+            }
+
+            template<int Index>
+            static T *read(lua_State *L)
+            {
+                return read(L, Index);
+            }
+
+            static bool check(lua_State *L, int index)
+            {
+                if (lua_isnil(L, index))
+                {
+                    return true;
+                }
+                auto *holder = to_object<T>(L, index);
+                return holder != nullptr && holder->ptr != nullptr;
+            }
+
+            static T *read(lua_State *L, int index)
+            {
+                auto *holder = to_object<T>(L, index);
+                return holder != nullptr ? holder->ptr : nullptr;
+            }
+
+            template<int Index>
+            static bool get_argument(lua_State *L, T *&arg)
+            {
+                if (!check<Index>(L))
+                {
+                    return false;
+                }
+                arg = read<Index>(L);
+                return true;
+            }
+        };
+
+        // shares ownership with lua, objects pushed as raw pointers are rejected since nobody could keep them alive
+        template<IsObjectType T>
+        struct Argument<std::shared_ptr<T> >
+        {
+            template<int Index>
+            static bool check(lua_State *L)
+            {
+                if (lua_isnil(L, Index))
+                {
+                    return true;
+                }
+                auto *holder = to_object<T>(L, Index);
+                return holder != nullptr && holder->IsOwned();
+            }
+
+            template<int Index>
+            static std::shared_ptr<T> read(lua_State *L)
+            {
+                auto *holder = to_object<T>(L, Index);
+                if (holder == nullptr)
+                {
+                    return nullptr;
+                }
+                if (holder->unique != nullptr)
+                {
+                    // object owned exclusively by lua becomes shared
+                    holder->shared = std::move(holder->unique);
+                }
+                return holder->shared;
+            }
+
+            template<int Index>
+            static bool get_argument(lua_State *L, std::shared_ptr<T> &arg)
+            {
+                if (!check<Index>(L))
+                {
+                    return false;
+                }
+                arg = read<Index>(L);
+                return true;
+            }
+        };
+
+        // takes the object away from lua, only possible if lua is its only owner;
+        // the userdata stays behind without an object
+        template<IsObjectType T>
+        struct Argument<std::unique_ptr<T> >
+        {
+            template<int Index>
+            static bool check(lua_State *L)
+            {
+                if (lua_isnil(L, Index))
+                {
+                    return true;
+                }
+                auto *holder = to_object<T>(L, Index);
+                return holder != nullptr && holder->unique != nullptr;
+            }
+
+            template<int Index>
+            static std::unique_ptr<T> read(lua_State *L)
+            {
+                auto *holder = to_object<T>(L, Index);
+                if (holder == nullptr)
+                {
+                    return nullptr;
+                }
+                // forget the address, it may be reused by another object
+                push_object_cache<T>(L);
+                lua_pushnil(L);
+                lua_rawsetp(L, -2, holder->ptr);
+                lua_pop(L, 1);
+                holder->ptr = nullptr;
+                return std::move(holder->unique);
+            }
+
+            template<int Index>
+            static bool get_argument(lua_State *L, std::unique_ptr<T> &arg)
+            {
+                if (!check<Index>(L))
+                {
+                    return false;
+                }
+                arg = read<Index>(L);
+                return true;
+            }
+        };
+
+        template<typename E>
+        concept IsEnum = std::is_enum_v<E>;
+
+        template<typename E>
+        concept IsNamedEnum = IsEnum<E> && requires { EnumNames<E>::Values; };
+
+        template<typename E>
+        concept IsFlagsEnum = IsNamedEnum<E> && requires { requires EnumNames<E>::Flags; };
+
+        // position of the name at given index in EnumNames<E>::Values, -1 if it is not a name of E
+        template<IsNamedEnum E>
+        int find_enum_name(lua_State *L, int index)
+        {
+            // lua interns short strings, so a name coming from a script literal has the same address on every call
+            // (and between check and read), the content is still compared as the address may have been reused
+            thread_local const char *lastName = nullptr;
+            thread_local int lastPosition = 0;
+
+            size_t length;
+            const char *name = lua_tolstring(L, index, &length);
+            if (name == lastName)
+            {
+                const std::string_view candidate = EnumNames<E>::Values[lastPosition].second;
+                if (candidate.size() == length && std::memcmp(candidate.data(), name, length) == 0)
+                {
+                    return lastPosition;
+                }
+            }
+            for (size_t i = 0; i < std::size(EnumNames<E>::Values); ++i)
+            {
+                // names usually differ in length or the first character, which is cheaper to check than memcmp
+                const std::string_view candidate = EnumNames<E>::Values[i].second;
+                if (candidate.size() == length && (length == 0 || candidate[0] == name[0]) &&
+                    std::memcmp(candidate.data(), name, length) == 0)
+                {
+                    lastName = name;
+                    lastPosition = static_cast<int>(i);
+                    return lastPosition;
+                }
+            }
+            return -1;
+        }
+
+        // integer or name of the value, flags also accept a table of names
+        template<IsEnum E>
+        struct Argument<E>
+        {
+            using Underlying = std::underlying_type_t<E>;
+
+            static constexpr unsigned ExactKinds = IntegerBit | (IsNamedEnum<E> ? KindBit(LUA_TSTRING) : 0) |
+                                                   (IsFlagsEnum<E> ? KindBit(LUA_TTABLE) : 0);
+            static constexpr unsigned ConvertibleKinds = 0;
+
+            template<int Index>
+            static bool check(lua_State *L)
+            {
+                return convert(L, Index).has_value();
+            }
+
+            // values are validated by check, variants pick the enum by the lua type alone
+            template<int Index>
+            static E read(lua_State *L)
+            {
+                if constexpr (IsNamedEnum<E>)
+                {
+                    if (lua_type(L, Index) == LUA_TSTRING)
+                    {
+                        const int position = find_enum_name<E>(L, Index);
+                        return position < 0 ? E{} : EnumNames<E>::Values[position].first;
+                    }
+                }
+                if constexpr (IsFlagsEnum<E>)
+                {
+                    if (lua_type(L, Index) == LUA_TTABLE)
+                    {
+                        return convert(L, Index).value_or(E{});
+                    }
+                }
+                return static_cast<E>(lua_tointeger(L, Index));
+            }
+
+            template<int Index>
+            static bool get_argument(lua_State *L, E &arg)
+            {
+                auto value = convert(L, Index);
+                if (!value)
+                {
+                    return false;
+                }
+                arg = *value;
+                return true;
+            }
+
+        private:
+            static std::optional<E> convert(lua_State *L, int index)
+            {
+                const int type = lua_type(L, index);
+                if (type == LUA_TNUMBER && lua_isinteger(L, index))
+                {
+                    const auto value = static_cast<E>(lua_tointeger(L, index));
+                    if constexpr (IsNamedEnum<E> && !IsFlagsEnum<E>)
+                    {
+                        for (const auto &entry: EnumNames<E>::Values)
+                        {
+                            if (entry.first == value)
+                            {
+                                return value;
+                            }
+                        }
+                        return std::nullopt;
+                    }
+                    return value;
+                }
+                if constexpr (IsNamedEnum<E>)
+                {
+                    if (type == LUA_TSTRING)
+                    {
+                        const int position = find_enum_name<E>(L, index);
+                        if (position < 0)
+                        {
+                            return std::nullopt;
+                        }
+                        return EnumNames<E>::Values[position].first;
+                    }
+                }
+                if constexpr (IsFlagsEnum<E>)
+                {
+                    if (type == LUA_TTABLE)
+                    {
+                        Underlying value = 0;
+                        const auto length = static_cast<lua_Integer>(lua_rawlen(L, index));
+                        for (lua_Integer i = 1; i <= length; ++i)
+                        {
+                            lua_rawgeti(L, index, i);
+                            const int position = lua_type(L, -1) == LUA_TSTRING ? find_enum_name<E>(L, -1) : -1;
+                            lua_pop(L, 1);
+                            if (position < 0)
+                            {
+                                return std::nullopt;
+                            }
+                            value |= static_cast<Underlying>(EnumNames<E>::Values[position].first);
+                        }
+                        return static_cast<E>(value);
+                    }
+                }
+                return std::nullopt;
+            }
+        };
+
+        // converts value on top of the stack, std::nullopt if it has a different type
+        template<typename T>
+        std::optional<T> read_top(lua_State *L)
+        {
+            if constexpr (IsDirectArgument<T>)
+            {
+                if (!Argument<T>::template check<-1>(L))
+                {
+                    return std::nullopt;
+                }
+                return Argument<T>::template read<-1>(L);
+            } else
+            {
+                T value{};
+                if (!Argument<T>::template get_argument<-1>(L, value))
+                {
+                    return std::nullopt;
+                }
+                return std::optional<T>(std::move(value));
+            }
+        }
+
+        template<typename ArgType>
+        bool push_result(lua_State *L, ArgType &arg);
+
+        template<IsMap Map>
+        bool push_result(lua_State *L, Map &arg);
+
+        template<IsEnum E>
+        bool push_result(lua_State *L, E &arg);
+
+        template<IsObjectType T>
+        bool push_result(lua_State *L, T *&arg);
+
+        template<IsObjectType T>
+        bool push_result(lua_State *L, std::shared_ptr<T> &arg);
+
+        template<IsObjectType T>
+        bool push_result(lua_State *L, std::unique_ptr<T> &arg);
+
+        template<typename T>
+        bool push_result(lua_State *L, std::optional<T> &arg);
+
+        template<typename... Ts>
+        bool push_result(lua_State *L, std::variant<Ts...> &arg);
+
+        template <typename ... Args, std::size_t... Indices>
+        constexpr bool push_tuple_result(lua_State *L, std::tuple<Args...> &arg, std::index_sequence<Indices...>) {
+            return ((push_result(L, std::get<Indices>(arg))) && ...);
+        }
+
+        template<typename ... Args>
+        bool push_result(lua_State *L, std::tuple<Args...> &arg)
+        {
+            return push_tuple_result(L, arg, std::make_index_sequence<std::tuple_size_v<std::tuple<Args...>>>{});
+        }
+
+        // primitive results are defined inline, so bound functions push them without an extra call
+        template<>
+        inline bool push_result(lua_State *L, std::string &arg)
+        {
+            lua_pushlstring(L, arg.data(), arg.size());
+            return true;
+        }
+
+        template<>
+        inline bool push_result(lua_State *L, const char* &arg)
+        {
+            lua_pushstring(L, arg);
+            return true;
+        }
+
+        template<>
+        inline bool push_result(lua_State *L, double &arg)
+        {
+            lua_pushnumber(L, arg);
+            return true;
+        }
+
+        template<>
+        inline bool push_result(lua_State *L, bool &arg)
+        {
+            lua_pushboolean(L, arg);
+            return true;
+        }
+
+        template<>
+        inline bool push_result(lua_State *L, int &arg)
+        {
+            lua_pushinteger(L, arg);
+            return true;
+        }
+
+        template<>
+        inline bool push_result(lua_State *L, std::monostate &/*arg*/)
+        {
+            lua_pushnil(L);
+            return true;
+        }
+
+        template<>
+        inline bool push_result(lua_State *L, std::nullptr_t &/*arg*/)
+        {
+            lua_pushnil(L);
+            return true;
+        }
+
+        template<typename T>
+        bool push_result(lua_State *L, std::optional<T> &arg)
+        {
+            if (!arg)
+            {
+                lua_pushnil(L);
+                return true;
+            }
+            return push_result(L, *arg);
+        }
+
+        template<typename... Ts>
+        bool push_result(lua_State *L, std::variant<Ts...> &arg)
+        {
+            return std::visit([L](auto &value) { return push_result(L, value); }, arg);
+        }
+
+        // named values are returned as names, flags and values without a name as integers
+        template<IsEnum E>
+        bool push_result(lua_State *L, E &arg)
+        {
+            if constexpr (IsNamedEnum<E> && !IsFlagsEnum<E>)
+            {
+                for (const auto &entry: EnumNames<E>::Values)
+                {
+                    if (entry.first == arg)
+                    {
+                        const std::string_view name = entry.second;
+                        lua_pushlstring(L, name.data(), name.size());
+                        return true;
+                    }
+                }
+            }
+            lua_pushinteger(L, static_cast<lua_Integer>(arg));
+            return true;
+        }
+
+        template<IsObjectType T>
+        bool push_result(lua_State *L, T *&arg)
+        {
+            if (arg == nullptr)
+            {
+                lua_pushnil(L);
+                return true;
+            }
+            push_object(L, arg);
+            return true;
+        }
+
+        template<IsObjectType T>
+        bool push_result(lua_State *L, std::shared_ptr<T> &arg)
+        {
+            if (arg == nullptr)
+            {
+                lua_pushnil(L);
+                return true;
+            }
+            auto *holder = push_object(L, arg.get());
+            if (!holder->IsOwned())
+            {
+                // the object was pushed as raw pointer before, lua holds it from now on
+                holder->shared = arg;
+            }
+            return true;
+        }
+
+        template<IsObjectType T>
+        bool push_result(lua_State *L, std::unique_ptr<T> &arg)
+        {
+            if (arg == nullptr)
+            {
+                lua_pushnil(L);
+                return true;
+            }
+            auto *holder = push_object(L, arg.get());
+            if (!holder->IsOwned())
+            {
+                holder->unique = std::move(arg);
+            }
+            return true;
+        }
+
+        template<IsMap Map>
+        bool push_result(lua_State *L, Map &arg)
+        {
+            // size the hash part up front, so filling the table doesn't rehash
+            lua_createtable(L, 0, static_cast<int>(arg.size()));
+            for (auto &entry: arg)
+            {
+                // keys are const in standard maps, push_result never modifies its argument
+                // on failure the partially filled table is dropped, nothing is left on the stack
+                if (!push_result(L, const_cast<typename Map::key_type &>(entry.first)))
+                {
+                    lua_pop(L, 1);
+                    return false;
+                }
+                if (!push_result(L, entry.second))
+                {
+                    lua_pop(L, 2);
+                    return false;
+                }
+                lua_rawset(L, -3);
+            }
+            return true;
+        }
+
+
+        template<::std::size_t I = 0,
+            typename... Tp>
+        inline typename ::std::enable_if<I == sizeof...(Tp), bool>::type
+        populate_arguments(lua_State */*L*/, ::std::tuple<Tp...> &/*t*/)
+        {
+            return true;
+        }
+
+        template<::std::size_t I = 0,
+            typename... Tp>
+        inline typename ::std::enable_if<I < sizeof...(Tp), bool>::type
+        populate_arguments(lua_State *L, ::std::tuple<Tp...> &t)
+        {
+            using TupleType = ::std::tuple<Tp...>;
+            return Argument<std::tuple_element_t<I, TupleType> >::template get_argument<I + 1>(L, ::std::get<I>(t)) &&
+                   populate_arguments<I + 1, Tp...>(L, t);
+        }
+
+        // same as populate_arguments, but reads the sizeof...(Tp) values on top of the stack
+        template<::std::size_t I = 0,
+            typename... Tp>
+        inline typename ::std::enable_if<I == sizeof...(Tp), bool>::type
+        populate_results(lua_State */*L*/, ::std::tuple<Tp...> &/*t*/)
+        {
+            return true;
+        }
+
+        template<::std::size_t I = 0,
+            typename... Tp>
+        inline typename ::std::enable_if<I < sizeof...(Tp), bool>::type
+        populate_results(lua_State *L, ::std::tuple<Tp...> &t)
+        {
+            using TupleType = ::std::tuple<Tp...>;
+            constexpr int Index = static_cast<int>(I) - static_cast<int>(sizeof...(Tp));
+            return Argument<std::tuple_element_t<I, TupleType> >::template get_argument<Index>(L, ::std::get<I>(t)) &&
+                   populate_results<I + 1, Tp...>(L, t);
+        }
+
+        // reads the sizeof...(Tp) values on top of the stack directly into caller provided variables
+        template<typename... Tp, std::size_t... I>
+        bool read_results_into(lua_State *L, std::tuple<Tp &...> &results, std::index_sequence<I...>)
+        {
+            constexpr int N = static_cast<int>(sizeof...(Tp));
+            return (Argument<Tp>::template get_argument<static_cast<int>(I) - N>(L, std::get<I>(results)) && ...);
+        }
+
+        template<::std::size_t I = 0, typename... Tp>
+        inline typename ::std::enable_if<I == sizeof...(Tp), void>::type
+        push_arguments(lua_State */*L*/, ::std::tuple<Tp...> &/*t*/)
+        {
+        }
+
+        template<::std::size_t I = 0, typename... Tp>
+        inline typename ::std::enable_if<I < sizeof...(Tp), void>::type
+        push_arguments(lua_State *L, ::std::tuple<Tp...> &t)
+        {
+            push_result(L, ::std::get<I>(t));
+            push_arguments<I + 1, Tp...>(L, t);
+        }
+
+
+    }
+
+    /**
+     * @class Returns
+     * @brief Output parameter of bound functions returning multiple values, results are pushed straight onto the lua stack.
+     *
+     * Must be the last parameter of the function, it doesn't consume any lua argument. The function should call it
+     * exactly once, results that were not provided are returned as nil. Unlike returning std::tuple, no intermediate
+     * tuple is default constructed and filled.
+     *
+     * @code
+     * void MinMax(int a, int b, LuaVar::Returns<int, int> out)
+     * {
+     *     out(std::min(a, b), std::max(a, b));
+     * }
+     * @endcode
+     */
+    template<typename... Ts>
+    class Returns
+    {
+        lua_State *L = nullptr;
+
+    public:
+        static constexpr int Count = static_cast<int>(sizeof...(Ts));
+
+        Returns() = default;
+
+        explicit Returns(lua_State *L) : L(L)
+        {
+        }
+
+        void operator()(Ts... values) const
+        {
+            (Internal::push_result(L, values), ...);
+        }
+    };
+
     namespace Internal
     {
-        struct none_type
+        // Varargs positions are only known at runtime, specializations without runtime index overloads
+        // get the value copied to the top of the stack
+        template<typename T>
+        struct VarargSlot
         {
-        };
+            static bool check(lua_State *L, int index)
+            {
+                if constexpr (IsRuntimeIndexArgument<T>)
+                {
+                    return Argument<T>::check(L, index);
+                } else
+                {
+                    lua_pushvalue(L, index);
+                    const bool valid = Argument<T>::template check<-1>(L);
+                    lua_pop(L, 1);
+                    return valid;
+                }
+            }
 
-        template<typename ArgType>
-        struct Argument
-        {
-            template<int Index>
-            static bool get_argument(lua_State */*L*/, ArgType &/*arg*/ = {})
+            static T read(lua_State *L, int index)
             {
-                return false;
+                if constexpr (IsRuntimeIndexArgument<T>)
+                {
+                    return Argument<T>::read(L, index);
+                } else
+                {
+                    lua_pushvalue(L, index);
+                    T value = Argument<T>::template read<-1>(L);
+                    lua_pop(L, 1);
+                    return value;
+                }
             }
         };
+    }
 
-        template<>
-        template<int Index>
-        inline bool Argument<int>::get_argument(lua_State *L, int &arg)
+    /**
+     * @class StackView
+     * @brief Raw view of the remaining lua arguments of a bound function, nothing is converted or copied.
+     *
+     * Must be the last lua argument of the function (it can only be followed by LuaVar::Returns).
+     * Positions are 0-based and relative to the first argument covered by the view.
+     *
+     * @code
+     * void Log(std::string level, LuaVar::StackView args)
+     * {
+     *     for (int i = 0; i < args.size(); ++i)
+     *         print_value(args.State(), args.Index(i));
+     * }
+     * @endcode
+     */
+    class StackView
+    {
+    protected:
+        lua_State *L = nullptr;
+        int _first = 1;
+        int _count = 0;
+
+    public:
+        StackView() = default;
+
+        /**
+         * @brief Covers stack slots from `first` up to the current top of the stack.
+         */
+        StackView(lua_State *L, int first) : L(L), _first(lua_absindex(L, first))
         {
-            if (!lua_isnumber(L, Index))
-            {
-                return false;
-            }
-            arg = static_cast<int>(luaL_checkinteger(L, Index));
-            return true;
+            _count = std::max(0, lua_gettop(L) - _first + 1);
         }
 
+        [[nodiscard]] lua_State *State() const
+        {
+            return L;
+        }
 
-        template<>
-        template<int Index>
-        inline bool Argument<double>::get_argument(lua_State *L, double &arg)
+        [[nodiscard]] int size() const
         {
-            if (!lua_isnumber(L, Index))
-            {
-                return false;
-            }
-            arg = luaL_checknumber(L, Index);
-            return true;
+            return _count;
         }
 
-        template<>
-        template<int Index>
-        inline bool Argument<std::string>::get_argument(lua_State *L, std::string &arg)
+        [[nodiscard]] bool empty() const
         {
-            if (!lua_isstring(L, Index))
-            {
-                return false;
-            }
-            auto s = luaL_checkstring(L, Index);
-            arg = s;
-            return true;
+            return _count == 0;
         }
 
-        template<typename ArgType>
-        bool push_result(lua_State *L, ArgType &arg);
+        /**
+         * @brief Absolute stack index of the value at given position.
+         */
+        [[nodiscard]] int Index(int position) const
+        {
+            return _first + position;
+        }
 
-        template <typename ... Args, std::size_t... Indices>
-        constexpr bool push_tuple_result(lua_State *L, std::tuple<Args...> &arg, std::index_sequence<Indices...>) {
-            return ((push_result(L, std::get<Indices>(arg))) && ...);
+        /**
+         * @brief Lua type of the value at given position.
+         */
+        [[nodiscard]] int Type(int position) const
+        {
+            return lua_type(L, Index(position));
         }
 
-        template<typename ... Args>
-        bool push_result(lua_State *L, std::tuple<Args...> &arg)
+        /**
+         * @brief Converts the value at given position.
+         * @return std::nullopt if the value has a different type.
+         */
+        template<typename T>
+        std::optional<T> Get(int position) const
         {
-            return push_tuple_result(L, arg, std::make_index_sequence<std::tuple_size_v<std::tuple<Args...>>>{});
+            lua_pushvalue(L, Index(position));
+            std::optional<T> res = Internal::read_top<T>(L);
+            lua_pop(L, 1);
+            return res;
         }
+    };
 
-        template<>
-        LuaVar_API bool push_result(lua_State *L, std::string &arg);
-        template<>
-        LuaVar_API bool push_result(lua_State *L, const char* &arg);
-        template<>
-        LuaVar_API bool push_result(lua_State *L, double &arg);
-        template<>
-        LuaVar_API bool push_result(lua_State *L, bool &arg);
-        template<>
-        LuaVar_API bool push_result(lua_State *L, int &arg);
+    /**
+     * @class Varargs
+     * @brief Remaining lua arguments of a bound function, all of them convertible to T.
+     *
+     * The arguments stay on the lua stack, each one is converted only when it is accessed.
+     * The function isn't called if any of the values has a different type, like with regular parameters.
+     *
+     * @code
+     * int Sum(LuaVar::Varargs<int> values)
+     * {
+     *     int sum = 0;
+     *     for (int value : values)
+     *         sum += value;
+     *     return sum;
+     * }
+     * @endcode
+     */
+    template<typename T> requires Internal::IsDirectArgument<T>
+    class Varargs : public StackView
+    {
+    public:
+        class iterator
+        {
+            const Varargs *_args = nullptr;
+            int _position = 0;
 
+        public:
+            using value_type = T;
+            using difference_type = std::ptrdiff_t;
 
-        template<::std::size_t I = 0,
-            typename... Tp>
-        inline typename ::std::enable_if<I == sizeof...(Tp), bool>::type
-        populate_arguments(lua_State */*L*/, ::std::tuple<Tp...> &/*t*/)
+            iterator() = default;
+
+            iterator(const Varargs *args, int position) : _args(args), _position(position)
+            {
+            }
+
+            T operator*() const
+            {
+                return (*_args)[_position];
+            }
+
+            iterator &operator++()
+            {
+                ++_position;
+                return *this;
+            }
+
+            iterator operator++(int)
+            {
+                iterator copy = *this;
+                ++_position;
+                return copy;
+            }
+
+            bool operator==(const iterator &other) const
+            {
+                return _position == other._position;
+            }
+        };
+
+        using StackView::StackView;
+
+        /**
+         * @brief Converts the value at given position, the value was validated when the function was called.
+         */
+        T operator[](int position) const
         {
-            return true;
+            return Internal::VarargSlot<T>::read(L, Index(position));
         }
 
-        template<::std::size_t I = 0,
-            typename... Tp>
-        inline typename ::std::enable_if<I < sizeof...(Tp), bool>::type
-        populate_arguments(lua_State *L, ::std::tuple<Tp...> &t)
+        [[nodiscard]] iterator begin() const
         {
-            using TupleType = ::std::tuple<Tp...>;
-            return Argument<std::tuple_element_t<I, TupleType> >::template get_argument<I + 1>(L, ::std::get<I>(t)) &&
-                   populate_arguments<I + 1, Tp...>(L, t);
+            return iterator(this, 0);
         }
 
-        template<::std::size_t I = 0, typename... Tp>
-        inline typename ::std::enable_if<I == sizeof...(Tp), void>::type
-        push_arguments(lua_State */*L*/, ::std::tuple<Tp...> &/*t*/)
+        [[nodiscard]] iterator end() const
         {
+            return iterator(this, _count);
         }
+    };
 
-        template<::std::size_t I = 0, typename... Tp>
-        inline typename ::std::enable_if<I < sizeof...(Tp), void>::type
-        push_arguments(lua_State *L, ::std::tuple<Tp...> &t)
+    namespace Internal
+    {
+        template<typename... Ts>
+        struct Argument<Returns<Ts...> >
         {
-            push_result(L, ::std::get<I>(t));
-            push_arguments<I + 1, Tp...>(L, t);
-        }
+            template<int Index>
+            static bool check(lua_State */*L*/)
+            {
+                return true;
+            }
+
+            template<int Index>
+            static Returns<Ts...> read(lua_State *L)
+            {
+                return Returns<Ts...>(L);
+            }
+
+            template<int Index>
+            static bool get_argument(lua_State *L, Returns<Ts...> &arg)
+            {
+                arg = Returns<Ts...>(L);
+                return true;
+            }
+        };
+
+        template<>
+        struct Argument<StackView>
+        {
+            template<int Index>
+            static bool check(lua_State */*L*/)
+            {
+                return true;
+            }
+
+            template<int Index>
+            static StackView read(lua_State *L)
+            {
+                return StackView(L, Index);
+            }
+
+            template<int Index>
+            static bool get_argument(lua_State *L, StackView &arg)
+            {
+                arg = read<Index>(L);
+                return true;
+            }
+        };
+
+        template<typename T>
+        struct Argument<Varargs<T> >
+        {
+            template<int Index>
+            static bool check(lua_State *L)
+            {
+                const int top = lua_gettop(L);
+                for (int i = lua_absindex(L, Index); i <= top; ++i)
+                {
+                    if (!VarargSlot<T>::check(L, i))
+                    {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            template<int Index>
+            static Varargs<T> read(lua_State *L)
+            {
+                return Varargs<T>(L, Index);
+            }
+
+            template<int Index>
+            static bool get_argument(lua_State *L, Varargs<T> &arg)
+            {
+                if (!check<Index>(L))
+                {
+                    return false;
+                }
+                arg = read<Index>(L);
+                return true;
+            }
+        };
+
+        // number of results written by Returns<...>, -1 for any other type
+        template<typename T>
+        struct ReturnsCount : std::integral_constant<int, -1>
+        {
+        };
+
+        template<typename... Ts>
+        struct ReturnsCount<Returns<Ts...> > : std::integral_constant<int, Returns<Ts...>::Count>
+        {
+        };
+
+        // number of results written through Returns<...> parameter, -1 if the function doesn't have one
+        template<typename Arguments>
+        struct ResultsWriterCount : std::integral_constant<int, -1>
+        {
+        };
 
+        template<typename... Args> requires (sizeof...(Args) > 0)
+        struct ResultsWriterCount<std::tuple<Args...> >
+            : ReturnsCount<std::tuple_element_t<sizeof...(Args) - 1, std::tuple<Args...> > >
+        {
+            static_assert(((ReturnsCount<std::remove_cvref_t<Args> >::value >= 0) + ... + 0) <=
+                          (ResultsWriterCount::value >= 0 ? 1 : 0),
+                          "LuaVar::Returns must be the last parameter of the function");
+        };
 
         template<typename T, LuaVarFlags flags>
         struct FunctorDescriptor
@@ -141,40 +1565,110 @@ namespace LuaVar
 
             static int call(lua_State *L, FunctorType functor)
             {
-                Arguments items;
-                // gather arguments from lua stack and push them into `items` structure
-                auto b = populate_arguments(L, items);
-
-                if (!b)
+                if constexpr (DirectArguments)
+                {
+                    return call_direct(L, functor, std::make_index_sequence<std::tuple_size_v<Arguments> >{});
+                } else
                 {
-                    if constexpr (flags::IsSet(LuaCallSoftError))
+                    Arguments items;
+                    // gather arguments from lua stack and push them into `items` structure
+                    if (!populate_arguments(L, items))
+                    {
+                        return invalid_arguments();
+                    }
+
+                    if constexpr (WrittenResults >= 0)
                     {
-                        printf("Invalid arguments provided\n");
-                        fflush(stdout);
+                        const int top = lua_gettop(L);
+                        std::apply(functor, std::move(items));
+                        return written_results(L, top);
+                    } else if constexpr (std::is_same_v<ReturnType, void>)
+                    {
+                        // Functor is of void return type, just call it
+                        std::apply(functor, std::move(items));
                         return 0;
                     } else
                     {
-                        // luaL_error(L, "Invalid arguments");
-                        return -1;
+                        // Functor is of non-void return type, call and assign result
+                        ReturnType res = std::apply(functor, std::move(items));
+                        return push_results(L, res);
                     }
                 }
+            }
+
+        private:
+            template<typename>
+            struct AllDirect : std::false_type
+            {
+            };
+
+            template<typename... Args>
+            struct AllDirect<std::tuple<Args...> > : std::bool_constant<(IsDirectArgument<Args> && ...)>
+            {
+            };
+
+            static constexpr bool DirectArguments = AllDirect<Arguments>::value;
+
+            static constexpr int WrittenResults = ResultsWriterCount<Arguments>::value;
+            static_assert(WrittenResults < 0 || std::is_same_v<ReturnType, void>,
+                          "functions writing results through LuaVar::Returns must return void");
+
+            // exactly the declared number of results is returned, missing ones become nil
+            static int written_results(lua_State *L, int top)
+            {
+                lua_settop(L, top + WrittenResults);
+                return WrittenResults;
+            }
+
+            // same code a hand written lua_CFunction would have: validate the stack, then read values
+            // straight into the call
+            template<std::size_t... I>
+            static int call_direct(lua_State *L, FunctorType functor, std::index_sequence<I...>)
+            {
+                if (!(Argument<std::tuple_element_t<I, Arguments> >::template check<I + 1>(L) && ...))
+                {
+                    return invalid_arguments();
+                }
 
-                if constexpr (std::is_same_v<ReturnType, void>)
+                if constexpr (WrittenResults >= 0)
+                {
+                    const int top = lua_gettop(L);
+                    functor(Argument<std::tuple_element_t<I, Arguments> >::template read<I + 1>(L)...);
+                    return written_results(L, top);
+                } else if constexpr (std::is_same_v<ReturnType, void>)
                 {
-                    // Functor is of void return type, just call it
-                    std::apply(functor, items);
+                    functor(Argument<std::tuple_element_t<I, Arguments> >::template read<I + 1>(L)...);
                     return 0;
                 } else
                 {
-                    // Functor is of non-void return type, call and assign result
-                    ReturnType res = std::apply(functor, items);
-                    push_result(L, res);
-                    if constexpr (IsTuple<ReturnType>)
-                        return std::tuple_size_v<ReturnType>;
-                    else
-                        return 1;
+                    ReturnType res = functor(Argument<std::tuple_element_t<I, Arguments> >::template read<I + 1>(L)...);
+                    return push_results(L, res);
+                }
+            }
+
+            static int invalid_arguments()
+            {
+                if constexpr (flags::IsSet(LuaCallSoftError))
+                {
+                    printf("Invalid arguments provided\n");
+                    fflush(stdout);
+                    return 0;
+                } else
+                {
+                    // luaL_error(L, "Invalid arguments");
+                    return -1;
                 }
             }
+
+            template<typename Result>
+            static int push_results(lua_State *L, Result &res)
+            {
+                push_result(L, res);
+                if constexpr (IsTuple<Result>)
+                    return std::tuple_size_v<Result>;
+                else
+                    return 1;
+            }
         };
 
 
@@ -187,6 +1681,7 @@ namespace LuaVar
             using FunctorType = Functor;
 
             static Functor &GetFunctor(Functor &functor) { return functor; }
+            static Functor &&GetFunctor(Functor &&functor) { return std::move(functor); }
         };
 
 
@@ -199,6 +1694,11 @@ namespace LuaVar
             {
                 return complexFunctor._functor;
             }
+
+            static FunctorType &&GetFunctor(CallableDyn<Functor> &&complexFunctor)
+            {
+                return std::move(complexFunctor._functor);
+            }
         };
 
         template<auto functor, LuaVarFlags flags>
@@ -235,12 +1735,31 @@ namespace LuaVar
             }
         };
 
-        static int GetAvailableId()
+        template<typename T>
+        struct IsMutableCallOperator : std::false_type
+        {
+        };
+
+        template<typename ClassType, typename ReturnType, typename... Args>
+        struct IsMutableCallOperator<ReturnType(ClassType::*)(Args...)> : std::true_type
         {
-            static int id = 0;
-            return ++id;
+        };
+
+        template<typename T>
+        constexpr bool HasMutableCallOperator()
+        {
+            if constexpr (requires { &T::operator(); })
+                return IsMutableCallOperator<decltype(&T::operator())>::value;
+            else
+                return false;
         }
 
+        // functors which can be copied byte by byte into closure upvalues, each call works on a fresh copy
+        // so `mutable` lambdas (which expect their state to persist) are excluded
+        template<typename T>
+        concept IsInlineFunctor = std::is_trivially_copyable_v<T> && sizeof(T) <= LUAVAR_INLINE_CAPTURE_SIZE &&
+                                  !HasMutableCallOperator<T>();
+
         template<IsDynamicFunctor Functor, LuaVarFlags flags>
         class DynamicBind
         {
@@ -256,32 +1775,86 @@ namespace LuaVar
             const char *_name;
             ActualFunctorType functor;
 
-            struct Wrapper
-            {
-                ActualFunctorType functor;
+            // the functor lives directly in userdata memory, lua only guarantees alignment of pointers and numbers,
+            // so over-aligned functors get extra space to be aligned manually
+            static constexpr size_t StorageSlack = alignof(ActualFunctorType) > alignof(void *)
+                                                       ? alignof(ActualFunctorType) - 1
+                                                       : 0;
 
-                explicit Wrapper(ActualFunctorArgType functor) : functor(functor)
+            static ActualFunctorType *Storage(void *userdata)
+            {
+                if constexpr (StorageSlack != 0)
                 {
+                    auto address = reinterpret_cast<std::uintptr_t>(userdata);
+                    address = (address + StorageSlack) & ~static_cast<std::uintptr_t>(StorageSlack);
+                    userdata = reinterpret_cast<void *>(address);
                 }
+                return std::launder(static_cast<ActualFunctorType *>(userdata));
+            }
 
-                static int Clear(lua_State *L)
+            static int Clear(lua_State *L)
+            {
+                Storage(lua_touserdata(L, 1))->~ActualFunctorType();
+                return 0;
+            }
+
+            // number of integer upvalues holding bytes of an inline functor
+            static constexpr int InlineUpvalues = static_cast<int>(
+                (sizeof(ActualFunctorType) + sizeof(lua_Integer) - 1) / sizeof(lua_Integer));
+
+            static void PushInlineFunctor(lua_State *L, const ActualFunctorType &functor)
+            {
+                // stateless trampoline, the functor is rebuilt from upvalues on every call
+                auto wrapper = [](lua_State *L)
                 {
-                    Wrapper *obj = *reinterpret_cast<Wrapper **>(lua_touserdata(L, 1));
-                    delete obj;
-                    return 0;
+                    lua_Integer words[InlineUpvalues];
+                    for (int i = 0; i < InlineUpvalues; ++i)
+                    {
+                        words[i] = lua_tointeger(L, lua_upvalueindex(i + 1));
+                    }
+                    alignas(ActualFunctorType) unsigned char storage[sizeof(ActualFunctorType)];
+                    std::memcpy(storage, words, sizeof(ActualFunctorType));
+                    auto &capture = *std::launder(reinterpret_cast<ActualFunctorType *>(storage));
+
+                    int res = K::call(L, capture);
+                    if (res == -1)
+                    {
+                        lua_pushfstring(L, "Invalid arguments");
+                        return 1;
+                    }
+                    return res;
+                };
+
+                lua_Integer words[InlineUpvalues] = {};
+                std::memcpy(words, &functor, sizeof(ActualFunctorType));
+                for (lua_Integer word: words)
+                {
+                    lua_pushinteger(L, word);
                 }
-            };
+                lua_pushcclosure(L, wrapper, InlineUpvalues);
+            }
 
         public:
 
-            static void PushFunctor(lua_State *L, ActualFunctorArgType functor)
+            /**
+             * @brief Pushes closure calling the functor, rvalue functors are moved into lua owned storage without copying.
+             */
+            template<typename F>
+            static void PushFunctor(lua_State *L, F &&functor)
             {
+                if constexpr (IsInlineFunctor<ActualFunctorType>)
+                {
+                    // small trivially copyable captures don't need heap allocation nor finalizer
+                    PushInlineFunctor(L, functor);
+                    return;
+                }
+
                 // create lambda that handles actual call into functor
                 auto wrapper = [](lua_State *L)
                 {
-                    auto *capture = *reinterpret_cast<Wrapper **>(lua_touserdata(L, lua_upvalueindex(1)));
+                    auto *capture = Storage(lua_touserdata(L, lua_upvalueindex(1)));
 
-                    int res = K::call(L, capture->functor);
+                    int res = K::call(L, *capture);
                     if (res == -1)
                     {
                         lua_pushfstring(L, "Invalid arguments");
@@ -291,17 +1864,15 @@ namespace LuaVar
                     return res;
                 };
 
-                // Allocate userdata
-                auto **ud = static_cast<Wrapper **>(lua_newuserdata(L, sizeof(Wrapper*)));
-                *ud = new Wrapper(functor);
+                // Allocate userdata and construct the functor in place
+                void *ud = lua_newuserdatauv(L, sizeof(ActualFunctorType) + StorageSlack, 0);
+                new(Storage(ud)) ActualFunctorType(std::forward<F>(functor));
 
                 // Create and set the metatable
-                static auto id = GetAvailableId();
-                auto meta_name = std::string("Function#") + std::to_string(id);
-                if (luaL_newmetatable(L, meta_name.c_str()))
+                if (NewMetatable(L, GetTypeKey<DynamicBind>()))
                 {
                     // Ensure metatable is created only once
-                    lua_pushcfunction(L, Wrapper::Clear);
+                    lua_pushcfunction(L, Clear);
                     lua_setfield(L, -2, "__gc"); // Set __gc field in the metatable
                 }
                 lua_setmetatable(L, -2);
@@ -315,11 +1886,28 @@ namespace LuaVar
             {
             }
 
-            void Bind(lua_State *L)
+            constexpr DynamicBind(char const *name, Functor &&functor) : _name(name),
+                                                                         functor(Adapter::GetFunctor(std::move(functor)))
+            {
+            }
+
+            /**
+             * @brief Binds a copy of the functor, the binding can be used again.
+             */
+            void Bind(lua_State *L) &
             {
                 PushFunctor(L, functor);
                 lua_setglobal(L, _name);
             }
+
+            /**
+             * @brief Moves the functor into lua, used when binding straight from CppFunction(...).Bind(L).
+             */
+            void Bind(lua_State *L) &&
+            {
+                PushFunctor(L, std::move(functor));
+                lua_setglobal(L, _name);
+            }
         };
 
         template<typename ArgType>
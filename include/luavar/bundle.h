@@ -0,0 +1,150 @@
+// Copyright (c) Mateusz Raczynski 2025.
+// The software is provided AS IS, with no guarantees for it to work correctly.
+// The author doesn't take any responsibility for any damages done.
+
+#ifndef LUAVAR_BUNDLE_H
+#define LUAVAR_BUNDLE_H
+
+#include <lua.hpp>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <luavar/config.h>
+#include <luavar/state.h>
+
+namespace LuaVar
+{
+    /**
+     * @class ScriptBundle
+     * @brief Read-only set of precompiled scripts stored in a single file, see ScriptBundleBuilder.
+     *
+     * The file is mapped into memory and chunks are loaded straight from the mapping, so opening a bundle costs
+     * a single mapping instead of reading and compiling every script, and all states of the process share the same
+     * page cache backed bytes. Scripts are found by name with a binary search over the sorted index.
+     *
+     * @code
+     * std::string error;
+     * auto bundle = LuaVar::ScriptBundle::Open("scripts.bundle", error);
+     * if (bundle == nullptr)
+     *     log(error);
+     * LuaVar::ScriptBundle::AddSearcher(L, bundle); // require("ai.pathfinding") now looks into the bundle
+     * if (bundle->Load(L, "main") != LUA_OK || lua_pcall(L, 0, 0, 0) != LUA_OK)
+     *     log(lua_tostring(L, -1));
+     * @endcode
+     */
+    class LuaVar_API ScriptBundle
+    {
+    public:
+        /**
+         * @brief Maps the bundle file into memory and validates its index.
+         * @return nullptr with the error set if the file can't be mapped, is not a bundle or was built for
+         * a different version of lua.
+         */
+        static std::shared_ptr<ScriptBundle> Open(const std::string &path, std::string &error);
+
+        ~ScriptBundle();
+
+        ScriptBundle(const ScriptBundle &) = delete;
+        ScriptBundle &operator=(const ScriptBundle &) = delete;
+
+        /**
+         * @brief Number of scripts in the bundle.
+         */
+        [[nodiscard]] size_t Size() const
+        {
+            return _count;
+        }
+
+        /**
+         * @brief Name of the script at given position, names are sorted.
+         */
+        [[nodiscard]] std::string_view Name(size_t index) const;
+
+        [[nodiscard]] bool Contains(std::string_view name) const;
+
+        /**
+         * @brief Precompiled chunk of the script, empty if there is no such script.
+         */
+        [[nodiscard]] std::string_view Chunk(std::string_view name) const;
+
+        /**
+         * @brief Pushes the script as a function, like luaL_loadfile.
+         * @return LUA_OK, or the error code with an error message pushed instead (LUA_ERRFILE if there is
+         * no such script).
+         */
+        int Load(lua_State *L, std::string_view name) const;
+
+        /**
+         * @brief Makes `require` look for modules in the bundle, before the lua and C searchers.
+         *
+         * The state keeps the bundle alive. Module names are the script names.
+         * @return false if the package library is not opened in the state.
+         */
+        static bool AddSearcher(lua_State *L, const std::shared_ptr<ScriptBundle> &bundle);
+
+    private:
+        friend class ScriptBundleBuilder;
+        struct Entry;
+
+        ScriptBundle(void *mapping, size_t size);
+
+        const Entry *Find(std::string_view name) const;
+
+        void *_mapping;
+        size_t _size;
+        const char *_data;
+        const Entry *_entries = nullptr;
+        size_t _count = 0;
+    };
+
+    /**
+     * @class ScriptBundleBuilder
+     * @brief Compiles scripts and writes them as a bundle to be opened by ScriptBundle.
+     *
+     * The bundles are built by the `luavar_bundle` tool (BUILD_TOOLS option) or at runtime.
+     * Bytecode is specific to the lua version and its number types, so bundles are built with the same lua
+     * the application uses.
+     */
+    class LuaVar_API ScriptBundleBuilder
+    {
+    public:
+        /**
+         * @param strip whether to drop debug information (line numbers, local names) for smaller chunks
+         */
+        explicit ScriptBundleBuilder(bool strip = false);
+
+        /**
+         * @brief Compiles the script and adds it under given name.
+         * @return false with the error set on syntax errors and duplicate names.
+         */
+        bool Add(const std::string &name, std::string_view source, std::string &error);
+
+        /**
+         * @brief Reads, compiles and adds the script file.
+         */
+        bool AddFile(const std::string &name, const std::string &path, std::string &error);
+
+        [[nodiscard]] size_t Size() const
+        {
+            return _scripts.size();
+        }
+
+        /**
+         * @brief Writes the bundle with all scripts added so far.
+         */
+        bool Write(const std::string &path, std::string &error) const;
+
+    private:
+        bool Compile(const std::string &name, std::string_view source, const std::string &chunkName,
+                     std::string &error);
+
+        LuaState _state;
+        bool _strip;
+        std::vector<std::pair<std::string, std::string> > _scripts;
+    };
+}
+
+#endif //LUAVAR_BUNDLE_H
@@ -0,0 +1,133 @@
+// Copyright (c) Mateusz Raczynski 2025.
+// The software is provided AS IS, with no guarantees for it to work correctly.
+// The author doesn't take any responsibility for any damages done.
+
+#ifndef LUAVAR_CHANNEL_H
+#define LUAVAR_CHANNEL_H
+
+#include <lua.hpp>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <luavar/config.h>
+
+namespace LuaVar
+{
+    namespace Internal
+    {
+        struct ChannelAccess;
+    }
+
+    /**
+     * @class Channel
+     * @brief Bounded multi-producer multi-consumer queue of lua values, used to pass messages between states
+     * running on different threads.
+     *
+     * Values are serialized into a compact binary message when sent and deserialized directly into the receiving
+     * state. Supported values are nil, booleans, numbers, strings and flat tables (tables whose keys and values are
+     * all of the former types). The queue itself is a lock-free ring buffer, threads only block (without spinning)
+     * when the channel is full or empty.
+     *
+     * In lua the channel is a userdata with methods:
+     * - `ch:send(value)` waits while the channel is full,
+     * - `ch:recv()` waits for a value and returns it,
+     * - `ch:try_recv()` returns true and the value, or false if the channel is empty.
+     *
+     * When called from a coroutine, waiting yields instead of blocking the thread, the coroutine retries the
+     * operation once it is resumed (resume values are ignored). Outside of coroutines waiting blocks the thread.
+     *
+     * @code
+     * auto jobs = LuaVar::Channel::Create(1024);
+     * LuaVar::Channel::Bind(producer, "jobs", jobs);
+     * LuaVar::Channel::Bind(consumer, "jobs", jobs);
+     * @endcode
+     */
+    class LuaVar_API Channel
+    {
+    public:
+        /**
+         * @brief Creates channel holding up to `capacity` messages (rounded up to a power of two).
+         */
+        static std::shared_ptr<Channel> Create(size_t capacity);
+
+        ~Channel();
+
+        Channel(const Channel &) = delete;
+        Channel &operator=(const Channel &) = delete;
+
+        [[nodiscard]] size_t Capacity() const
+        {
+            return _mask + 1;
+        }
+
+        /**
+         * @brief Serializes value at given index and sends it if there is space.
+         * @return false if the channel is full or the value is not supported (see IsSupported).
+         */
+        bool TrySend(lua_State *L, int index);
+
+        /**
+         * @brief Sends value at given index, waits (blocks the thread) while the channel is full.
+         * @return false if the value is not supported.
+         */
+        bool Send(lua_State *L, int index);
+
+        /**
+         * @brief Pushes the oldest value if there is one.
+         * @return false (with nothing pushed) if the channel is empty.
+         */
+        bool TryReceive(lua_State *L);
+
+        /**
+         * @brief Pushes the oldest value, waits (blocks the thread) while the channel is empty.
+         */
+        void Receive(lua_State *L);
+
+        /**
+         * @brief Whether the value at given index can be sent through a channel.
+         */
+        static bool IsSupported(lua_State *L, int index);
+
+        /**
+         * @brief Pushes userdata representing the channel onto the lua stack.
+         */
+        static void Push(lua_State *L, const std::shared_ptr<Channel> &channel);
+
+        /**
+         * @brief Makes the channel available as a global variable with the given name.
+         */
+        static void Bind(lua_State *L, const char *name, const std::shared_ptr<Channel> &channel);
+
+    private:
+        friend struct Internal::ChannelAccess;
+
+        // slot of the ring buffer (Vyukov's bounded queue): the sequence tells whether the slot is ready
+        // to be written (sequence == position) or read (sequence == position + 1) at given position
+        struct Cell
+        {
+            std::atomic<size_t> sequence;
+            std::string message;
+        };
+
+        explicit Channel(size_t capacity);
+
+        bool TryPush(std::string &message);
+        bool TryPop(std::string &message);
+        void WaitForReceive(uint32_t seen);
+        void WaitForSend(uint32_t seen);
+
+        std::unique_ptr<Cell[]> _cells;
+        size_t _mask;
+        alignas(64) std::atomic<size_t> _sendPosition{0};
+        alignas(64) std::atomic<size_t> _receivePosition{0};
+        // incremented after every send/receive, blocked threads wait for them to change
+        alignas(64) std::atomic<uint32_t> _sent{0};
+        std::atomic<uint32_t> _received{0};
+        // threads blocked in Receive/Send, reset by the notifying side so a wait costs a single wake up
+        std::atomic<uint32_t> _receivers{0};
+        std::atomic<uint32_t> _senders{0};
+    };
+}
+
+#endif //LUAVAR_CHANNEL_H
@@ -8,4 +8,10 @@
 // #define LuaVar_API __declspec(dllexport)
 #define LuaVar_API
 
+// Capture lambdas that are trivially copyable and not bigger than this many bytes are stored directly
+// in integer upvalues of the lua closure, bigger ones go to a heap allocated wrapper with `__gc`
+#ifndef LUAVAR_INLINE_CAPTURE_SIZE
+#define LUAVAR_INLINE_CAPTURE_SIZE 16
+#endif
+
 #endif //LUAVAR_CONFIG_H
@@ -0,0 +1,118 @@
+// Copyright (c) Mateusz Raczynski 2025.
+// The software is provided AS IS, with no guarantees for it to work correctly.
+// The author doesn't take any responsibility for any damages done.
+
+#ifndef LUAVAR_ENVIRONMENT_H
+#define LUAVAR_ENVIRONMENT_H
+
+#include <lua.hpp>
+#include <luavar/config.h>
+
+namespace LuaVar
+{
+    /**
+     * @class Environment
+     * @brief Isolated set of globals layered on top of a template state.
+     *
+     * The template is the regular global table of the state, filled once with scripts loaded through
+     * Environment::LoadTemplate. Each Environment is a table whose metatable falls back to the template globals
+     * for reads, while all global writes land in the environment itself. Activating an environment
+     * redirects `_ENV` of every template chunk to it, so functions defined by template scripts (called e.g. through
+     * LuaFunction) read and write request-local globals. Reset() drops all request-local data in place.
+     *
+     * Only the global namespace is isolated, tables owned by the template (e.g. `string` or `config`)
+     * are shared and can still be mutated by scripts.
+     *
+     * @code
+     * LuaVar::Environment::LoadTemplate(L, handlers_script);
+     * LuaVar::Environment env(L);
+     * {
+     *     LuaVar::Environment::Scope scope(env);
+     *     handle_request(L, request_id);
+     * }
+     * env.Reset();
+     * @endcode
+     */
+    class LuaVar_API Environment
+    {
+        lua_State *L;
+        int _ref;
+
+    public:
+        /**
+         * @class Scope
+         * @brief Activates the environment for its lifetime, the previously active environment (or the template
+         * globals) is restored on destruction, so scopes can be nested.
+         */
+        class Scope
+        {
+            lua_State *L;
+            int _previous;
+
+        public:
+            explicit Scope(const Environment &environment) : L(environment.L), _previous(SaveActive(L))
+            {
+                environment.Activate();
+            }
+
+            ~Scope()
+            {
+                RestoreActive(L, _previous);
+            }
+
+            Scope(const Scope &) = delete;
+            Scope &operator=(const Scope &) = delete;
+        };
+
+        explicit Environment(lua_State *L);
+        ~Environment();
+
+        Environment(const Environment &) = delete;
+        Environment &operator=(const Environment &) = delete;
+        Environment(Environment &&other) noexcept;
+        Environment &operator=(Environment &&other) noexcept;
+
+        /**
+         * @brief Loads and runs a script in the template (global) environment.
+         *
+         * The chunk is remembered once it runs successfully, so functions defined by it follow the currently
+         * active environment.
+         * @return true on success, on failure the error message is left on the stack.
+         */
+        static bool LoadTemplate(lua_State *L, const char *script, const char *chunkName = "=template");
+
+        /**
+         * @brief Makes template functions use this environment as their globals.
+         */
+        void Activate() const;
+
+        /**
+         * @brief Points template functions back to the template globals.
+         */
+        static void Deactivate(lua_State *L);
+
+        /**
+         * @brief Runs ad-hoc script with this environment as its globals.
+         * @return true on success, on failure the error message is left on the stack.
+         */
+        bool Run(const char *script, const char *chunkName = "=environment") const;
+
+        /**
+         * @brief Drops all globals set within this environment, the table itself is reused.
+         */
+        void Reset() const;
+
+        /**
+         * @brief Pushes the environment table onto the stack.
+         */
+        void Push() const;
+
+    private:
+        // references the `_ENV` currently used by template chunks
+        static int SaveActive(lua_State *L);
+        // makes the referenced `_ENV` active again and releases the reference
+        static void RestoreActive(lua_State *L, int ref);
+    };
+}
+
+#endif //LUAVAR_ENVIRONMENT_H
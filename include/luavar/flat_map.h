@@ -0,0 +1,163 @@
+// Copyright (c) Mateusz Raczynski 2025.
+// The software is provided AS IS, with no guarantees for it to work correctly.
+// The author doesn't take any responsibility for any damages done.
+
+#ifndef LUAVAR_FLAT_MAP_H
+#define LUAVAR_FLAT_MAP_H
+
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace LuaVar
+{
+    /**
+     * @class FlatMap
+     * @brief Associative container keeping its entries sorted in a single contiguous vector.
+     *
+     * Lookups are binary searches over contiguous memory, which is considerably more cache friendly than
+     * node based std::map for small and medium sized, rarely modified maps (e.g. configuration or entity attributes).
+     * Insertion and erasure are linear. The interface follows std::map, so it can be used as a drop-in replacement
+     * and it can be passed to and returned from bound functions the same way.
+     *
+     * @code
+     * LuaVar::FlatMap<std::string, int> attributes;
+     * attributes["strength"] = 10;
+     * @endcode
+     */
+    template<typename Key, typename Value, typename Compare = std::less<Key> >
+    class FlatMap
+    {
+    public:
+        using key_type = Key;
+        using mapped_type = Value;
+        using value_type = std::pair<Key, Value>;
+        using key_compare = Compare;
+        using container_type = std::vector<value_type>;
+        using size_type = typename container_type::size_type;
+        using iterator = typename container_type::iterator;
+        using const_iterator = typename container_type::const_iterator;
+
+        FlatMap() = default;
+
+        /**
+         * @brief Builds the map from unordered entries with a single sort, if a key repeats the last entry wins.
+         */
+        explicit FlatMap(container_type entries, Compare compare = Compare()) : _entries(std::move(entries)),
+                                                                              _compare(std::move(compare))
+        {
+            std::stable_sort(_entries.begin(), _entries.end(), [this](const value_type &a, const value_type &b)
+            {
+                return _compare(a.first, b.first);
+            });
+            // keep the last of equal keys: walk backwards and move unique entries to the end
+            auto out = _entries.end();
+            for (auto it = _entries.end(); it != _entries.begin();)
+            {
+                --it;
+                if (out == _entries.end() || _compare(it->first, out->first))
+                {
+                    --out;
+                    if (out != it)
+                    {
+                        *out = std::move(*it);
+                    }
+                }
+            }
+            _entries.erase(_entries.begin(), out);
+        }
+
+        iterator begin() { return _entries.begin(); }
+        iterator end() { return _entries.end(); }
+        const_iterator begin() const { return _entries.begin(); }
+        const_iterator end() const { return _entries.end(); }
+
+        [[nodiscard]] size_type size() const { return _entries.size(); }
+        [[nodiscard]] bool empty() const { return _entries.empty(); }
+        void clear() { _entries.clear(); }
+        void reserve(size_type count) { _entries.reserve(count); }
+
+        iterator find(const Key &key)
+        {
+            auto it = lower_bound(key);
+            return it != end() && !_compare(key, it->first) ? it : end();
+        }
+
+        const_iterator find(const Key &key) const
+        {
+            return const_cast<FlatMap *>(this)->find(key);
+        }
+
+        [[nodiscard]] bool contains(const Key &key) const
+        {
+            return find(key) != end();
+        }
+
+        Value &at(const Key &key)
+        {
+            auto it = find(key);
+            if (it == end())
+            {
+                throw std::out_of_range("FlatMap::at");
+            }
+            return it->second;
+        }
+
+        const Value &at(const Key &key) const
+        {
+            return const_cast<FlatMap *>(this)->at(key);
+        }
+
+        Value &operator[](const Key &key)
+        {
+            return emplace(key, Value()).first->second;
+        }
+
+        /**
+         * @brief Inserts the entry unless the key is already present.
+         * @return Iterator to the entry with the key and whether insertion took place.
+         */
+        template<typename K, typename V>
+        std::pair<iterator, bool> emplace(K &&key, V &&value)
+        {
+            auto it = lower_bound(key);
+            if (it != end() && !_compare(key, it->first))
+            {
+                return {it, false};
+            }
+            return {_entries.emplace(it, std::forward<K>(key), std::forward<V>(value)), true};
+        }
+
+        size_type erase(const Key &key)
+        {
+            auto it = find(key);
+            if (it == end())
+            {
+                return 0;
+            }
+            _entries.erase(it);
+            return 1;
+        }
+
+        bool operator==(const FlatMap &other) const
+        {
+            return _entries == other._entries;
+        }
+
+    private:
+        iterator lower_bound(const Key &key)
+        {
+            return std::lower_bound(_entries.begin(), _entries.end(), key, [this](const value_type &entry, const Key &k)
+            {
+                return _compare(entry.first, k);
+            });
+        }
+
+        container_type _entries;
+        [[no_unique_address]] Compare _compare;
+    };
+}
+
+#endif //LUAVAR_FLAT_MAP_H
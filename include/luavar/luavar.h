@@ -9,6 +9,7 @@
 
 #include "lua.hpp"
 #include <string>
+#include <vector>
 #include <luavar/binding_utils.h>
 #include <luavar/type_traits.h>
 
@@ -29,10 +30,16 @@ namespace LuaVar
                 return 1;
             }
 
+            // number of values read by GetResults from the top of the stack
+            constexpr static int ResultsCount()
+            {
+                return 1;
+            }
+
             inline static RetType GetResults(lua_State *L)
             {
                 PackedType res;
-                Internal::populate_arguments(L, res);
+                Internal::populate_results(L, res);
                 return std::get<0>(res);
             }
         };
@@ -54,10 +61,15 @@ namespace LuaVar
                 }
             }
 
+            constexpr static int ResultsCount()
+            {
+                return sizeof...(Args);
+            }
+
             inline static RetType GetResults(lua_State *L)
             {
                 PackedType res;
-                Internal::populate_arguments(L, res);
+                Internal::populate_results(L, res);
                 return res;
             }
         };
@@ -74,6 +86,11 @@ namespace LuaVar
                 return 0;
             }
 
+            constexpr static int ResultsCount()
+            {
+                return 0;
+            }
+
             inline static RetType GetResults(lua_State */*L*/)
             {
             }
@@ -84,47 +101,105 @@ namespace LuaVar
         {
         };
 
+        /**
+         * @brief Checks that the value on top of the stack is a function taking `nargs` parameters, the value stays on the stack.
+         * @param nargs number of declared parameters, -1 to skip the arity check
+         */
+        LuaVar_API bool CheckFunction(lua_State *L, const char *funcName, int nargs, std::string &error);
+
+        /**
+         * @brief Checks that global `funcName` is a function and caches it for later calls, see LuaVar::ValidateFunctions.
+         * @param nargs number of declared parameters, -1 to skip the arity check
+         */
+        LuaVar_API bool ValidateFunction(lua_State *L, const char *funcName, int nargs, std::string &error);
+
+        /**
+         * @brief Drops the function cached by ValidateFunction.
+         */
+        LuaVar_API void InvalidateFunction(lua_State *L, const char *funcName);
+
+        // pushes the function to call, returns false (with nothing pushed) if it is not a function and soft errors are on
+        template<int flags>
+        bool push_function(const char *funcName, lua_State *L)
+        {
+            if constexpr (static_cast<bool>(flags & LuaCallValidated))
+            {
+                // validated functions are cached in the registry under the address of their name,
+                // this skips hashing the name and checking the type of the global
+                if (lua_rawgetp(L, LUA_REGISTRYINDEX, funcName) == LUA_TFUNCTION)
+                {
+                    return true;
+                }
+                lua_pop(L, 1);
+            }
+
+            auto type = lua_getglobal(L, funcName);
+            if constexpr (static_cast<bool>(flags & LuaCallSoftError))
+            {
+                if (type != LUA_TFUNCTION)
+                {
+                    printf("global %s is not a function\n", funcName);
+                    fflush(stdout);
+                    lua_pop(L, 1);
+                    return false;
+                }
+            } else
+            {
+                assert(type != LUA_TNIL); //"called function that doesn't exist!"
+                luaL_checktype(L, -1, LUA_TFUNCTION);
+            }
+            return true;
+        }
+
         template<typename RetType, int flags, typename... ArgTypes>
         struct Caller<RetType (*)(ArgTypes...), flags>
         {
-            static RetType Call(const std::string &funcName, lua_State *L, ArgTypes... args)
+            static RetType Call(const char *funcName, lua_State *L, ArgTypes... args)
             {
-                auto result = lua_getglobal(L, funcName.c_str());
-                if constexpr (static_cast<bool>(flags & LuaCallSoftError))
+                const int base = lua_gettop(L);
+                if (!push_function<flags>(funcName, L))
                 {
-                    if (!lua_isfunction(L, -1))
+                    if constexpr (!std::is_same_v<RetType, void>)
                     {
-                        printf("global %s is not a function\n", funcName.c_str());
-                        fflush(stdout);
                         return {};
+                    } else
+                    {
+                        return;
                     }
-                } else
-                {
-                    assert(result); //"called function that doesn't exist!"
-                    luaL_checktype(L, -1, LUA_TFUNCTION);
                 }
 
                 using Parser = Internal::LuaReturnParser<LuaFlags<flags>, RetType>;
                 std::tuple<ArgTypes...> items(args...);
                 Internal::push_arguments(L, items);
                 lua_call(L, std::tuple_size_v<decltype(items)>, Parser::ReturnedValuesCount());
-                return Parser::GetResults(L);
+                // adjust to exactly the expected number of results (missing ones become nil), then pop them once read
+                lua_settop(L, base + Parser::ResultsCount());
+                if constexpr (std::is_same_v<RetType, void>)
+                {
+                    lua_settop(L, base);
+                } else
+                {
+                    RetType res = Parser::GetResults(L);
+                    lua_settop(L, base);
+                    return res;
+                }
             }
         };
 
-        template<typename... Args>
-        std::tuple<std::string, lua_State *, Args...> prep_args(Args... args)
+        template<typename Ret, int flags, typename... ArgTypes, typename... Results>
+        bool CallInto(const char *funcName, lua_State *L, std::tuple<Results &...> &results, ArgTypes... args)
         {
-            return {"", nullptr, args...};
-        }
+            const int base = lua_gettop(L);
+            if (!push_function<flags>(funcName, L))
+            {
+                return false;
+            }
 
-        template<typename Ret, int flags, typename... Types>
-        auto decl_impl(const char *name, lua_State *L, std::tuple<Types...> args)
-        {
-            auto t2 = std::apply<std::tuple<std::string, lua_State *, Types...> (*)(Types...)>(prep_args, args);
-            std::get<0>(t2) = name;
-            std::get<1>(t2) = L;
-            return std::apply(LuaVar::Internal::Caller<Ret (*)(Types...), flags>::Call, t2);
+            (Internal::push_result(L, args), ...);
+            lua_call(L, sizeof...(ArgTypes), sizeof...(Results));
+            const bool res = Internal::read_results_into(L, results, std::index_sequence_for<Results...>{});
+            lua_settop(L, base);
+            return res;
         }
     }
 
@@ -173,6 +248,17 @@ namespace LuaVar
         return Internal::DynamicBind<Functor, flags>(name, e);
     }
 
+    // capture lambda passed as rvalue, it is moved all the way into lua without being copied
+    template<Internal::IsLuaVarFunctor Functor, LuaVarFlags flags>
+    auto CppFunction(char const *name, Functor &&e, flags /**/) ->
+        std::enable_if_t<
+            Internal::IsCaptureLambda<Functor> && !Internal::IsLuaWrappedCallableDyn<Functor>,
+            Internal::DynamicBind<Functor, flags>
+        >
+    {
+        return Internal::DynamicBind<Functor, flags>(name, std::move(e));
+    }
+
     template<Internal::IsLuaVarFunctor Functor, LuaVarFlags flags>
     auto CppFunction(char const *name, Functor e, flags /**/) ->
         std::enable_if_t<Internal::IsLuaWrappedCallableDyn<Functor>,
@@ -182,7 +268,7 @@ namespace LuaVar
         static_assert(!Internal::IsFunctionPointer<Functor>,
                       "Use function as template parameter or wrap it in LuaVar::Callable<>{}");
 
-        return Internal::DynamicBind<Functor, flags>(name, e);
+        return Internal::DynamicBind<Functor, flags>(name, std::move(e));
     }
 
     template<typename T, typename K>
@@ -238,15 +324,16 @@ namespace LuaVar
     template<Internal::IsDynamicFunctor Functor>
     auto CppFunction(char const *name, Functor&& e) ->
         std::enable_if_t<Internal::IsDynamicFunctor<std::remove_reference_t<Functor>>,
-            decltype(CppFunction<Functor, DefaultLuaVarFlags>(name, e, DefaultLuaVarFlags{}))
+            decltype(CppFunction(name, std::move(e), DefaultLuaVarFlags{}))
         >
     {
-        return CppFunction<Functor, DefaultLuaVarFlags>(name, e, DefaultLuaVarFlags{});
+        return CppFunction(name, std::move(e), DefaultLuaVarFlags{});
     }
 
     /***
     * Define LUA function that can be called from C++.
-    * The function existence and correctness is NOT verified until it is triggered.
+    * The function existence and correctness is NOT verified until it is triggered,
+    * unless it is validated up front with LuaVar::ValidateFunctions.
     *
     * @code
     * auto FunctionName = LuaVar::LuaFunction<bool(*)(int, int)>("lua_function_name");
@@ -264,7 +351,8 @@ namespace LuaVar
      * instantiated with a Lua function name alone or with a Lua function name and a corresponding
      * C++ callable Functor (used as a signature prototype).
      *
-     * The LUA function existence and correctness is NOT verified until it is triggered.
+     * The LUA function existence and correctness is NOT verified until it is triggered,
+     * unless it is validated up front with LuaVar::ValidateFunctions.
      *
      * @code
      * auto FunctionName = LuaVar::LuaFunction<bool(*)(int, int)>("lua_function_name");
@@ -348,9 +436,71 @@ namespace LuaVar
          * @param args The arguments to be passed to the Lua function.
          * @return The result of the Lua function call, with the type determined by the template type `Ret`.
          */
-        Ret Call(lua_State *L, Args... args)
+        Ret Call(lua_State *L, Args... args) const
+        {
+            return Internal::Caller<FunctorF, FlagsT::LuaFlagsValue>::Call(name, L, args...);
+        }
+
+        /**
+         * Calls a Lua function and reads its results directly into caller provided variables, without building
+         * a result tuple. The declared return type is ignored, the number of results is given by `results`.
+         *
+         * @code
+         * int count; std::string name;
+         * bool ok = GetInfo.CallInto(L, std::tie(count, name), 5);
+         * @endcode
+         *
+         * @param L The Lua state within which the function call will be executed.
+         * @param results References to variables receiving the results, usually created with std::tie.
+         * @param args The arguments to be passed to the Lua function.
+         * @return false if any of the results couldn't be converted, variables of preceding results are already set.
+         */
+        template<typename... Results>
+        bool CallInto(lua_State *L, std::tuple<Results &...> results, Args... args) const
+        {
+            return Internal::CallInto<Ret, FlagsT::LuaFlagsValue>(name, L, results, args...);
+        }
+
+        /**
+         * Checks that the Lua function exists and caches it, calls made afterwards with LuaCallValidated set
+         * skip looking up and checking the global. See LuaVar::ValidateFunctions.
+         *
+         * @param L The Lua state with the scripts loaded.
+         * @param error Receives description of the problem if the function is not valid.
+         * @return true if the function can be called.
+         */
+        bool Validate(lua_State *L, std::string &error) const
+        {
+            return Internal::ValidateFunction(L, name, CheckedArity(), error);
+        }
+
+        [[nodiscard]] constexpr const char *Name() const
+        {
+            return name;
+        }
+
+        /**
+         * Whether calls use the function cached by Validate, i.e. LuaCallValidated is set.
+         */
+        static constexpr bool UsesValidatedCache()
+        {
+            return FlagsT::IsSet(LuaCallValidated);
+        }
+
+        /**
+         * Number of parameters the Lua function must declare, -1 unless LuaCallCheckArity is set.
+         */
+        static constexpr int CheckedArity()
+        {
+            return FlagsT::IsSet(LuaCallCheckArity) ? static_cast<int>(sizeof...(Args)) : -1;
+        }
+
+        /**
+         * Drops the function cached by Validate, following calls look up the global again.
+         */
+        void Invalidate(lua_State *L) const
         {
-            return Internal::decl_impl<Ret, FlagsT::LuaFlagsValue>(name, L, std::make_tuple(args...));
+            Internal::InvalidateFunction(L, name);
         }
 
         /**
@@ -360,12 +510,40 @@ namespace LuaVar
          * @param args The variadic arguments to be passed to the Call function.
          * @return The result of the Call function of type Ret.
          */
-        Ret operator()(lua_State *L, Args... args)
+        Ret operator()(lua_State *L, Args... args) const
         {
             return Call(L, args...);
         }
     };
 
+    /**
+     * @brief Validates declared Lua functions once the scripts are loaded, usually right after creating the state.
+     *
+     * Every function is checked to exist and to be callable, functions declared with LuaCallCheckArity also need
+     * to declare the same number of parameters. Valid functions are cached in the state, keyed by the address
+     * of their name. Functions declared with LuaCallValidated call the cached function and skip looking up and
+     * checking the global, others keep calling the global. Names must therefore have static storage duration
+     * (string literals). Validate again after scripts redefine the functions.
+     *
+     * @code
+     * constexpr auto OnUpdate = LuaVar::LuaFunction<void(*)(double)>("on_update")
+     *         .Flags(LuaVar::LuaFlags<LuaVar::LuaCallValidated>{});
+     * constexpr auto OnEvent = LuaVar::LuaFunction<bool(*)(int)>("on_event").Flags(LuaVar::LuaFlags<LuaVar::LuaCallCheckArity>{});
+     * for (auto &error : LuaVar::ValidateFunctions(L, OnUpdate, OnEvent))
+     *     log(error);
+     * @endcode
+     *
+     * @return Descriptions of the problems found, empty if all functions are valid.
+     */
+    template<typename... Functions>
+    std::vector<std::string> ValidateFunctions(lua_State *L, const Functions &... functions)
+    {
+        std::vector<std::string> errors;
+        std::string error;
+        ((functions.Validate(L, error) ? void() : errors.push_back(error)), ...);
+        return errors;
+    }
+
     template<Internal::IsFunctionPointer Functor>
     LuaFunction(char const *name, Functor e) -> LuaFunction<Functor>;
     template<Internal::IsFunctionPointer Functor, LuaFlagsT flags>
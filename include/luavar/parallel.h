@@ -0,0 +1,323 @@
+// Copyright (c) Mateusz Raczynski 2025.
+// The software is provided AS IS, with no guarantees for it to work correctly.
+// The author doesn't take any responsibility for any damages done.
+
+#ifndef LUAVAR_PARALLEL_H
+#define LUAVAR_PARALLEL_H
+
+#include <lua.hpp>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ranges>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <luavar/config.h>
+#include <luavar/luavar.h>
+#include <luavar/state.h>
+
+namespace LuaVar
+{
+    /**
+     * @brief Configuration of ParallelMap.
+     *
+     * @var threads number of worker threads (each with its own state), 0 uses all hardware threads
+     * @var chunkSize number of elements a worker takes at once, 0 tunes it automatically
+     * @var state options of the worker states
+     * @var setup called for every worker state before the script is loaded, e.g. to bind C++ functions
+     */
+    struct ParallelOptions
+    {
+        unsigned threads = 0;
+        size_t chunkSize = 0;
+        LuaStateOptions state{};
+        std::function<void(lua_State *L)> setup{};
+    };
+
+    namespace Internal
+    {
+        /**
+         * @class ParallelPool
+         * @brief Worker threads, each owning a state with the script loaded, used by ParallelMap.
+         *
+         * Elements are handed out in chunks through a single atomic counter. With automatic chunk size the chunks
+         * shrink as the work runs out (a share of the remaining elements per worker), but never below a minimum
+         * derived from the time per element measured during previous runs, so that taking a chunk stays negligible.
+         */
+        class LuaVar_API ParallelPool
+        {
+        public:
+            // processes elements [begin, end) in the state of a worker, returns false and sets error on failure
+            using Task = std::function<bool(lua_State *L, size_t begin, size_t end, std::string &error)>;
+            // called for every worker state once the script is loaded
+            using Prepare = std::function<bool(lua_State *L, std::string &error)>;
+
+            ParallelPool(const char *script, const ParallelOptions &options, const Prepare &prepare);
+            ~ParallelPool();
+
+            ParallelPool(const ParallelPool &) = delete;
+            ParallelPool &operator=(const ParallelPool &) = delete;
+
+            [[nodiscard]] bool IsValid() const
+            {
+                return _valid;
+            }
+
+            [[nodiscard]] size_t Size() const
+            {
+                return _workers.size();
+            }
+
+            /**
+             * @brief Description of the first problem found while preparing the worker states.
+             */
+            [[nodiscard]] const std::string &Error() const
+            {
+                return _error;
+            }
+
+            /**
+             * @brief Smallest chunk handed out with automatic chunk size, updated after every run.
+             */
+            [[nodiscard]] size_t MinChunkSize() const
+            {
+                return _minChunk;
+            }
+
+            /**
+             * @brief Runs the task over `count` elements and waits for all workers.
+             * @return false if any chunk failed, remaining chunks are skipped and error describes the first failure.
+             */
+            bool Run(size_t count, const Task &task, std::string &error);
+
+        private:
+            struct Job;
+
+            void Work(size_t index);
+            bool Grab(Job &job, size_t &begin, size_t &end) const;
+
+            std::vector<std::unique_ptr<LuaState> > _states;
+            std::vector<std::thread> _workers;
+            std::mutex _mutex;
+            std::condition_variable _wake;
+            std::condition_variable _done;
+            Job *_job = nullptr;
+            size_t _generation = 0;
+            size_t _active = 0;
+            bool _stopping = false;
+            bool _valid = true;
+            std::string _error;
+            size_t _chunkSize;
+            size_t _minChunk = 1;
+        };
+
+        // integers are read with luaL_checkinteger, which raises an error for numbers without integer representation
+        template<typename T>
+        bool has_integer_representation(lua_State *L, int index)
+        {
+            if constexpr (std::is_integral_v<T> && !std::is_same_v<T, bool>)
+            {
+                int isInteger = 0;
+                lua_tointegerx(L, index, &isInteger);
+                return isInteger != 0;
+            }
+            return true;
+        }
+
+        // one lua function call of ParallelMap, the result is read while still in protected mode
+        template<typename Ret, int flags>
+        struct ProtectedCall
+        {
+            using Parser = LuaReturnParser<LuaFlags<flags>, Ret>;
+
+            Ret *result;
+            const char *name;
+
+            // called through lua_pcall with the stack: ProtectedCall, function, argument
+            static int Run(lua_State *L)
+            {
+                auto *call = static_cast<ProtectedCall *>(lua_touserdata(L, 1));
+                lua_call(L, 1, Parser::ReturnedValuesCount());
+                lua_settop(L, 1 + Parser::ResultsCount());
+                if (!Read(L, *call->result))
+                {
+                    return luaL_error(L, "bad result of %s", call->name);
+                }
+                return 0;
+            }
+
+        private:
+            static bool Read(lua_State *L, Ret &result)
+            {
+                if constexpr (std::is_same_v<typename Parser::PackedType, Ret>)
+                {
+                    return ReadTuple(L, result, std::make_index_sequence<std::tuple_size_v<Ret> >{});
+                } else
+                {
+                    return has_integer_representation<Ret>(L, -1) &&
+                           Argument<Ret>::template get_argument<-1>(L, result);
+                }
+            }
+
+            template<typename Tuple, std::size_t... I>
+            static bool ReadTuple(lua_State *L, Tuple &results, std::index_sequence<I...>)
+            {
+                constexpr int N = static_cast<int>(sizeof...(I));
+                return ((has_integer_representation<std::tuple_element_t<I, Tuple> >(L, static_cast<int>(I) - N) &&
+                         Argument<std::tuple_element_t<I, Tuple> >::template get_argument<static_cast<int>(I) - N>(
+                             L, std::get<I>(results))) && ...);
+            }
+        };
+
+        // calls validated lua function in protected mode, lua errors and results of unexpected types
+        // are reported instead of propagated
+        template<typename Ret, int flags, typename Arg>
+        bool protected_call(lua_State *L, const char *name, Arg &arg, Ret &result, std::string &error)
+        {
+            const int base = lua_gettop(L);
+            ProtectedCall<Ret, flags> call{&result, name};
+            lua_pushcfunction(L, (ProtectedCall<Ret, flags>::Run));
+            lua_pushlightuserdata(L, &call);
+            if (!push_function<flags | LuaCallSoftError | LuaCallValidated>(name, L))
+            {
+                lua_settop(L, base);
+                error = std::string("global ") + name + " is not a function";
+                return false;
+            }
+            push_result(L, arg);
+            if (lua_pcall(L, 3, 0, 0) != LUA_OK)
+            {
+                const char *message = lua_tostring(L, -1);
+                error = message != nullptr ? message : "error object is not a string";
+                lua_settop(L, base);
+                return false;
+            }
+            return true;
+        }
+    }
+
+    template<typename Function>
+    class ParallelMap;
+
+    /**
+     * @class ParallelMap
+     * @brief Evaluates a lua function over a range of elements on a pool of threads with independent states.
+     *
+     * Every worker owns a state created with ParallelOptions::state, prepared by ParallelOptions::setup and with
+     * the script loaded, and the function validated (see LuaVar::ValidateFunctions). The states are kept between
+     * calls, so globals set by the scripts persist per worker. The range is split into chunks handed out to the
+     * workers, the function is called once per element, results are stored in the order of the input.
+     * Calls are protected, the first lua error or result of unexpected type stops the remaining chunks and is
+     * available through Error().
+     *
+     * @code
+     * constexpr auto Score = LuaVar::LuaFunction<double (*)(int)>("score");
+     * LuaVar::ParallelMap scoring(scoring_script, Score);
+     * std::vector<double> scores;
+     * if (!scoring.Map(records, scores))
+     *     log(scoring.Error());
+     * @endcode
+     */
+    template<typename Ret, typename Arg, LuaFlagsT FlagsT>
+    class ParallelMap<LuaFunction<Ret (*)(Arg), FlagsT> >
+    {
+        static_assert(!std::is_same_v<Ret, void>, "ParallelMap requires a function returning a value");
+
+        using Function = LuaFunction<Ret (*)(Arg), FlagsT>;
+        // std::vector<bool> packs the elements, concurrent writes to neighbouring results would race
+        using Slot = std::conditional_t<std::is_same_v<Ret, bool>, char, Ret>;
+
+        Function _function;
+        std::string _error;
+        Internal::ParallelPool _pool;
+
+    public:
+        ParallelMap(const char *script, Function function, const ParallelOptions &options = {}) :
+            _function(function),
+            _pool(script, options, [function](lua_State *L, std::string &error)
+            {
+                return function.Validate(L, error);
+            })
+        {
+        }
+
+        /**
+         * @brief Whether all worker states were created and the script loaded, see Error() otherwise.
+         */
+        [[nodiscard]] bool IsValid() const
+        {
+            return _pool.IsValid();
+        }
+
+        /**
+         * @brief Description of the first failure of the construction or of the last Map call.
+         */
+        [[nodiscard]] const std::string &Error() const
+        {
+            return _error.empty() && !IsValid() ? _pool.Error() : _error;
+        }
+
+        [[nodiscard]] size_t Threads() const
+        {
+            return _pool.Size();
+        }
+
+        /**
+         * @brief Calls the function for every element of the input.
+         * @param results receives the results in the order of the input
+         * @return false if the pool is not valid or any call failed.
+         */
+        template<std::ranges::random_access_range Range>
+        bool Map(const Range &input, std::vector<Ret> &results)
+        {
+            _error.clear();
+            if (!IsValid())
+            {
+                return false;
+            }
+            const size_t count = std::ranges::size(input);
+            std::vector<Slot> slots(count);
+            auto first = std::ranges::begin(input);
+            const char *name = _function.Name();
+            const bool success = _pool.Run(count, [first, name, &slots](lua_State *L, size_t begin, size_t end,
+                                                                        std::string &error)
+            {
+                for (size_t i = begin; i < end; ++i)
+                {
+                    std::remove_cvref_t<Arg> arg = first[i];
+                    Ret result{};
+                    if (!Internal::protected_call<Ret, FlagsT::LuaFlagsValue>(L, name, arg, result, error))
+                    {
+                        return false;
+                    }
+                    slots[i] = std::move(result);
+                }
+                return true;
+            }, _error);
+            if (!success)
+            {
+                return false;
+            }
+            if constexpr (std::is_same_v<Slot, Ret>)
+            {
+                results = std::move(slots);
+            } else
+            {
+                results.assign(slots.begin(), slots.end());
+            }
+            return true;
+        }
+    };
+
+    template<typename Functor, LuaFlagsT FlagsT>
+    ParallelMap(const char *script, LuaFunction<Functor, FlagsT> function,
+                const ParallelOptions &options = {}) -> ParallelMap<LuaFunction<Functor, FlagsT> >;
+}
+
+#endif //LUAVAR_PARALLEL_H
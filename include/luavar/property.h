@@ -0,0 +1,157 @@
+// Copyright (c) Mateusz Raczynski 2025.
+// The software is provided AS IS, with no guarantees for it to work correctly.
+// The author doesn't take any responsibility for any damages done.
+
+#ifndef LUAVAR_PROPERTY_H
+#define LUAVAR_PROPERTY_H
+
+#include <lua.hpp>
+#include <initializer_list>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <luavar/config.h>
+#include <luavar/luavar.h>
+
+namespace LuaVar
+{
+    namespace Internal
+    {
+        // type erased access to a C++ variable, stored in a userdata referenced by the metamethods of the proxy
+        struct PropertyAccessor
+        {
+            void *variable;
+            void (*get)(lua_State *L, void *variable);
+            // converts value on top of the stack and assigns it, nullptr for read-only properties
+            bool (*set)(lua_State *L, void *variable);
+        };
+    }
+
+    /**
+     * @class Property
+     * @brief C++ variable exposed as a field of a PropertyTable.
+     *
+     * The variable is accessed through a pointer, so it has to outlive every state the table is bound to.
+     * Values are converted the same way as arguments and results of bound functions.
+     * Pointers to const variables make read-only properties.
+     */
+    class Property
+    {
+        friend class PropertyTable;
+
+        std::string _name;
+        Internal::PropertyAccessor _accessor;
+
+    public:
+        template<typename T>
+        Property(std::string name, T *variable) : _name(std::move(name)),
+                                                   _accessor{const_cast<std::remove_const_t<T> *>(variable), &Get<T>,
+                                                             Setter<T>()}
+        {
+        }
+
+        /**
+         * @brief Forbids assignments from scripts, the variable can still be modified from C++.
+         */
+        Property &ReadOnly()
+        {
+            _accessor.set = nullptr;
+            return *this;
+        }
+
+    private:
+        template<typename T>
+        static void Get(lua_State *L, void *variable)
+        {
+            // push_result never modifies its argument
+            Internal::push_result(L, *static_cast<std::remove_const_t<T> *>(variable));
+        }
+
+        template<typename T>
+        static constexpr bool (*Setter())(lua_State *, void *)
+        {
+            if constexpr (std::is_const_v<T>)
+            {
+                return nullptr;
+            } else
+            {
+                return &Set<T>;
+            }
+        }
+
+        template<typename T>
+        static bool Set(lua_State *L, void *variable)
+        {
+            auto value = Internal::read_top<T>(L);
+            if (!value)
+            {
+                return false;
+            }
+            *static_cast<T *>(variable) = std::move(*value);
+            return true;
+        }
+    };
+
+    /**
+     * @class PropertyTable
+     * @brief Module table whose fields read and write C++ variables.
+     *
+     * The table is an empty proxy, `__index` and `__newindex` are implemented in C++ and find the variable
+     * through a pointer kept in their upvalue. Names are interned when the proxy is pushed, so a field access
+     * compares string addresses and calls the accessor without any table lookup or lua call.
+     * Fields that are not properties are stored in the proxy itself, so scripts can still extend the module.
+     *
+     * Scripts reading many fields per tick can use a snapshot instead: a plain table filled with current values,
+     * refreshed from C++ (e.g. once per frame) with UpdateSnapshot. Reads from a snapshot are ordinary table reads,
+     * writes don't reach C++.
+     *
+     * @code
+     * LuaVar::PropertyTable tunables("tunables", {
+     *     LuaVar::Property("gravity", &gravity),
+     *     LuaVar::Property("frame", &frame).ReadOnly()
+     * });
+     * tunables.Bind(L);
+     * @endcode
+     */
+    class LuaVar_API PropertyTable
+    {
+        std::string _name;
+        std::vector<Property> _properties;
+
+    public:
+        PropertyTable(std::string name, std::initializer_list<Property> properties);
+
+        /**
+         * @brief Adds another property, tables that are already bound are not affected.
+         */
+        PropertyTable &Add(Property property);
+
+        [[nodiscard]] const std::string &Name() const
+        {
+            return _name;
+        }
+
+        /**
+         * @brief Makes the proxy available as a global variable named after the table.
+         */
+        void Bind(lua_State *L) const;
+
+        /**
+         * @brief Pushes a new proxy onto the stack.
+         */
+        void Push(lua_State *L) const;
+
+        /**
+         * @brief Pushes a new plain table holding current values of all properties.
+         */
+        void PushSnapshot(lua_State *L) const;
+
+        /**
+         * @brief Writes current values of all properties into the table at given index (e.g. a pushed snapshot).
+         */
+        void UpdateSnapshot(lua_State *L, int index) const;
+    };
+}
+
+#endif //LUAVAR_PROPERTY_H
@@ -0,0 +1,515 @@
+// Copyright (c) Mateusz Raczynski 2025.
+// The software is provided AS IS, with no guarantees for it to work correctly.
+// The author doesn't take any responsibility for any damages done.
+
+#ifndef LUAVAR_REF_H
+#define LUAVAR_REF_H
+
+#include <lua.hpp>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <luavar/config.h>
+#include <luavar/luavar.h>
+
+namespace LuaVar
+{
+    namespace Internal
+    {
+        // whether the first of the arguments is the state to run on rather than a value to pass
+        template<typename... Args>
+        concept StartsWithState = sizeof...(Args) > 0 &&
+                                  std::is_convertible_v<std::tuple_element_t<0, std::tuple<Args...> >, lua_State *>;
+    }
+
+    /**
+     * @class Ref
+     * @brief Owning handle to any lua value, kept alive through a registry reference.
+     *
+     * The handle is move-only, the reference is released with `luaL_unref` on destruction.
+     * It keeps the main thread of the state, so it stays valid after the coroutine it was created from dies.
+     * Operations without a state argument run on the main thread. Code running inside lua (e.g. bound functions,
+     * possibly called from a coroutine) passes its own state instead, so lua errors unwind the calling thread.
+     *
+     * @code
+     * lua_getglobal(L, "config");
+     * auto config = LuaVar::Ref::Pop(L);
+     * @endcode
+     */
+    class LuaVar_API Ref
+    {
+    protected:
+        lua_State *L = nullptr;
+        int _ref = LUA_NOREF;
+
+    public:
+        Ref() = default;
+
+        /**
+         * @brief References value at given stack index, the stack is left unchanged.
+         */
+        Ref(lua_State *L, int index);
+        ~Ref();
+
+        Ref(const Ref &) = delete;
+        Ref &operator=(const Ref &) = delete;
+        Ref(Ref &&other) noexcept;
+        Ref &operator=(Ref &&other) noexcept;
+
+        /**
+         * @brief References value on top of the stack and pops it.
+         */
+        static Ref Pop(lua_State *L);
+
+        /**
+         * @brief References value of a global variable.
+         */
+        static Ref Global(lua_State *L, const char *name);
+
+        /**
+         * @brief Whether the handle refers to a value (references to nil are not valid).
+         */
+        [[nodiscard]] bool IsValid() const
+        {
+            return L != nullptr && _ref != LUA_NOREF && _ref != LUA_REFNIL;
+        }
+
+        explicit operator bool() const
+        {
+            return IsValid();
+        }
+
+        /**
+         * @brief Lua type of the referenced value (LUA_TNIL for invalid handles).
+         */
+        [[nodiscard]] int Type() const;
+        [[nodiscard]] int Type(lua_State *thread) const;
+
+        /**
+         * @brief Pushes the referenced value (nil for invalid handles).
+         */
+        void Push() const;
+
+        /**
+         * @brief Pushes the referenced value onto the stack of a different thread of the same state (e.g. a coroutine).
+         */
+        void Push(lua_State *thread) const;
+
+        [[nodiscard]] lua_State *State() const
+        {
+            return L;
+        }
+
+        /**
+         * @brief Converts the referenced value to a C++ type supported by bound functions.
+         * @return std::nullopt if the value has a different type.
+         */
+        template<typename T>
+        std::optional<T> As() const
+        {
+            return As<T>(L);
+        }
+
+        template<typename T>
+        std::optional<T> As(lua_State *thread) const
+        {
+            Push(thread);
+            std::optional<T> res = Internal::read_top<T>(thread);
+            lua_pop(thread, 1);
+            return res;
+        }
+
+        /**
+         * @brief Releases the reference, the handle becomes invalid.
+         */
+        void Reset();
+    };
+
+    /**
+     * @class Table
+     * @brief Handle to a lua table with typed raw accessors.
+     *
+     * Accessors use raw access (`lua_rawgeti`/`lua_rawget`/`lua_rawset`), metamethods are not triggered.
+     *
+     * @code
+     * auto config = LuaVar::Table::Global(L, "config");
+     * int width = config.Get<int>("width").value_or(800);
+     * config.Set("height", 600);
+     * @endcode
+     */
+    class LuaVar_API Table : public Ref
+    {
+    public:
+        Table() = default;
+
+        /**
+         * @brief References table at given stack index, the handle is invalid if the value is not a table.
+         */
+        Table(lua_State *L, int index);
+
+        static Table Pop(lua_State *L);
+        static Table Global(lua_State *L, const char *name);
+
+        /**
+         * @brief Creates a new table with preallocated array and hash parts.
+         */
+        static Table Create(lua_State *L, int arraySize = 0, int hashSize = 0);
+
+        /**
+         * @brief Reads value stored under the key.
+         * @return std::nullopt if the key is missing, the value has a different type or the handle is invalid.
+         */
+        template<typename T, typename K>
+        std::optional<T> Get(const K &key) const
+        {
+            return Get<T>(L, key);
+        }
+
+        template<typename T, typename K>
+        std::optional<T> Get(lua_State *thread, const K &key) const
+        {
+            if (!IsValid())
+            {
+                return std::nullopt;
+            }
+            Push(thread);
+            PushValue(thread, key);
+            std::optional<T> res = Internal::read_top<T>(thread);
+            lua_pop(thread, 2);
+            return res;
+        }
+
+        /**
+         * @brief Stores the value under the key, values are converted the same way as results of bound functions.
+         * Does nothing if the handle is invalid.
+         */
+        template<typename K, typename V>
+        void Set(const K &key, V value)
+        {
+            Set(L, key, std::move(value));
+        }
+
+        template<typename K, typename V>
+        void Set(lua_State *thread, const K &key, V value)
+        {
+            if (!IsValid())
+            {
+                return;
+            }
+            Push(thread);
+            if constexpr (std::is_integral_v<K> && !std::is_same_v<K, bool>)
+            {
+                Internal::push_result(thread, value);
+                lua_rawseti(thread, -2, static_cast<lua_Integer>(key));
+            } else
+            {
+                PushKey(thread, key);
+                Internal::push_result(thread, value);
+                lua_rawset(thread, -3);
+            }
+            lua_pop(thread, 1);
+        }
+
+        /**
+         * @brief Length of the array part (the `#` operator without `__len`).
+         */
+        [[nodiscard]] size_t Length() const;
+        [[nodiscard]] size_t Length(lua_State *thread) const;
+
+        /**
+         * @brief Calls `callback(key, value)` for every entry whose key and value convert to K and V,
+         * other entries are skipped.
+         */
+        template<typename K, typename V, typename Callback>
+        void ForEach(Callback &&callback) const
+        {
+            ForEach<K, V>(L, std::forward<Callback>(callback));
+        }
+
+        template<typename K, typename V, typename Callback>
+        void ForEach(lua_State *thread, Callback &&callback) const
+        {
+            if (!IsValid())
+            {
+                return;
+            }
+            Push(thread);
+            const int table = lua_gettop(thread);
+            lua_pushnil(thread);
+            while (lua_next(thread, table) != 0)
+            {
+                std::optional<V> value = Internal::read_top<V>(thread);
+                lua_pop(thread, 1);
+                // the key is converted on a copy, so lua_next still sees the original
+                lua_pushvalue(thread, -1);
+                std::optional<K> key = Internal::read_top<K>(thread);
+                lua_pop(thread, 1);
+                if (key && value)
+                {
+                    callback(*key, *value);
+                }
+            }
+            lua_pop(thread, 1);
+        }
+
+    private:
+        // pushes value stored under the key of table on top of the stack
+        template<typename K>
+        static void PushValue(lua_State *thread, const K &key)
+        {
+            if constexpr (std::is_integral_v<K> && !std::is_same_v<K, bool>)
+            {
+                lua_rawgeti(thread, -1, static_cast<lua_Integer>(key));
+            } else
+            {
+                PushKey(thread, key);
+                lua_rawget(thread, -2);
+            }
+        }
+
+        template<typename K>
+        static void PushKey(lua_State *thread, const K &key)
+        {
+            if constexpr (std::is_convertible_v<const K &, std::string_view>)
+            {
+                const std::string_view view(key);
+                lua_pushlstring(thread, view.data(), view.size());
+            } else
+            {
+                K copy = key;
+                Internal::push_result(thread, copy);
+            }
+        }
+    };
+
+    /**
+     * @class Function
+     * @brief Handle to a lua function, calling it doesn't look up any globals.
+     *
+     * @code
+     * auto update = LuaVar::Function::Global(L, "update");
+     * int state = update.Call<int>(dt);
+     * @endcode
+     */
+    class LuaVar_API Function : public Ref
+    {
+    public:
+        Function() = default;
+
+        /**
+         * @brief References function at given stack index, the handle is invalid if the value is not a function.
+         */
+        Function(lua_State *L, int index);
+
+        static Function Pop(lua_State *L);
+        static Function Global(lua_State *L, const char *name);
+
+        /**
+         * @brief Calls the function on the main thread, lua errors are propagated the same way as with LuaFunction.
+         * @tparam Ret result type, std::tuple for multiple results
+         */
+        template<typename Ret = void, typename... Args> requires (!Internal::StartsWithState<Args...>)
+        Ret Call(Args &&... args) const
+        {
+            return Call<Ret>(L, std::forward<Args>(args)...);
+        }
+
+        /**
+         * @brief Calls the function on given thread, errors unwind that thread (e.g. to a pcall in a coroutine).
+         */
+        template<typename Ret = void, typename... Args>
+        Ret Call(lua_State *thread, Args &&... args) const
+        {
+            using Parser = Internal::LuaReturnParser<LuaFlags<LuaCallDefaultMode>, Ret>;
+            const int base = lua_gettop(thread);
+            Push(thread);
+            // push_result never modifies its argument, it takes non-const reference only for historical reasons
+            (Internal::push_result(thread, const_cast<std::remove_cvref_t<Args> &>(args)), ...);
+            lua_call(thread, sizeof...(Args), Parser::ReturnedValuesCount());
+            lua_settop(thread, base + Parser::ResultsCount());
+            if constexpr (std::is_same_v<Ret, void>)
+            {
+                lua_settop(thread, base);
+            } else
+            {
+                Ret res = Parser::GetResults(thread);
+                lua_settop(thread, base);
+                return res;
+            }
+        }
+
+        /**
+         * @brief Calls the function and reads its results directly into caller provided variables (e.g. std::tie(a, b)).
+         * @return false if any of the results couldn't be converted.
+         */
+        template<typename... Results, typename... Args>
+        bool CallInto(std::tuple<Results &...> results, Args &&... args) const
+        {
+            return CallInto(L, results, std::forward<Args>(args)...);
+        }
+
+        template<typename... Results, typename... Args>
+        bool CallInto(lua_State *thread, std::tuple<Results &...> results, Args &&... args) const
+        {
+            const int base = lua_gettop(thread);
+            Push(thread);
+            (Internal::push_result(thread, const_cast<std::remove_cvref_t<Args> &>(args)), ...);
+            lua_call(thread, sizeof...(Args), sizeof...(Results));
+            const bool res = Internal::read_results_into(thread, results, std::index_sequence_for<Results...>{});
+            lua_settop(thread, base);
+            return res;
+        }
+
+        template<typename Ret = void, typename... Args>
+        Ret operator()(Args &&... args) const
+        {
+            return Call<Ret>(std::forward<Args>(args)...);
+        }
+    };
+
+    template<typename Signature>
+    class Callback;
+
+    /**
+     * @class Callback
+     * @brief Lua function with a fixed C++ signature, meant to be stored by bound functions and called later.
+     *
+     * Copies share a single registry reference, so copying is just a reference count increment.
+     * Calls go straight to the referenced function, the same way as with Function.
+     *
+     * @code
+     * std::vector<LuaVar::Callback<void(int)> > handlers;
+     * auto register_handler = [&handlers](LuaVar::Callback<void(int)> handler) { handlers.push_back(handler); };
+     * ...
+     * for (const auto &handler: handlers)
+     * {
+     *     handler(event);
+     * }
+     * // inside a bound function pass the calling state: handler(args.State(), event)
+     * @endcode
+     */
+    template<typename Ret, typename... Args>
+    class Callback<Ret(Args...)>
+    {
+        std::shared_ptr<const Function> _function;
+
+    public:
+        Callback() = default;
+
+        explicit Callback(Function function)
+        {
+            if (function)
+            {
+                _function = std::make_shared<const Function>(std::move(function));
+            }
+        }
+
+        [[nodiscard]] bool IsValid() const
+        {
+            return _function != nullptr;
+        }
+
+        explicit operator bool() const
+        {
+            return IsValid();
+        }
+
+        /**
+         * @brief Pushes the function (nil for empty callbacks).
+         */
+        void Push(lua_State *L) const
+        {
+            if (_function)
+            {
+                _function->Push(L);
+            } else
+            {
+                lua_pushnil(L);
+            }
+        }
+
+        /**
+         * @brief Calls the function on the main thread, the callback must not be empty.
+         */
+        Ret operator()(Args... args) const
+        {
+            return _function->template Call<Ret>(_function->State(), std::forward<Args>(args)...);
+        }
+
+        /**
+         * @brief Calls the function on given thread, used when called from a bound function (possibly running
+         * in a coroutine) so that lua errors unwind the calling thread.
+         */
+        Ret operator()(lua_State *thread, Args... args) const
+        {
+            return _function->template Call<Ret>(thread, std::forward<Args>(args)...);
+        }
+    };
+
+    namespace Internal
+    {
+        template<typename T>
+            requires std::is_same_v<T, Ref> || std::is_same_v<T, Table> || std::is_same_v<T, Function>
+        struct Argument<T>
+        {
+            template<int Index>
+            static bool get_argument(lua_State *L, T &arg)
+            {
+                T ref(L, Index);
+                if (!ref && !lua_isnoneornil(L, Index))
+                {
+                    return false;
+                }
+                arg = std::move(ref);
+                return true;
+            }
+        };
+
+        // nil becomes an empty callback
+        template<typename Ret, typename... Args>
+        struct Argument<Callback<Ret(Args...)> >
+        {
+            template<int Index>
+            static bool get_argument(lua_State *L, Callback<Ret(Args...)> &arg)
+            {
+                if (lua_isnoneornil(L, Index))
+                {
+                    arg = {};
+                    return true;
+                }
+                if (lua_type(L, Index) != LUA_TFUNCTION)
+                {
+                    return false;
+                }
+                arg = Callback<Ret(Args...)>(Function(L, Index));
+                return true;
+            }
+        };
+
+        template<>
+        inline bool push_result(lua_State *L, Ref &arg)
+        {
+            arg.Push(L);
+            return true;
+        }
+
+        template<>
+        inline bool push_result(lua_State *L, Table &arg)
+        {
+            arg.Push(L);
+            return true;
+        }
+
+        template<>
+        inline bool push_result(lua_State *L, Function &arg)
+        {
+            arg.Push(L);
+            return true;
+        }
+    }
+}
+
+#endif //LUAVAR_REF_H
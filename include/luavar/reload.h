@@ -0,0 +1,137 @@
+// Copyright (c) Mateusz Raczynski 2025.
+// The software is provided AS IS, with no guarantees for it to work correctly.
+// The author doesn't take any responsibility for any damages done.
+
+#ifndef LUAVAR_RELOAD_H
+#define LUAVAR_RELOAD_H
+
+#include <lua.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <luavar/config.h>
+
+namespace LuaVar
+{
+    /**
+     * @class HotReload
+     * @brief Reloads scripts at runtime and switches all declared LuaFunctions to the new version at once.
+     *
+     * Every version of the scripts is loaded into a fresh environment, whose reads fall back to the global table
+     * (so libraries and bound functions stay available). Declared functions are validated against the new
+     * environment first, a version that fails to compile, to run or to validate is dropped and the current one keeps
+     * running. A valid version is swapped in between requests: while any Request is alive, calls keep using
+     * the old version, and the swap happens when the last one ends. Calls already running always finish on the
+     * version they started with.
+     *
+     * The swap updates the references cached for the declared functions (the same cache as LuaVar::ValidateFunctions),
+     * so only functions called through the declared LuaFunction objects follow reloads. They must be declared
+     * with LuaCallValidated, otherwise their calls would look up the global instead.
+     *
+     * @code
+     * constexpr auto Handle = LuaVar::LuaFunction<int(*)(int)>("handle").Flags(LuaVar::LuaFlags<LuaVar::LuaCallValidated>{});
+     * LuaVar::HotReload scripts(L, Handle);
+     * scripts.Load(read_file("handlers.lua"));
+     * ...
+     * {
+     *     LuaVar::HotReload::Request request(scripts);
+     *     for (int id : batch)
+     *         Handle(L, id);
+     * }
+     * @endcode
+     */
+    class LuaVar_API HotReload
+    {
+    public:
+        /**
+         * @class Request
+         * @brief Keeps the current version active for its lifetime, a pending version is swapped in when the last request ends.
+         */
+        class Request
+        {
+            HotReload &_reload;
+
+        public:
+            explicit Request(HotReload &reload) : _reload(reload)
+            {
+                ++_reload._requests;
+            }
+
+            ~Request()
+            {
+                if (--_reload._requests == 0)
+                {
+                    _reload.Swap();
+                }
+            }
+
+            Request(const Request &) = delete;
+            Request &operator=(const Request &) = delete;
+        };
+
+        /**
+         * @param functions LuaFunction objects the scripts have to define, their names must be string literals
+         */
+        template<typename... Functions>
+        explicit HotReload(lua_State *L, const Functions &... functions) : L(L)
+        {
+            static_assert((Functions::UsesValidatedCache() && ...),
+                          "functions following reloads must be declared with LuaVar::LuaCallValidated");
+            _functions = {{functions.Name(), functions.CheckedArity()}...};
+        }
+
+        ~HotReload();
+
+        HotReload(const HotReload &) = delete;
+        HotReload &operator=(const HotReload &) = delete;
+
+        /**
+         * @brief Compiles and runs the script in a fresh environment and validates the declared functions in it.
+         *
+         * The new version is swapped in right away if no request is active, otherwise when the last request ends.
+         * A version still waiting for the swap is replaced.
+         * @return Descriptions of the problems found, empty if the version was accepted.
+         */
+        std::vector<std::string> Load(const char *script, const char *chunkName = "=script");
+
+        /**
+         * @brief Swaps in the pending version, unless there is none or a request is active.
+         * @return true if the version was swapped.
+         */
+        bool Swap();
+
+        /**
+         * @brief Number of versions swapped in so far, 0 until the first successful Load.
+         */
+        [[nodiscard]] uint64_t Epoch() const
+        {
+            return _epoch;
+        }
+
+        [[nodiscard]] bool HasPending() const
+        {
+            return _pending != LUA_NOREF;
+        }
+
+        /**
+         * @brief Pushes the environment of the active version (nil before the first successful Load).
+         */
+        void PushEnvironment() const;
+
+    private:
+        struct Declaration
+        {
+            const char *name;
+            int nargs;
+        };
+
+        lua_State *L;
+        std::vector<Declaration> _functions;
+        int _active = LUA_NOREF;
+        int _pending = LUA_NOREF;
+        int _requests = 0;
+        uint64_t _epoch = 0;
+    };
+}
+
+#endif //LUAVAR_RELOAD_H
@@ -0,0 +1,94 @@
+// Copyright (c) Mateusz Raczynski 2025.
+// The software is provided AS IS, with no guarantees for it to work correctly.
+// The author doesn't take any responsibility for any damages done.
+
+#ifndef LUAVAR_SERIALIZE_H
+#define LUAVAR_SERIALIZE_H
+
+#include <lua.hpp>
+#include <cstddef>
+#include <functional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <luavar/config.h>
+
+namespace LuaVar
+{
+    /**
+     * @enum SerializeStatus
+     * @brief Result of Serialize and Deserialize.
+     */
+    enum class SerializeStatus
+    {
+        Ok,
+        // functions, userdata and threads cannot be serialized
+        UnsupportedValue,
+        // tables are nested deeper than SerializeOptions::maxDepth
+        TooDeep,
+        // the buffer is full and there is no sink to flush it to
+        BufferTooSmall,
+        // the sink refused the data
+        SinkFailed,
+        // the data is not a valid serialized value or it is truncated
+        Malformed
+    };
+
+    /**
+     * @brief Receives serialized data in pieces, returns false to abort serialization.
+     */
+    using SerializeSink = std::function<bool(const char *data, size_t size)>;
+
+    /**
+     * @var maxDepth deepest nesting of tables, protects the C++ stack from very deep or malicious data
+     * @var minDedupLength strings at least this long are written once, repeated occurrences refer to the first one
+     */
+    struct SerializeOptions
+    {
+        size_t maxDepth = 200;
+        size_t minDedupLength = 4;
+    };
+
+    /**
+     * @brief Serializes value at given index into a compact binary form, the stack is left unchanged.
+     *
+     * Integers and lengths are stored as varints, numbers as 8 bytes, repeated strings and tables are written once
+     * and referenced afterwards, so shared subtables and cycles are restored as such. Tables are written with their
+     * array part first, so they are recreated with preallocated array and hash parts. Metatables are not serialized.
+     *
+     * The data is written into the caller provided buffer, which is flushed to the sink whenever it fills up,
+     * so values of any size can be streamed through a small buffer.
+     *
+     * @code
+     * std::array<char, 4096> buffer;
+     * auto status = LuaVar::Serialize(L, -1, buffer, [&file](const char *data, size_t size)
+     * {
+     *     return fwrite(data, 1, size, file) == size;
+     * });
+     * @endcode
+     *
+     * @param buffer when streaming to a sink it has to hold at least 32 bytes
+     * @param sink receives the data (all of it before returning), may be empty if the whole value is expected
+     * to fit in the buffer
+     * @param written receives the total number of bytes produced
+     */
+    LuaVar_API SerializeStatus Serialize(lua_State *L, int index, std::span<char> buffer, const SerializeSink &sink,
+                                         size_t *written = nullptr, const SerializeOptions &options = {});
+
+    /**
+     * @brief Serializes value at given index, appending the data to the string.
+     */
+    LuaVar_API SerializeStatus Serialize(lua_State *L, int index, std::string &output,
+                                         const SerializeOptions &options = {});
+
+    /**
+     * @brief Pushes value stored in serialized data.
+     *
+     * The data is validated while it is read, nothing is pushed if it is malformed.
+     * @param consumed receives the number of bytes read, data may continue with other values
+     */
+    LuaVar_API SerializeStatus Deserialize(lua_State *L, std::string_view data, size_t *consumed = nullptr,
+                                           const SerializeOptions &options = {});
+}
+
+#endif //LUAVAR_SERIALIZE_H
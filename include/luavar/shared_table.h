@@ -0,0 +1,245 @@
+// Copyright (c) Mateusz Raczynski 2025.
+// The software is provided AS IS, with no guarantees for it to work correctly.
+// The author doesn't take any responsibility for any damages done.
+
+#ifndef LUAVAR_SHARED_TABLE_H
+#define LUAVAR_SHARED_TABLE_H
+
+#include <lua.hpp>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#include <luavar/config.h>
+
+namespace LuaVar
+{
+    namespace Internal
+    {
+        struct SharedTableAccess;
+    }
+
+    /**
+     * @class SharedTable
+     * @brief Immutable key-value table living on the C++ side that can be exposed to any number of lua states.
+     *
+     * The table is built once (with SharedTable::Builder or SharedTable::FromLua) and never modified afterwards,
+     * so it can be read concurrently from multiple threads without synchronization.
+     * Every state sees the table as a small read-only userdata whose `__index`, `__len` and `__pairs`
+     * are implemented in C++, the data itself is never copied into the state.
+     *
+     * Keys can be strings or integers, values can be booleans, integers, numbers, strings or nested SharedTables.
+     *
+     * @code
+     * auto items = LuaVar::SharedTable::Builder()
+     *         .Set("sword", 10)
+     *         .Set("shield", 5)
+     *         .Build();
+     * LuaVar::SharedTable::Bind(L1, "items", items);
+     * LuaVar::SharedTable::Bind(L2, "items", items);
+     * @endcode
+     */
+    class LuaVar_API SharedTable
+    {
+    public:
+        enum class Type : std::uint8_t
+        {
+            Nil,
+            Boolean,
+            Integer,
+            Number,
+            String,
+            Table
+        };
+
+        struct Value
+        {
+            Type type = Type::Nil;
+
+            union
+            {
+                bool boolean;
+                lua_Integer integer;
+                lua_Number number;
+                std::string_view string;
+                const SharedTable *table;
+            };
+
+            Value() : integer(0)
+            {
+            }
+        };
+
+        class Builder;
+
+        SharedTable(const SharedTable &) = delete;
+        SharedTable &operator=(const SharedTable &) = delete;
+
+        /**
+         * @brief Looks up value stored under string key.
+         * @return Pointer to the value or nullptr if the key is not present.
+         */
+        [[nodiscard]] const Value *Find(std::string_view key) const;
+
+        /**
+         * @brief Looks up value stored under integer key.
+         * @return Pointer to the value or nullptr if the key is not present.
+         */
+        [[nodiscard]] const Value *Find(lua_Integer key) const;
+
+        /**
+         * @brief Number of consecutive integer keys starting from 1 (the lua `#` operator).
+         */
+        [[nodiscard]] size_t ArraySize() const
+        {
+            return _array.size();
+        }
+
+        /**
+         * @brief Total number of entries in the table.
+         */
+        [[nodiscard]] size_t Size() const
+        {
+            return _array.size() + _hashCount;
+        }
+
+        /**
+         * @brief Snapshots lua table at given stack index into a new SharedTable.
+         *
+         * Nested tables are converted recursively, a table referenced multiple times is converted once.
+         * Fails (returns nullptr) if the table contains cycles, keys other than strings or integers,
+         * or values that cannot be shared (functions, userdata, threads).
+         */
+        static std::shared_ptr<const SharedTable> FromLua(lua_State *L, int index);
+
+        /**
+         * @brief Pushes read-only userdata representing the table onto the lua stack.
+         *
+         * Pushing the same table again returns the same userdata. Nested tables reached through the pushed
+         * userdata are cached with it, so indexing the same subtable repeatedly doesn't allocate.
+         */
+        static void Push(lua_State *L, const std::shared_ptr<const SharedTable> &table);
+
+        /**
+         * @brief Makes the table available as a global variable with the given name.
+         */
+        static void Bind(lua_State *L, const char *name, const std::shared_ptr<const SharedTable> &table);
+
+    private:
+        enum class KeyType : std::uint8_t
+        {
+            Empty,
+            Integer,
+            String
+        };
+
+        struct Slot
+        {
+            std::uint64_t hash = 0;
+            KeyType keyType = KeyType::Empty;
+
+            union
+            {
+                lua_Integer integerKey;
+                std::string_view stringKey;
+            };
+
+            Value value;
+
+            Slot() : integerKey(0)
+            {
+            }
+        };
+
+        SharedTable() = default;
+
+        [[nodiscard]] const Slot *FindSlot(std::uint64_t hash, KeyType keyType, lua_Integer integerKey,
+                                           std::string_view stringKey) const;
+
+        static std::uint64_t Hash(std::string_view key);
+        static std::uint64_t Hash(lua_Integer key);
+
+        friend struct Internal::SharedTableAccess;
+
+        // values stored under keys 1..n
+        std::vector<Value> _array;
+        // open addressing hash part, capacity is always a power of two
+        std::vector<Slot> _slots;
+        size_t _hashCount = 0;
+        // all strings (keys and values) are stored in a single block
+        std::unique_ptr<char[]> _strings;
+        std::vector<std::shared_ptr<const SharedTable> > _children;
+    };
+
+    /**
+     * @class SharedTable::Builder
+     * @brief Collects entries of a SharedTable before it is frozen with Build().
+     */
+    class LuaVar_API SharedTable::Builder
+    {
+    public:
+        template<typename K, typename V>
+        Builder &Set(const K &key, V &&value)
+        {
+            Entry entry;
+            if constexpr (std::is_integral_v<K> && !std::is_same_v<K, bool>)
+            {
+                entry.keyType = KeyType::Integer;
+                entry.integerKey = static_cast<lua_Integer>(key);
+            } else
+            {
+                static_assert(std::is_convertible_v<const K &, std::string_view>, "SharedTable keys must be integers or strings");
+                entry.keyType = KeyType::String;
+                entry.stringKey = std::string_view(key);
+            }
+
+            using ValueType = std::remove_cvref_t<V>;
+            if constexpr (std::is_same_v<ValueType, bool>)
+            {
+                entry.value.type = Type::Boolean;
+                entry.value.boolean = value;
+            } else if constexpr (std::is_integral_v<ValueType>)
+            {
+                entry.value.type = Type::Integer;
+                entry.value.integer = static_cast<lua_Integer>(value);
+            } else if constexpr (std::is_floating_point_v<ValueType>)
+            {
+                entry.value.type = Type::Number;
+                entry.value.number = static_cast<lua_Number>(value);
+            } else if constexpr (std::is_convertible_v<ValueType, std::shared_ptr<const SharedTable> >)
+            {
+                entry.value.type = Type::Table;
+                entry.table = std::forward<V>(value);
+            } else
+            {
+                static_assert(std::is_convertible_v<const ValueType &, std::string_view>, "unsupported SharedTable value type");
+                entry.value.type = Type::String;
+                entry.stringValue = std::string_view(value);
+            }
+            _entries.push_back(std::move(entry));
+            return *this;
+        }
+
+        /**
+         * @brief Freezes collected entries into an immutable table. If the same key was set multiple times, the last value wins.
+         */
+        [[nodiscard]] std::shared_ptr<const SharedTable> Build() const;
+
+    private:
+        struct Entry
+        {
+            KeyType keyType = KeyType::Empty;
+            lua_Integer integerKey = 0;
+            std::string stringKey;
+            Value value;
+            std::string stringValue;
+            std::shared_ptr<const SharedTable> table;
+        };
+
+        std::vector<Entry> _entries;
+    };
+}
+
+#endif //LUAVAR_SHARED_TABLE_H
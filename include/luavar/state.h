@@ -9,16 +9,181 @@
 #ifndef STATE_H
 #define STATE_H
 #include <lua.hpp>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
 #include <luavar/config.h>
 
 namespace LuaVar
 {
+    namespace Internal
+    {
+        struct GcCounters;
+        struct MemoryCounters;
+        struct BudgetCounters;
+    }
+
+    /**
+     * @enum GcMode
+     * @brief Garbage collector modes supported by lua 5.4.
+     */
+    enum class GcMode
+    {
+        Incremental,
+        Generational
+    };
+
+    /**
+     * @brief Parameters of the incremental collector, zero keeps the current value.
+     *
+     * @var pause how long the collector waits before starting a new cycle, in percents of memory in use after the last collection
+     * @var stepMultiplier speed of the collector relative to memory allocation, in percents
+     * @var stepSize log2 of the amount of allocated bytes between collector steps
+     */
+    struct IncrementalGcParams
+    {
+        int pause = 0;
+        int stepMultiplier = 0;
+        int stepSize = 0;
+    };
+
+    /**
+     * @brief Parameters of the generational collector, zero keeps the current value.
+     *
+     * @var minorMultiplier memory growth (in percents) since the last major collection that triggers a minor collection
+     * @var majorMultiplier memory growth (in percents) that triggers a major collection
+     */
+    struct GenerationalGcParams
+    {
+        int minorMultiplier = 0;
+        int majorMultiplier = 0;
+    };
+
+    /**
+     * @brief Garbage collector telemetry of a single state.
+     *
+     * Pause durations cover only collector work requested explicitly through LuaState (Collect, StepGc),
+     * work done automatically during allocations is spread over script execution.
+     */
+    struct GcStats
+    {
+        size_t heapBytes = 0;
+        // completed collection cycles, both automatic and explicit (minor collections in generational mode)
+        size_t collections = 0;
+        // explicit Collect and StepGc calls
+        size_t explicitRuns = 0;
+        std::chrono::nanoseconds lastPause{0};
+        std::chrono::nanoseconds maxPause{0};
+        std::chrono::nanoseconds totalPause{0};
+    };
+
+    /**
+     * @brief Memory usage of a single state, tracked by its allocator.
+     */
+    struct MemoryStats
+    {
+        size_t usedBytes = 0;
+        // highest usage since the state was created or ResetPeakMemory was called
+        size_t peakBytes = 0;
+        // 0 if there is no limit
+        size_t limitBytes = 0;
+        // allocations refused because of the limit
+        size_t failedAllocations = 0;
+    };
+
+    /**
+     * @brief Called from the allocator when memory usage of the state crosses the threshold, with current usage.
+     *
+     * Runs in the middle of a lua allocation, so it must not call any lua API on the state.
+     */
+    using MemoryThresholdCallback = std::function<void(size_t usedBytes)>;
+
+    /**
+     * @enum LuaLibrary
+     * @brief Standard lua libraries, combined as a bitmask in LuaStateOptions.
+     */
+    enum LuaLibrary : unsigned
+    {
+        LuaLibraryNone = 0,
+        LuaLibraryBase = 1u << 0,
+        LuaLibraryPackage = 1u << 1,
+        LuaLibraryCoroutine = 1u << 2,
+        LuaLibraryTable = 1u << 3,
+        LuaLibraryIo = 1u << 4,
+        LuaLibraryOs = 1u << 5,
+        LuaLibraryString = 1u << 6,
+        LuaLibraryMath = 1u << 7,
+        LuaLibraryUtf8 = 1u << 8,
+        LuaLibraryDebug = 1u << 9,
+        LuaLibraryAll = (1u << 10) - 1
+    };
+
+    /**
+     * @brief Options of a new LuaState.
+     *
+     * @var memoryLimit allocations that would exceed this many bytes fail with a lua memory error, 0 for no limit
+     * @var memoryThreshold usage (in bytes) that triggers onMemoryThreshold, 0 to disable
+     * @var onMemoryThreshold called each time usage rises past memoryThreshold
+     * @var libraries LuaLibrary bitmask of standard libraries opened right away
+     * @var lazyLibraries LuaLibrary bitmask of standard libraries opened when their global (e.g. `string`)
+     * is accessed for the first time, through `__index` of the global table. The base library is never lazy,
+     * it is opened right away when requested. The metatable of the global table is removed once all of them are loaded.
+     * A lazy string library is also loaded by the first method call on a string, like `('abc'):upper()`.
+     */
+    struct LuaStateOptions
+    {
+        size_t memoryLimit = 0;
+        size_t memoryThreshold = 0;
+        MemoryThresholdCallback onMemoryThreshold{};
+        unsigned libraries = LuaLibraryNone;
+        unsigned lazyLibraries = LuaLibraryNone;
+    };
+
+    /**
+     * @brief Limits of a single protected call, exceeding any of them aborts the call with a lua error.
+     *
+     * Limits are checked from a count hook every `checkInterval` VM instructions, so they are enforced with that
+     * granularity. Time spent in C/C++ functions is counted only for the wall time limit and only once control
+     * returns to lua. Once exceeded, every following check fails immediately, so scripts can't catch the error
+     * with pcall and keep running. Coroutines get the hook when they are resumed through coroutine.resume or
+     * a function made by coroutine.wrap, including the ones created before the call.
+     *
+     * Any count hook makes the VM trace every instruction, so a limited call runs noticeably slower than
+     * an unlimited one and the interval affects the overhead only marginally. When the coroutine library is
+     * loaded, the hook also runs on every function call to recognize resumed coroutines, which adds a fixed
+     * cost per call.
+     *
+     * A hook installed by the embedder (e.g. a debugger or profiler) doesn't run during a limited call,
+     * it is restored once the call returns.
+     *
+     * @var instructions VM instructions the call may execute, 0 for no limit
+     * @var wallTime time the call may take, 0 for no limit
+     * @var checkInterval VM instructions between checks
+     */
+    struct ExecutionBudget
+    {
+        uint64_t instructions = 0;
+        std::chrono::nanoseconds wallTime{0};
+        int checkInterval = 1000;
+    };
+
     LuaVar_API class LuaState
     {
         lua_State *L;
+        std::unique_ptr<Internal::GcCounters> _gc;
+        std::unique_ptr<Internal::MemoryCounters> _memory;
+        std::unique_ptr<Internal::BudgetCounters> _budget;
+
+        template<typename Call>
+        int WithBudget(const ExecutionBudget *budget, Call &&call);
+
+        void RecordPause(std::chrono::nanoseconds pause);
 
     public:
         LuaState();
+        explicit LuaState(const LuaStateOptions &options);
         ~LuaState();
         [[nodiscard]] inline lua_State *Get() const
         {
@@ -29,6 +194,91 @@ namespace LuaVar
         {
             return L;
         }
+
+        /**
+         * @brief Switches the collector to incremental mode.
+         */
+        void UseIncrementalGc(const IncrementalGcParams &params = {});
+
+        /**
+         * @brief Switches the collector to generational mode.
+         */
+        void UseGenerationalGc(const GenerationalGcParams &params = {});
+
+        /**
+         * @brief Mode last set through UseIncrementalGc or UseGenerationalGc (incremental by default).
+         */
+        [[nodiscard]] GcMode GetGcMode() const;
+
+        /**
+         * @brief Stops or restarts automatic collection. Stopped collector still runs on Collect and StepGc.
+         */
+        void SetGcRunning(bool running);
+
+        [[nodiscard]] bool IsGcRunning() const;
+
+        /**
+         * @brief Performs a full collection cycle.
+         */
+        void Collect();
+
+        /**
+         * @brief Performs collector work in bounded slices until the time budget is used or the cycle completes.
+         *
+         * Meant to be called during idle time, usually with automatic collection stopped (SetGcRunning(false)).
+         *
+         * @param budget time budget, at least one step is always performed
+         * @param stepKb amount of work of a single slice (as if the given KB were allocated), 0 for a single basic step
+         * @return true if a collection cycle has been completed
+         */
+        bool StepGc(std::chrono::microseconds budget, int stepKb = 0);
+
+        [[nodiscard]] GcStats GetGcStats() const;
+
+        /**
+         * @brief Sets the hard memory limit, 0 removes it. Lowering it below current usage only affects new allocations.
+         */
+        void SetMemoryLimit(size_t bytes);
+
+        /**
+         * @brief Sets the usage threshold and the callback called when usage rises past it, 0 disables it.
+         */
+        void SetMemoryThreshold(size_t bytes, MemoryThresholdCallback callback);
+
+        [[nodiscard]] MemoryStats GetMemoryStats() const;
+
+        /**
+         * @brief Starts tracking the peak usage again from the current usage.
+         */
+        void ResetPeakMemory();
+
+        /**
+         * @brief Sets the budget applied to Run and PCall calls that don't specify their own, default budget is unlimited.
+         */
+        void SetExecutionBudget(const ExecutionBudget &budget);
+
+        /**
+         * @brief Loads and runs the script in protected mode within the default execution budget.
+         * @return lua status code, on failure the error message is left on the stack.
+         */
+        int Run(const char *script, const char *chunkName = "=run");
+
+        int Run(const char *script, const ExecutionBudget &budget, const char *chunkName = "=run");
+
+        /**
+         * @brief lua_pcall within the default execution budget.
+         *
+         * Calls nested in an already running Run or PCall stay within the outer budget.
+         * @return lua status code, on failure the error message is left on the stack.
+         */
+        int PCall(int nargs, int nresults);
+
+        int PCall(int nargs, int nresults, const ExecutionBudget &budget);
+
+        /**
+         * @brief Whether the last Run or PCall was aborted because of its execution budget.
+         */
+        [[nodiscard]] bool BudgetExceeded() const;
     };
 }
 #endif //STATE_H
@@ -7,6 +7,7 @@
 
 #include <functional>
 #include <concepts>
+#include <utility>
 
 namespace LuaVar {
 
@@ -27,13 +28,23 @@ namespace LuaVar {
      *
      * @var LuaParamTypeCheck
      * Enables type checking of parameters passed to the Lua function.
+     *
+     * @var LuaCallCheckArity
+     * Validation of the function (LuaVar::ValidateFunctions) also checks the number of parameters
+     * declared by the Lua function, unless it is a vararg or C function.
+     *
+     * @var LuaCallValidated
+     * Calls use the function cached by validation (LuaVar::ValidateFunctions, LuaVar::HotReload) and look up
+     * the global only if there is none. Without it calls always go straight to the global.
      */
     enum LuaCallFlag
     {
         LuaCallDefaultMode = 0b0000,
         LuaCallSoftError = 0b1000,
         LuaParamTypeCheck = 0b0100, //todo: not used currently
-        LuaVariableValueCountReturned = 0b00100
+        LuaVariableValueCountReturned = 0b00100,
+        LuaCallCheckArity = 0b10000,
+        LuaCallValidated = 0b100000
     };
 
     template<int _flags>
@@ -143,9 +154,9 @@ namespace Internal {
     template<typename T>
     struct CallableDyn
     {
-        const T _functor;
+        T _functor;
 
-        CallableDyn(const T _functor) : _functor(_functor)
+        CallableDyn(T _functor) : _functor(std::move(_functor))
         {
         };
     };
@@ -0,0 +1,392 @@
+// Copyright (c) Mateusz Raczynski 2025.
+// The software is provided AS IS, with no guarantees for it to work correctly.
+// The author doesn't take any responsibility for any damages done.
+
+#include <luavar/bundle.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <new>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace LuaVar
+{
+    struct ScriptBundle::Entry
+    {
+        std::uint64_t chunkOffset;
+        std::uint64_t chunkSize;
+        std::uint64_t nameOffset;
+        std::uint64_t nameSize;
+    };
+
+    namespace Internal
+    {
+        // the file starts with the header followed by the index entries sorted by name, then null terminated names
+        // and the chunks; integers are stored in native byte order, like the bytecode itself
+        struct BundleHeader
+        {
+            char magic[8];
+            std::uint32_t version;
+            std::uint32_t luaVersion;
+            std::uint64_t count;
+        };
+
+        static constexpr char BundleMagic[8] = {'L', 'V', 'B', 'U', 'N', 'D', 'L', 'E'};
+        static constexpr std::uint32_t BundleVersion = 1;
+        static const char *BundleMetaName = "LuaVar::ScriptBundle";
+
+        static void *MapFile(const std::string &path, size_t &size, std::string &error)
+        {
+#ifdef _WIN32
+            HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                      FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (file == INVALID_HANDLE_VALUE)
+            {
+                error = "cannot open " + path;
+                return nullptr;
+            }
+            LARGE_INTEGER fileSize;
+            void *view = nullptr;
+            if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0)
+            {
+                size = static_cast<size_t>(fileSize.QuadPart);
+                HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+                if (mapping != nullptr)
+                {
+                    view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                    CloseHandle(mapping);
+                }
+            }
+            CloseHandle(file);
+            if (view == nullptr)
+            {
+                error = "cannot map " + path;
+            }
+            return view;
+#else
+            const int file = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (file < 0)
+            {
+                error = "cannot open " + path + ": " + strerror(errno);
+                return nullptr;
+            }
+            struct stat status{};
+            void *view = nullptr;
+            if (fstat(file, &status) == 0 && status.st_size > 0)
+            {
+                size = static_cast<size_t>(status.st_size);
+                view = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+                if (view == MAP_FAILED)
+                {
+                    view = nullptr;
+                }
+            }
+            const int mapError = errno;
+            close(file);
+            if (view == nullptr)
+            {
+                error = "cannot map " + path + ": " + strerror(mapError);
+            }
+            return view;
+#endif
+        }
+
+        static void UnmapFile(void *view, size_t size)
+        {
+#ifdef _WIN32
+            (void) size;
+            UnmapViewOfFile(view);
+#else
+            munmap(view, size);
+#endif
+        }
+
+        static int CollectBundle(lua_State *L)
+        {
+            using Handle = std::shared_ptr<ScriptBundle>;
+            static_cast<Handle *>(lua_touserdata(L, 1))->~Handle();
+            return 0;
+        }
+
+        // package.searchers entry, the bundle handle is the upvalue
+        static int SearchBundle(lua_State *L)
+        {
+            const auto &bundle = *static_cast<std::shared_ptr<ScriptBundle> *>(lua_touserdata(L, lua_upvalueindex(1)));
+            size_t length;
+            const char *name = luaL_checklstring(L, 1, &length);
+            if (!bundle->Contains({name, length}))
+            {
+                lua_pushfstring(L, "no script '%s' in the bundle", name);
+                return 1;
+            }
+            if (bundle->Load(L, {name, length}) != LUA_OK)
+            {
+                return luaL_error(L, "error loading module '%s' from the bundle:\n\t%s", name, lua_tostring(L, -1));
+            }
+            lua_pushvalue(L, 1);
+            return 2;
+        }
+
+        static int WriteChunk(lua_State *, const void *data, size_t size, void *output)
+        {
+            static_cast<std::string *>(output)->append(static_cast<const char *>(data), size);
+            return 0;
+        }
+    }
+
+    std::shared_ptr<ScriptBundle> ScriptBundle::Open(const std::string &path, std::string &error)
+    {
+        size_t size = 0;
+        void *mapping = Internal::MapFile(path, size, error);
+        if (mapping == nullptr)
+        {
+            return nullptr;
+        }
+        std::shared_ptr<ScriptBundle> bundle(new ScriptBundle(mapping, size));
+
+        Internal::BundleHeader header{};
+        if (size < sizeof(header))
+        {
+            error = path + " is not a script bundle";
+            return nullptr;
+        }
+        memcpy(&header, mapping, sizeof(header));
+        if (memcmp(header.magic, Internal::BundleMagic, sizeof(header.magic)) != 0 ||
+            header.version != Internal::BundleVersion)
+        {
+            error = path + " is not a script bundle";
+            return nullptr;
+        }
+        if (header.luaVersion != LUA_VERSION_NUM)
+        {
+            error = path + " was built for a different version of lua";
+            return nullptr;
+        }
+        if (header.count > (size - sizeof(header)) / sizeof(Entry))
+        {
+            error = path + " is truncated";
+            return nullptr;
+        }
+
+        // the mapping is page aligned and the entries follow the header, so they are read in place
+        bundle->_entries = reinterpret_cast<const Entry *>(bundle->_data + sizeof(header));
+        bundle->_count = static_cast<size_t>(header.count);
+        for (size_t i = 0; i < bundle->_count; ++i)
+        {
+            const Entry &entry = bundle->_entries[i];
+            const bool valid = entry.nameOffset < size && entry.nameSize < size - entry.nameOffset &&
+                               bundle->_data[entry.nameOffset + entry.nameSize] == '\0' &&
+                               entry.chunkOffset <= size && entry.chunkSize <= size - entry.chunkOffset &&
+                               (i == 0 || bundle->Name(i - 1) < bundle->Name(i));
+            if (!valid)
+            {
+                error = path + " has a corrupted index";
+                return nullptr;
+            }
+        }
+        return bundle;
+    }
+
+    ScriptBundle::ScriptBundle(void *mapping, size_t size) :
+        _mapping(mapping), _size(size), _data(static_cast<const char *>(mapping))
+    {
+    }
+
+    ScriptBundle::~ScriptBundle()
+    {
+        Internal::UnmapFile(_mapping, _size);
+    }
+
+    std::string_view ScriptBundle::Name(size_t index) const
+    {
+        const Entry &entry = _entries[index];
+        return {_data + entry.nameOffset, static_cast<size_t>(entry.nameSize)};
+    }
+
+    const ScriptBundle::Entry *ScriptBundle::Find(std::string_view name) const
+    {
+        const Entry *end = _entries + _count;
+        const Entry *entry = std::lower_bound(_entries, end, name, [this](const Entry &entry, std::string_view name)
+        {
+            return std::string_view(_data + entry.nameOffset, static_cast<size_t>(entry.nameSize)) < name;
+        });
+        if (entry == end || std::string_view(_data + entry->nameOffset, static_cast<size_t>(entry->nameSize)) != name)
+        {
+            return nullptr;
+        }
+        return entry;
+    }
+
+    bool ScriptBundle::Contains(std::string_view name) const
+    {
+        return Find(name) != nullptr;
+    }
+
+    std::string_view ScriptBundle::Chunk(std::string_view name) const
+    {
+        const Entry *entry = Find(name);
+        if (entry == nullptr)
+        {
+            return {};
+        }
+        return {_data + entry->chunkOffset, static_cast<size_t>(entry->chunkSize)};
+    }
+
+    int ScriptBundle::Load(lua_State *L, std::string_view name) const
+    {
+        const Entry *entry = Find(name);
+        if (entry == nullptr)
+        {
+            lua_pushliteral(L, "no script '");
+            lua_pushlstring(L, name.data(), name.size());
+            lua_pushliteral(L, "' in the bundle");
+            lua_concat(L, 3);
+            return LUA_ERRFILE;
+        }
+        // the buffer reader hands the mapped bytes to lua_load in one piece, nothing is copied before undumping;
+        // names are null terminated in the file, so they serve as chunk names directly
+        return luaL_loadbufferx(L, _data + entry->chunkOffset, static_cast<size_t>(entry->chunkSize),
+                                _data + entry->nameOffset, "b");
+    }
+
+    bool ScriptBundle::AddSearcher(lua_State *L, const std::shared_ptr<ScriptBundle> &bundle)
+    {
+        if (lua_getglobal(L, "package") != LUA_TTABLE)
+        {
+            lua_pop(L, 1);
+            return false;
+        }
+        if (lua_getfield(L, -1, "searchers") != LUA_TTABLE)
+        {
+            lua_pop(L, 2);
+            return false;
+        }
+        // the bundle goes right after the preload searcher
+        for (auto i = static_cast<lua_Integer>(lua_rawlen(L, -1)); i >= 2; --i)
+        {
+            lua_rawgeti(L, -1, i);
+            lua_rawseti(L, -2, i + 1);
+        }
+        new(lua_newuserdatauv(L, sizeof(std::shared_ptr<ScriptBundle>), 0)) std::shared_ptr<ScriptBundle>(bundle);
+        if (luaL_newmetatable(L, Internal::BundleMetaName))
+        {
+            lua_pushcfunction(L, Internal::CollectBundle);
+            lua_setfield(L, -2, "__gc");
+        }
+        lua_setmetatable(L, -2);
+        lua_pushcclosure(L, Internal::SearchBundle, 1);
+        lua_rawseti(L, -2, 2);
+        lua_pop(L, 2);
+        return true;
+    }
+
+    ScriptBundleBuilder::ScriptBundleBuilder(bool strip) : _strip(strip)
+    {
+    }
+
+    bool ScriptBundleBuilder::Add(const std::string &name, std::string_view source, std::string &error)
+    {
+        return Compile(name, source, "@" + name, error);
+    }
+
+    bool ScriptBundleBuilder::AddFile(const std::string &name, const std::string &path, std::string &error)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+        {
+            error = "cannot open " + path;
+            return false;
+        }
+        const std::string source((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        return Compile(name, source, "@" + path, error);
+    }
+
+    bool ScriptBundleBuilder::Compile(const std::string &name, std::string_view source, const std::string &chunkName,
+                                      std::string &error)
+    {
+        if (std::ranges::any_of(_scripts, [&name](const auto &script) { return script.first == name; }))
+        {
+            error = "duplicate script name " + name;
+            return false;
+        }
+        lua_State *L = _state.Get();
+        if (luaL_loadbufferx(L, source.data(), source.size(), chunkName.c_str(), "t") != LUA_OK)
+        {
+            error = lua_tostring(L, -1);
+            lua_pop(L, 1);
+            return false;
+        }
+        std::string chunk;
+        lua_dump(L, Internal::WriteChunk, &chunk, _strip);
+        lua_pop(L, 1);
+        _scripts.emplace_back(name, std::move(chunk));
+        return true;
+    }
+
+    bool ScriptBundleBuilder::Write(const std::string &path, std::string &error) const
+    {
+        std::vector<const std::pair<std::string, std::string> *> sorted;
+        sorted.reserve(_scripts.size());
+        for (const auto &script: _scripts)
+        {
+            sorted.push_back(&script);
+        }
+        std::ranges::sort(sorted, [](const auto *a, const auto *b) { return a->first < b->first; });
+
+        Internal::BundleHeader header{};
+        memcpy(header.magic, Internal::BundleMagic, sizeof(header.magic));
+        header.version = Internal::BundleVersion;
+        header.luaVersion = LUA_VERSION_NUM;
+        header.count = sorted.size();
+
+        std::vector<ScriptBundle::Entry> entries(sorted.size());
+        std::uint64_t offset = sizeof(header) + entries.size() * sizeof(ScriptBundle::Entry);
+        for (size_t i = 0; i < sorted.size(); ++i)
+        {
+            entries[i].nameOffset = offset;
+            entries[i].nameSize = sorted[i]->first.size();
+            offset += sorted[i]->first.size() + 1;
+        }
+        for (size_t i = 0; i < sorted.size(); ++i)
+        {
+            entries[i].chunkOffset = offset;
+            entries[i].chunkSize = sorted[i]->second.size();
+            offset += sorted[i]->second.size();
+        }
+
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char *>(entries.data()),
+                   static_cast<std::streamsize>(entries.size() * sizeof(ScriptBundle::Entry)));
+        for (const auto *script: sorted)
+        {
+            file.write(script->first.c_str(), static_cast<std::streamsize>(script->first.size() + 1));
+        }
+        for (const auto *script: sorted)
+        {
+            file.write(script->second.data(), static_cast<std::streamsize>(script->second.size()));
+        }
+        file.close();
+        if (!file)
+        {
+            error = "cannot write " + path;
+            return false;
+        }
+        return true;
+    }
+}
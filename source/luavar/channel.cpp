@@ -0,0 +1,502 @@
+// Copyright (c) Mateusz Raczynski 2025.
+// The software is provided AS IS, with no guarantees for it to work correctly.
+// The author doesn't take any responsibility for any damages done.
+
+#include <luavar/channel.h>
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <new>
+
+namespace LuaVar
+{
+    namespace Internal
+    {
+        static const char *ChannelMetaName = "LuaVar::Channel";
+
+        // every message starts with a tag, integers and numbers are stored in their native representation
+        // (messages never leave the process), lengths and counts as varints
+        enum class MessageTag : std::uint8_t
+        {
+            Nil,
+            False,
+            True,
+            Integer,
+            Number,
+            String,
+            Table
+        };
+
+        static size_t VarintSize(size_t value)
+        {
+            size_t size = 1;
+            while (value >= 0x80)
+            {
+                value >>= 7;
+                ++size;
+            }
+            return size;
+        }
+
+        static char *WriteVarint(char *out, size_t value)
+        {
+            while (value >= 0x80)
+            {
+                *out++ = static_cast<char>(value | 0x80);
+                value >>= 7;
+            }
+            *out++ = static_cast<char>(value);
+            return out;
+        }
+
+        static const char *ReadVarint(const char *in, size_t &value)
+        {
+            value = 0;
+            for (int shift = 0;; shift += 7)
+            {
+                const auto byte = static_cast<unsigned char>(*in++);
+                value |= static_cast<size_t>(byte & 0x7f) << shift;
+                if ((byte & 0x80) == 0)
+                {
+                    return in;
+                }
+            }
+        }
+
+        struct ChannelAccess
+        {
+            // size of the encoded scalar at given index, 0 if it is not a scalar
+            static size_t ScalarSize(lua_State *L, int index)
+            {
+                switch (lua_type(L, index))
+                {
+                    case LUA_TNIL:
+                    case LUA_TBOOLEAN:
+                        return 1;
+                    case LUA_TNUMBER:
+                        return 1 + sizeof(lua_Integer);
+                    case LUA_TSTRING:
+                    {
+                        size_t length;
+                        lua_tolstring(L, index, &length);
+                        return 1 + VarintSize(length) + length;
+                    }
+                    default:
+                        return 0;
+                }
+            }
+
+            // size of the message encoding value at given index, 0 if the value is not supported
+            static size_t MessageSize(lua_State *L, int index, size_t &integerKeys, size_t &entries)
+            {
+                integerKeys = 0;
+                entries = 0;
+                if (lua_type(L, index) != LUA_TTABLE)
+                {
+                    return ScalarSize(L, index);
+                }
+                index = lua_absindex(L, index);
+                size_t size = 0;
+                lua_pushnil(L);
+                while (lua_next(L, index) != 0)
+                {
+                    const size_t key = ScalarSize(L, -2);
+                    const size_t value = ScalarSize(L, -1);
+                    if (key == 0 || value == 0)
+                    {
+                        lua_pop(L, 2);
+                        return 0;
+                    }
+                    integerKeys += lua_isinteger(L, -2) ? 1 : 0;
+                    ++entries;
+                    size += key + value;
+                    lua_pop(L, 1);
+                }
+                return 1 + VarintSize(entries) + VarintSize(integerKeys) + size;
+            }
+
+            static char *WriteScalar(lua_State *L, int index, char *out)
+            {
+                switch (lua_type(L, index))
+                {
+                    case LUA_TBOOLEAN:
+                        *out++ = static_cast<char>(lua_toboolean(L, index) ? MessageTag::True : MessageTag::False);
+                        return out;
+                    case LUA_TNUMBER:
+                        if (lua_isinteger(L, index))
+                        {
+                            const lua_Integer value = lua_tointeger(L, index);
+                            *out++ = static_cast<char>(MessageTag::Integer);
+                            std::memcpy(out, &value, sizeof(value));
+                            return out + sizeof(value);
+                        } else
+                        {
+                            const lua_Number value = lua_tonumber(L, index);
+                            *out++ = static_cast<char>(MessageTag::Number);
+                            std::memcpy(out, &value, sizeof(value));
+                            return out + sizeof(value);
+                        }
+                    case LUA_TSTRING:
+                    {
+                        size_t length;
+                        const char *str = lua_tolstring(L, index, &length);
+                        *out++ = static_cast<char>(MessageTag::String);
+                        out = WriteVarint(out, length);
+                        std::memcpy(out, str, length);
+                        return out + length;
+                    }
+                    default:
+                        *out++ = static_cast<char>(MessageTag::Nil);
+                        return out;
+                }
+            }
+
+            // encodes supported value at given index, the message is allocated once with the exact size
+            static std::string Encode(lua_State *L, int index, size_t size, size_t integerKeys, size_t entries)
+            {
+                std::string message(size, '\0');
+                char *out = message.data();
+                if (lua_type(L, index) != LUA_TTABLE)
+                {
+                    WriteScalar(L, index, out);
+                    return message;
+                }
+                index = lua_absindex(L, index);
+                *out++ = static_cast<char>(MessageTag::Table);
+                out = WriteVarint(out, entries);
+                out = WriteVarint(out, integerKeys);
+                lua_pushnil(L);
+                while (lua_next(L, index) != 0)
+                {
+                    out = WriteScalar(L, -2, out);
+                    out = WriteScalar(L, -1, out);
+                    lua_pop(L, 1);
+                }
+                return message;
+            }
+
+            static const char *ReadScalar(lua_State *L, const char *in)
+            {
+                switch (static_cast<MessageTag>(*in++))
+                {
+                    case MessageTag::False:
+                        lua_pushboolean(L, false);
+                        return in;
+                    case MessageTag::True:
+                        lua_pushboolean(L, true);
+                        return in;
+                    case MessageTag::Integer:
+                    {
+                        lua_Integer value;
+                        std::memcpy(&value, in, sizeof(value));
+                        lua_pushinteger(L, value);
+                        return in + sizeof(value);
+                    }
+                    case MessageTag::Number:
+                    {
+                        lua_Number value;
+                        std::memcpy(&value, in, sizeof(value));
+                        lua_pushnumber(L, value);
+                        return in + sizeof(value);
+                    }
+                    case MessageTag::String:
+                    {
+                        size_t length;
+                        in = ReadVarint(in, length);
+                        lua_pushlstring(L, in, length);
+                        return in + length;
+                    }
+                    default:
+                        lua_pushnil(L);
+                        return in;
+                }
+            }
+
+            static void Decode(lua_State *L, const std::string &message)
+            {
+                const char *in = message.data();
+                if (static_cast<MessageTag>(*in) != MessageTag::Table)
+                {
+                    ReadScalar(L, in);
+                    return;
+                }
+                size_t entries;
+                size_t integerKeys;
+                in = ReadVarint(in + 1, entries);
+                in = ReadVarint(in, integerKeys);
+                lua_createtable(L, static_cast<int>(integerKeys), static_cast<int>(entries - integerKeys));
+                for (size_t i = 0; i < entries; ++i)
+                {
+                    in = ReadScalar(L, in);
+                    in = ReadScalar(L, in);
+                    lua_rawset(L, -3);
+                }
+            }
+
+            static bool Prepare(lua_State *L, int index, std::string &message)
+            {
+                size_t integerKeys;
+                size_t entries;
+                const size_t size = MessageSize(L, index, integerKeys, entries);
+                if (size == 0)
+                {
+                    return false;
+                }
+                message = Encode(L, index, size, integerKeys, entries);
+                return true;
+            }
+
+            static Channel &Get(lua_State *L)
+            {
+                return **static_cast<std::shared_ptr<Channel> *>(luaL_checkudata(L, 1, ChannelMetaName));
+            }
+
+            // waiting operations yield when called from a coroutine and retry in the continuation,
+            // C++ objects are destroyed before yielding as lua_yieldk doesn't return
+            static int Send(lua_State *L, int /*status*/, lua_KContext /*context*/)
+            {
+                Channel &channel = Get(L);
+                lua_settop(L, 2);
+                if (!Channel::IsSupported(L, 2))
+                {
+                    return luaL_error(L, "value of type %s cannot be sent through a channel", luaL_typename(L, 2));
+                }
+                if (!lua_isyieldable(L))
+                {
+                    channel.Send(L, 2);
+                    return 0;
+                }
+                if (channel.TrySend(L, 2))
+                {
+                    return 0;
+                }
+                return lua_yieldk(L, 0, 0, Send);
+            }
+
+            static int Receive(lua_State *L, int /*status*/, lua_KContext /*context*/)
+            {
+                Channel &channel = Get(L);
+                lua_settop(L, 1);
+                if (!lua_isyieldable(L))
+                {
+                    channel.Receive(L);
+                    return 1;
+                }
+                if (channel.TryReceive(L))
+                {
+                    return 1;
+                }
+                return lua_yieldk(L, 0, 0, Receive);
+            }
+
+            static int LuaSend(lua_State *L)
+            {
+                return Send(L, LUA_OK, 0);
+            }
+
+            static int LuaReceive(lua_State *L)
+            {
+                return Receive(L, LUA_OK, 0);
+            }
+
+            static int LuaTryReceive(lua_State *L)
+            {
+                Channel &channel = Get(L);
+                lua_settop(L, 1);
+                if (!channel.TryReceive(L))
+                {
+                    lua_pushboolean(L, false);
+                    return 1;
+                }
+                lua_pushboolean(L, true);
+                lua_insert(L, -2);
+                return 2;
+            }
+
+            static int Clear(lua_State *L)
+            {
+                static_cast<std::shared_ptr<Channel> *>(lua_touserdata(L, 1))->~shared_ptr();
+                return 0;
+            }
+        };
+    }
+
+    Channel::Channel(size_t capacity) : _mask(std::bit_ceil(std::max<size_t>(capacity, 2)) - 1)
+    {
+        _cells = std::make_unique<Cell[]>(_mask + 1);
+        for (size_t i = 0; i <= _mask; ++i)
+        {
+            _cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    Channel::~Channel() = default;
+
+    std::shared_ptr<Channel> Channel::Create(size_t capacity)
+    {
+        return std::shared_ptr<Channel>(new Channel(capacity));
+    }
+
+    bool Channel::TryPush(std::string &message)
+    {
+        size_t position = _sendPosition.load(std::memory_order_relaxed);
+        while (true)
+        {
+            Cell &cell = _cells[position & _mask];
+            const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            const auto difference = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(position);
+            if (difference == 0)
+            {
+                if (_sendPosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    cell.message = std::move(message);
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    _sent.fetch_add(1);
+                    if (_receivers.load() != 0 && _receivers.exchange(0) != 0)
+                    {
+                        _sent.notify_all();
+                    }
+                    return true;
+                }
+            } else if (difference < 0)
+            {
+                return false;
+            } else
+            {
+                position = _sendPosition.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool Channel::TryPop(std::string &message)
+    {
+        size_t position = _receivePosition.load(std::memory_order_relaxed);
+        while (true)
+        {
+            Cell &cell = _cells[position & _mask];
+            const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            const auto difference = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(position + 1);
+            if (difference == 0)
+            {
+                if (_receivePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    message = std::move(cell.message);
+                    cell.sequence.store(position + _mask + 1, std::memory_order_release);
+                    _received.fetch_add(1);
+                    if (_senders.load() != 0 && _senders.exchange(0) != 0)
+                    {
+                        _received.notify_all();
+                    }
+                    return true;
+                }
+            } else if (difference < 0)
+            {
+                return false;
+            } else
+            {
+                position = _receivePosition.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // the counter is read before the failed attempt, so an operation completed in between makes wait return at once,
+    // the registration is cleared by the notifying side, a thread that returned without being woken up only costs
+    // one extra notification
+    void Channel::WaitForReceive(uint32_t seen)
+    {
+        _senders.fetch_add(1);
+        _received.wait(seen);
+    }
+
+    void Channel::WaitForSend(uint32_t seen)
+    {
+        _receivers.fetch_add(1);
+        _sent.wait(seen);
+    }
+
+    bool Channel::TrySend(lua_State *L, int index)
+    {
+        std::string message;
+        return Internal::ChannelAccess::Prepare(L, index, message) && TryPush(message);
+    }
+
+    bool Channel::Send(lua_State *L, int index)
+    {
+        std::string message;
+        if (!Internal::ChannelAccess::Prepare(L, index, message))
+        {
+            return false;
+        }
+        while (true)
+        {
+            const uint32_t seen = _received.load();
+            if (TryPush(message))
+            {
+                return true;
+            }
+            WaitForReceive(seen);
+        }
+    }
+
+    bool Channel::TryReceive(lua_State *L)
+    {
+        std::string message;
+        if (!TryPop(message))
+        {
+            return false;
+        }
+        Internal::ChannelAccess::Decode(L, message);
+        return true;
+    }
+
+    void Channel::Receive(lua_State *L)
+    {
+        std::string message;
+        while (true)
+        {
+            const uint32_t seen = _sent.load();
+            if (TryPop(message))
+            {
+                break;
+            }
+            WaitForSend(seen);
+        }
+        Internal::ChannelAccess::Decode(L, message);
+    }
+
+    bool Channel::IsSupported(lua_State *L, int index)
+    {
+        size_t integerKeys;
+        size_t entries;
+        return Internal::ChannelAccess::MessageSize(L, index, integerKeys, entries) != 0;
+    }
+
+    void Channel::Push(lua_State *L, const std::shared_ptr<Channel> &channel)
+    {
+        new(lua_newuserdatauv(L, sizeof(std::shared_ptr<Channel>), 0)) std::shared_ptr<Channel>(channel);
+        if (luaL_newmetatable(L, Internal::ChannelMetaName))
+        {
+            const luaL_Reg methods[] = {
+                {"send", Internal::ChannelAccess::LuaSend},
+                {"recv", Internal::ChannelAccess::LuaReceive},
+                {"try_recv", Internal::ChannelAccess::LuaTryReceive},
+                {nullptr, nullptr}
+            };
+            luaL_newlib(L, methods);
+            lua_setfield(L, -2, "__index");
+            lua_pushcfunction(L, Internal::ChannelAccess::Clear);
+            lua_setfield(L, -2, "__gc");
+            // prevent scripts from replacing the metatable
+            lua_pushstring(L, Internal::ChannelMetaName);
+            lua_setfield(L, -2, "__metatable");
+        }
+        lua_setmetatable(L, -2);
+    }
+
+    void Channel::Bind(lua_State *L, const char *name, const std::shared_ptr<Channel> &channel)
+    {
+        Push(L, channel);
+        lua_setglobal(L, name);
+    }
+}
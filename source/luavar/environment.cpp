@@ -0,0 +1,183 @@
+// Copyright (c) Mateusz Raczynski 2025.
+// The software is provided AS IS, with no guarantees for it to work correctly.
+// The author doesn't take any responsibility for any damages done.
+
+#include <luavar/environment.h>
+
+#include <cstring>
+#include <utility>
+
+namespace LuaVar
+{
+    namespace Internal
+    {
+        // address used as registry key of the list of template chunks
+        static const char TemplateChunksKey = 0;
+
+        // pushes list of template chunks, creates it if needed
+        static void PushTemplateChunks(lua_State *L)
+        {
+            if (lua_rawgetp(L, LUA_REGISTRYINDEX, &TemplateChunksKey) != LUA_TTABLE)
+            {
+                lua_pop(L, 1);
+                lua_createtable(L, 8, 0);
+                lua_pushvalue(L, -1);
+                lua_rawsetp(L, LUA_REGISTRYINDEX, &TemplateChunksKey);
+            }
+        }
+
+        // sets `_ENV` of all template chunks to the value on top of the stack and pops it
+        static void SetTemplateChunksEnv(lua_State *L)
+        {
+            if (lua_rawgetp(L, LUA_REGISTRYINDEX, &TemplateChunksKey) != LUA_TTABLE)
+            {
+                lua_pop(L, 2);
+                return;
+            }
+            const auto count = static_cast<lua_Integer>(lua_rawlen(L, -1));
+            for (lua_Integer i = 1; i <= count; ++i)
+            {
+                lua_rawgeti(L, -1, i);
+                lua_pushvalue(L, -3);
+                // `_ENV` is always the first upvalue of the main chunk
+                lua_setupvalue(L, -2, 1);
+                lua_pop(L, 1);
+            }
+            lua_pop(L, 2);
+        }
+    }
+
+    Environment::Environment(lua_State *L) : L(L)
+    {
+        lua_createtable(L, 0, 0);
+
+        lua_createtable(L, 0, 2);
+        lua_pushglobaltable(L);
+        lua_setfield(L, -2, "__index");
+        // prevent scripts from detaching the environment from the template
+        lua_pushboolean(L, false);
+        lua_setfield(L, -2, "__metatable");
+        lua_setmetatable(L, -2);
+
+        // `_G` inside the environment refers to the environment itself
+        lua_pushvalue(L, -1);
+        lua_setfield(L, -2, "_G");
+
+        _ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    }
+
+    Environment::~Environment()
+    {
+        if (L != nullptr)
+        {
+            luaL_unref(L, LUA_REGISTRYINDEX, _ref);
+        }
+    }
+
+    Environment::Environment(Environment &&other) noexcept : L(std::exchange(other.L, nullptr)), _ref(other._ref)
+    {
+    }
+
+    Environment &Environment::operator=(Environment &&other) noexcept
+    {
+        if (this != &other)
+        {
+            if (L != nullptr)
+            {
+                luaL_unref(L, LUA_REGISTRYINDEX, _ref);
+            }
+            L = std::exchange(other.L, nullptr);
+            _ref = other._ref;
+        }
+        return *this;
+    }
+
+    bool Environment::LoadTemplate(lua_State *L, const char *script, const char *chunkName)
+    {
+        if (luaL_loadbufferx(L, script, strlen(script), chunkName, nullptr) != LUA_OK)
+        {
+            return false;
+        }
+        // only chunks that ran successfully become templates, the error message stays on the stack otherwise
+        lua_pushvalue(L, -1);
+        if (lua_pcall(L, 0, 0, 0) != LUA_OK)
+        {
+            lua_remove(L, -2);
+            return false;
+        }
+        Internal::PushTemplateChunks(L);
+        lua_insert(L, -2);
+        lua_rawseti(L, -2, static_cast<lua_Integer>(lua_rawlen(L, -2)) + 1);
+        lua_pop(L, 1);
+        return true;
+    }
+
+    void Environment::Activate() const
+    {
+        Push();
+        Internal::SetTemplateChunksEnv(L);
+    }
+
+    void Environment::Deactivate(lua_State *L)
+    {
+        lua_pushglobaltable(L);
+        Internal::SetTemplateChunksEnv(L);
+    }
+
+    int Environment::SaveActive(lua_State *L)
+    {
+        const int top = lua_gettop(L);
+        // all template chunks share the same `_ENV`, the first one tells which environment is active
+        if (lua_rawgetp(L, LUA_REGISTRYINDEX, &Internal::TemplateChunksKey) == LUA_TTABLE &&
+            lua_rawgeti(L, -1, 1) == LUA_TFUNCTION)
+        {
+            lua_getupvalue(L, -1, 1);
+        } else
+        {
+            lua_pushglobaltable(L);
+        }
+        const int ref = luaL_ref(L, LUA_REGISTRYINDEX);
+        lua_settop(L, top);
+        return ref;
+    }
+
+    void Environment::RestoreActive(lua_State *L, int ref)
+    {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, ref);
+        luaL_unref(L, LUA_REGISTRYINDEX, ref);
+        Internal::SetTemplateChunksEnv(L);
+    }
+
+    bool Environment::Run(const char *script, const char *chunkName) const
+    {
+        if (luaL_loadbufferx(L, script, strlen(script), chunkName, nullptr) != LUA_OK)
+        {
+            return false;
+        }
+        Push();
+        lua_setupvalue(L, -2, 1);
+        return lua_pcall(L, 0, 0, 0) == LUA_OK;
+    }
+
+    void Environment::Reset() const
+    {
+        Push();
+        // assigning nil to existing fields during traversal is allowed
+        lua_pushnil(L);
+        while (lua_next(L, -2) != 0)
+        {
+            lua_pop(L, 1);
+            lua_pushvalue(L, -1);
+            lua_pushnil(L);
+            lua_rawset(L, -4);
+        }
+        lua_pushvalue(L, -1);
+        lua_setfield(L, -2, "_G");
+        lua_pop(L, 1);
+    }
+
+    void Environment::Push() const
+    {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, _ref);
+    }
+}
@@ -3,3 +3,48 @@
 // The author doesn't take any responsibility for any damages done.
 
 #include <luavar/luavar.h>
+
+namespace LuaVar::Internal
+{
+    bool CheckFunction(lua_State *L, const char *funcName, int nargs, std::string &error)
+    {
+        const int type = lua_type(L, -1);
+        if (type != LUA_TFUNCTION)
+        {
+            error = std::string(funcName) + (type == LUA_TNIL ? " is not defined" : " is not a function");
+            return false;
+        }
+        if (nargs >= 0 && !lua_iscfunction(L, -1))
+        {
+            lua_Debug ar;
+            lua_pushvalue(L, -1);
+            lua_getinfo(L, ">u", &ar);
+            if (!ar.isvararg && ar.nparams != nargs)
+            {
+                error = std::string(funcName) + " takes " + std::to_string(ar.nparams) + " parameters, declared with " +
+                        std::to_string(nargs);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool ValidateFunction(lua_State *L, const char *funcName, int nargs, std::string &error)
+    {
+        InvalidateFunction(L, funcName);
+        lua_getglobal(L, funcName);
+        if (!CheckFunction(L, funcName, nargs, error))
+        {
+            lua_pop(L, 1);
+            return false;
+        }
+        lua_rawsetp(L, LUA_REGISTRYINDEX, funcName);
+        return true;
+    }
+
+    void InvalidateFunction(lua_State *L, const char *funcName)
+    {
+        lua_pushnil(L);
+        lua_rawsetp(L, LUA_REGISTRYINDEX, funcName);
+    }
+}
@@ -0,0 +1,183 @@
+// Copyright (c) Mateusz Raczynski 2025.
+// The software is provided AS IS, with no guarantees for it to work correctly.
+// The author doesn't take any responsibility for any damages done.
+
+#include <luavar/parallel.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+
+namespace LuaVar
+{
+    namespace Internal
+    {
+        // chunks of automatic size take at least this long, so taking a chunk is negligible compared to processing it
+        static constexpr std::chrono::nanoseconds TargetChunkTime = std::chrono::microseconds(50);
+        // with automatic chunk size a worker takes this share of the remaining elements
+        static constexpr size_t ChunksPerWorker = 4;
+        static constexpr size_t MaxMinChunk = 1 << 16;
+
+        struct ParallelPool::Job
+        {
+            size_t count;
+            const Task *task;
+            std::atomic<size_t> next{0};
+            std::atomic<bool> failed{false};
+            std::atomic<int64_t> busyNanoseconds{0};
+            std::string error;
+        };
+
+        ParallelPool::ParallelPool(const char *script, const ParallelOptions &options, const Prepare &prepare) :
+            _chunkSize(options.chunkSize)
+        {
+            const unsigned threads = options.threads != 0
+                                         ? options.threads
+                                         : std::max(1u, std::thread::hardware_concurrency());
+            _states.reserve(threads);
+            for (unsigned i = 0; i < threads && _valid; ++i)
+            {
+                auto &state = _states.emplace_back(std::make_unique<LuaState>(options.state));
+                lua_State *L = state->Get();
+                if (options.setup)
+                {
+                    options.setup(L);
+                }
+                if (luaL_loadbufferx(L, script, strlen(script), "=parallel", nullptr) != LUA_OK ||
+                    lua_pcall(L, 0, 0, 0) != LUA_OK)
+                {
+                    const char *message = lua_tostring(L, -1);
+                    _error = message != nullptr ? message : "error object is not a string";
+                    lua_settop(L, 0);
+                    _valid = false;
+                } else if (!prepare(L, _error))
+                {
+                    _valid = false;
+                }
+            }
+            if (!_valid)
+            {
+                _states.clear();
+                return;
+            }
+            _workers.reserve(threads);
+            for (unsigned i = 0; i < threads; ++i)
+            {
+                _workers.emplace_back(&ParallelPool::Work, this, i);
+            }
+        }
+
+        ParallelPool::~ParallelPool()
+        {
+            {
+                std::lock_guard lock(_mutex);
+                _stopping = true;
+            }
+            _wake.notify_all();
+            for (auto &worker: _workers)
+            {
+                worker.join();
+            }
+        }
+
+        bool ParallelPool::Run(size_t count, const Task &task, std::string &error)
+        {
+            if (count == 0)
+            {
+                return true;
+            }
+            Job job{count, &task, {}, {}, {}, {}};
+            {
+                std::unique_lock lock(_mutex);
+                _job = &job;
+                _active = _workers.size();
+                ++_generation;
+                _wake.notify_all();
+                _done.wait(lock, [this] { return _active == 0; });
+                _job = nullptr;
+            }
+            if (job.failed)
+            {
+                error = std::move(job.error);
+                return false;
+            }
+            if (_chunkSize == 0)
+            {
+                const int64_t perElement = std::max<int64_t>(1, job.busyNanoseconds / static_cast<int64_t>(count));
+                _minChunk = std::clamp<size_t>(static_cast<size_t>(TargetChunkTime.count() / perElement), 1,
+                                               MaxMinChunk);
+            }
+            return true;
+        }
+
+        bool ParallelPool::Grab(Job &job, size_t &begin, size_t &end) const
+        {
+            size_t next = job.next.load(std::memory_order_relaxed);
+            while (next < job.count && !job.failed.load(std::memory_order_relaxed))
+            {
+                const size_t remaining = job.count - next;
+                size_t size = _chunkSize != 0
+                                  ? _chunkSize
+                                  : std::max(_minChunk, remaining / (_workers.size() * ChunksPerWorker));
+                size = std::min(size, remaining);
+                if (job.next.compare_exchange_weak(next, next + size, std::memory_order_relaxed))
+                {
+                    begin = next;
+                    end = next + size;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void ParallelPool::Work(size_t index)
+        {
+            lua_State *L = _states[index]->Get();
+            size_t generation = 0;
+            while (true)
+            {
+                Job *job;
+                {
+                    std::unique_lock lock(_mutex);
+                    _wake.wait(lock, [this, generation] { return _stopping || _generation != generation; });
+                    if (_stopping)
+                    {
+                        return;
+                    }
+                    generation = _generation;
+                    job = _job;
+                }
+
+                size_t begin;
+                size_t end;
+                std::string error;
+                int64_t busy = 0;
+                while (Grab(*job, begin, end))
+                {
+                    const auto start = std::chrono::steady_clock::now();
+                    const bool success = (*job->task)(L, begin, end, error);
+                    busy += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - start).count();
+                    if (!success)
+                    {
+                        std::lock_guard lock(_mutex);
+                        if (!job->failed.exchange(true))
+                        {
+                            job->error = std::move(error);
+                        }
+                        break;
+                    }
+                }
+                job->busyNanoseconds += busy;
+
+                std::lock_guard lock(_mutex);
+                if (--_active == 0)
+                {
+                    _done.notify_one();
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,161 @@
+// Copyright (c) Mateusz Raczynski 2025.
+// The software is provided AS IS, with no guarantees for it to work correctly.
+// The author doesn't take any responsibility for any damages done.
+
+#include <luavar/property.h>
+
+#include <cstring>
+#include <new>
+#include <utility>
+
+namespace LuaVar
+{
+    namespace Internal
+    {
+        struct PropertySlot
+        {
+            const char *name;
+            size_t length;
+            PropertyAccessor accessor;
+        };
+
+        // the only upvalue of both metamethods, followed by `count` slots
+        // names point to lua strings anchored by the uservalue of the userdata
+        struct PropertySlots
+        {
+            size_t count;
+
+            PropertySlot *Slots()
+            {
+                return reinterpret_cast<PropertySlot *>(this + 1);
+            }
+        };
+
+        // accessor of property named by the key at given index, nullptr if there is none
+        // short lua strings are interned, so keys coming from scripts usually match property names by address;
+        // long strings (the limit depends on how lua was built) are compared by content
+        static const PropertyAccessor *FindProperty(lua_State *L, int key)
+        {
+            if (lua_type(L, key) != LUA_TSTRING)
+            {
+                return nullptr;
+            }
+            size_t length;
+            const char *name = lua_tolstring(L, key, &length);
+            auto *properties = static_cast<PropertySlots *>(lua_touserdata(L, lua_upvalueindex(1)));
+            const PropertySlot *slots = properties->Slots();
+            for (size_t i = 0; i < properties->count; ++i)
+            {
+                if (slots[i].name == name)
+                {
+                    return &slots[i].accessor;
+                }
+            }
+            for (size_t i = 0; i < properties->count; ++i)
+            {
+                const PropertySlot &slot = slots[i];
+                if (slot.length == length && std::memcmp(slot.name, name, length) == 0)
+                {
+                    return &slot.accessor;
+                }
+            }
+            return nullptr;
+        }
+
+        static int PropertyIndex(lua_State *L)
+        {
+            const PropertyAccessor *accessor = FindProperty(L, 2);
+            if (accessor == nullptr)
+            {
+                lua_pushnil(L);
+                return 1;
+            }
+            accessor->get(L, accessor->variable);
+            return 1;
+        }
+
+        static int PropertyNewIndex(lua_State *L)
+        {
+            const PropertyAccessor *accessor = FindProperty(L, 2);
+            if (accessor == nullptr)
+            {
+                lua_settop(L, 3);
+                lua_rawset(L, 1);
+                return 0;
+            }
+            if (accessor->set == nullptr)
+            {
+                return luaL_error(L, "property '%s' is read-only", lua_tostring(L, 2));
+            }
+            lua_settop(L, 3);
+            if (!accessor->set(L, accessor->variable))
+            {
+                return luaL_error(L, "invalid value for property '%s'", lua_tostring(L, 2));
+            }
+            return 0;
+        }
+    }
+
+    PropertyTable::PropertyTable(std::string name, std::initializer_list<Property> properties) : _name(std::move(name)),
+        _properties(properties)
+    {
+    }
+
+    PropertyTable &PropertyTable::Add(Property property)
+    {
+        _properties.push_back(std::move(property));
+        return *this;
+    }
+
+    void PropertyTable::Bind(lua_State *L) const
+    {
+        Push(L);
+        lua_setglobal(L, _name.c_str());
+    }
+
+    void PropertyTable::Push(lua_State *L) const
+    {
+        lua_createtable(L, 0, 0);
+        lua_createtable(L, 0, 3);
+
+        const size_t size = sizeof(Internal::PropertySlots) + sizeof(Internal::PropertySlot) * _properties.size();
+        auto *properties = static_cast<Internal::PropertySlots *>(lua_newuserdatauv(L, size, 1));
+        properties->count = _properties.size();
+        lua_createtable(L, static_cast<int>(_properties.size()), 0);
+        for (size_t i = 0; i < _properties.size(); ++i)
+        {
+            const std::string &name = _properties[i]._name;
+            const char *interned = lua_pushlstring(L, name.data(), name.size());
+            lua_rawseti(L, -2, static_cast<lua_Integer>(i + 1));
+            new(&properties->Slots()[i]) Internal::PropertySlot{interned, name.size(), _properties[i]._accessor};
+        }
+        lua_setiuservalue(L, -2, 1);
+
+        lua_pushvalue(L, -1);
+        lua_pushcclosure(L, Internal::PropertyIndex, 1);
+        lua_setfield(L, -3, "__index");
+        lua_pushcclosure(L, Internal::PropertyNewIndex, 1);
+        lua_setfield(L, -2, "__newindex");
+        // prevent scripts from replacing the metamethods
+        lua_pushboolean(L, false);
+        lua_setfield(L, -2, "__metatable");
+        lua_setmetatable(L, -2);
+    }
+
+    void PropertyTable::PushSnapshot(lua_State *L) const
+    {
+        lua_createtable(L, 0, static_cast<int>(_properties.size()));
+        UpdateSnapshot(L, -1);
+    }
+
+    void PropertyTable::UpdateSnapshot(lua_State *L, int index) const
+    {
+        index = lua_absindex(L, index);
+        for (const auto &property: _properties)
+        {
+            lua_pushlstring(L, property._name.data(), property._name.size());
+            property._accessor.get(L, property._accessor.variable);
+            lua_rawset(L, index);
+        }
+    }
+}
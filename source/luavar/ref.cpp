@@ -0,0 +1,157 @@
+// Copyright (c) Mateusz Raczynski 2025.
+// The software is provided AS IS, with no guarantees for it to work correctly.
+// The author doesn't take any responsibility for any damages done.
+
+#include <luavar/ref.h>
+
+#include <utility>
+
+namespace LuaVar
+{
+    Ref::Ref(lua_State *L, int index)
+    {
+        // coroutines may be collected while the handle lives, keep the main thread for operations without a state
+        lua_rawgeti(L, LUA_REGISTRYINDEX, LUA_RIDX_MAINTHREAD);
+        this->L = lua_tothread(L, -1);
+        lua_pop(L, 1);
+
+        lua_pushvalue(L, index);
+        _ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    }
+
+    Ref::~Ref()
+    {
+        Reset();
+    }
+
+    Ref::Ref(Ref &&other) noexcept : L(std::exchange(other.L, nullptr)), _ref(std::exchange(other._ref, LUA_NOREF))
+    {
+    }
+
+    Ref &Ref::operator=(Ref &&other) noexcept
+    {
+        if (this != &other)
+        {
+            Reset();
+            L = std::exchange(other.L, nullptr);
+            _ref = std::exchange(other._ref, LUA_NOREF);
+        }
+        return *this;
+    }
+
+    Ref Ref::Pop(lua_State *L)
+    {
+        Ref ref(L, -1);
+        lua_pop(L, 1);
+        return ref;
+    }
+
+    Ref Ref::Global(lua_State *L, const char *name)
+    {
+        lua_getglobal(L, name);
+        return Pop(L);
+    }
+
+    int Ref::Type() const
+    {
+        return Type(L);
+    }
+
+    int Ref::Type(lua_State *thread) const
+    {
+        if (!IsValid())
+        {
+            return LUA_TNIL;
+        }
+        Push(thread);
+        const int type = lua_type(thread, -1);
+        lua_pop(thread, 1);
+        return type;
+    }
+
+    void Ref::Push() const
+    {
+        Push(L);
+    }
+
+    void Ref::Push(lua_State *thread) const
+    {
+        // both LUA_NOREF and LUA_REFNIL are never used as registry keys, so they yield nil
+        lua_rawgeti(thread, LUA_REGISTRYINDEX, _ref);
+    }
+
+    void Ref::Reset()
+    {
+        if (L != nullptr)
+        {
+            luaL_unref(L, LUA_REGISTRYINDEX, _ref);
+        }
+        L = nullptr;
+        _ref = LUA_NOREF;
+    }
+
+    Table::Table(lua_State *L, int index)
+    {
+        if (lua_istable(L, index))
+        {
+            Ref::operator=(Ref(L, index));
+        }
+    }
+
+    Table Table::Pop(lua_State *L)
+    {
+        Table table(L, -1);
+        lua_pop(L, 1);
+        return table;
+    }
+
+    Table Table::Global(lua_State *L, const char *name)
+    {
+        lua_getglobal(L, name);
+        return Pop(L);
+    }
+
+    Table Table::Create(lua_State *L, int arraySize, int hashSize)
+    {
+        lua_createtable(L, arraySize, hashSize);
+        return Pop(L);
+    }
+
+    size_t Table::Length() const
+    {
+        return Length(L);
+    }
+
+    size_t Table::Length(lua_State *thread) const
+    {
+        if (!IsValid())
+        {
+            return 0;
+        }
+        Push(thread);
+        const size_t length = lua_rawlen(thread, -1);
+        lua_pop(thread, 1);
+        return length;
+    }
+
+    Function::Function(lua_State *L, int index)
+    {
+        if (lua_isfunction(L, index))
+        {
+            Ref::operator=(Ref(L, index));
+        }
+    }
+
+    Function Function::Pop(lua_State *L)
+    {
+        Function function(L, -1);
+        lua_pop(L, 1);
+        return function;
+    }
+
+    Function Function::Global(lua_State *L, const char *name)
+    {
+        lua_getglobal(L, name);
+        return Pop(L);
+    }
+}
@@ -0,0 +1,112 @@
+// Copyright (c) Mateusz Raczynski 2025.
+// The software is provided AS IS, with no guarantees for it to work correctly.
+// The author doesn't take any responsibility for any damages done.
+
+#include <luavar/reload.h>
+
+#include <cstring>
+#include <luavar/luavar.h>
+
+namespace LuaVar
+{
+    namespace Internal
+    {
+        // message of the error on top of the stack, scripts may raise errors with any value
+        static const char *ErrorMessage(lua_State *L)
+        {
+            const char *message = lua_tostring(L, -1);
+            return message != nullptr ? message : "error object is not a string";
+        }
+    }
+
+    HotReload::~HotReload()
+    {
+        for (const auto &function: _functions)
+        {
+            Internal::InvalidateFunction(L, function.name);
+        }
+        luaL_unref(L, LUA_REGISTRYINDEX, _active);
+        luaL_unref(L, LUA_REGISTRYINDEX, _pending);
+    }
+
+    std::vector<std::string> HotReload::Load(const char *script, const char *chunkName)
+    {
+        std::vector<std::string> errors;
+        if (luaL_loadbufferx(L, script, strlen(script), chunkName, nullptr) != LUA_OK)
+        {
+            errors.emplace_back(Internal::ErrorMessage(L));
+            lua_pop(L, 1);
+            return errors;
+        }
+
+        lua_createtable(L, 0, static_cast<int>(_functions.size()));
+        lua_createtable(L, 0, 1);
+        lua_pushglobaltable(L);
+        lua_setfield(L, -2, "__index");
+        lua_setmetatable(L, -2);
+        lua_pushvalue(L, -1);
+        // `_ENV` is always the first upvalue of the main chunk
+        lua_setupvalue(L, -3, 1);
+        lua_insert(L, -2);
+        if (lua_pcall(L, 0, 0, 0) != LUA_OK)
+        {
+            errors.emplace_back(Internal::ErrorMessage(L));
+            lua_pop(L, 2);
+            return errors;
+        }
+
+        for (const auto &function: _functions)
+        {
+            // raw access, functions missing in the new version must not be found among globals
+            lua_pushstring(L, function.name);
+            lua_rawget(L, -2);
+            std::string error;
+            if (!Internal::CheckFunction(L, function.name, function.nargs, error))
+            {
+                errors.push_back(std::move(error));
+            }
+            lua_pop(L, 1);
+        }
+        if (!errors.empty())
+        {
+            lua_pop(L, 1);
+            return errors;
+        }
+
+        luaL_unref(L, LUA_REGISTRYINDEX, _pending);
+        _pending = luaL_ref(L, LUA_REGISTRYINDEX);
+        Swap();
+        return errors;
+    }
+
+    bool HotReload::Swap()
+    {
+        if (_pending == LUA_NOREF || _requests > 0)
+        {
+            return false;
+        }
+        lua_rawgeti(L, LUA_REGISTRYINDEX, _pending);
+        for (const auto &function: _functions)
+        {
+            lua_pushstring(L, function.name);
+            lua_rawget(L, -2);
+            lua_rawsetp(L, LUA_REGISTRYINDEX, function.name);
+        }
+        lua_pop(L, 1);
+        luaL_unref(L, LUA_REGISTRYINDEX, _active);
+        _active = _pending;
+        _pending = LUA_NOREF;
+        ++_epoch;
+        return true;
+    }
+
+    void HotReload::PushEnvironment() const
+    {
+        if (_active == LUA_NOREF)
+        {
+            lua_pushnil(L);
+            return;
+        }
+        lua_rawgeti(L, LUA_REGISTRYINDEX, _active);
+    }
+}
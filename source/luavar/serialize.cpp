@@ -0,0 +1,662 @@
+// Copyright (c) Mateusz Raczynski 2025.
+// The software is provided AS IS, with no guarantees for it to work correctly.
+// The author doesn't take any responsibility for any damages done.
+
+#include <luavar/serialize.h>
+
+#include <algorithm>
+#include <bit>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+
+namespace LuaVar
+{
+    namespace Internal
+    {
+        // every value starts with a tag, small non-negative integers are stored in the tag itself
+        enum class SerialTag : std::uint8_t
+        {
+            Nil,
+            False,
+            True,
+            // zigzag encoded varint
+            Integer,
+            // 8 bytes of IEEE 754 double, little endian
+            Number,
+            // varint length and the bytes
+            String,
+            // as String, later occurrences are written as StringRef
+            SharedString,
+            // varint index of SharedString in order of appearance
+            StringRef,
+            // varint array count, varint hash count, the array values and the key value pairs
+            Table,
+            // varint index of Table in order of appearance
+            TableRef,
+            SmallInteger = 0x80
+        };
+
+        static constexpr size_t MaxVarintSize = 10;
+        static constexpr size_t MaxTableHeaderSize = 1 + 2 * MaxVarintSize;
+
+        static char *WriteVarint(char *out, std::uint64_t value)
+        {
+            while (value >= 0x80)
+            {
+                *out++ = static_cast<char>(value | 0x80);
+                value >>= 7;
+            }
+            *out++ = static_cast<char>(value);
+            return out;
+        }
+
+        // serialized data goes into the caller's buffer, which is flushed to the sink or grown when full
+        class SerialWriter
+        {
+        public:
+            SerialWriter(std::span<char> buffer, const SerializeSink &sink) :
+                _buffer(buffer.data()), _capacity(buffer.size()), _sink(sink ? &sink : nullptr)
+            {
+            }
+
+            explicit SerialWriter(std::string &output) :
+                _buffer(output.data()), _capacity(output.size()), _used(output.size()), _start(output.size()),
+                _output(&output)
+            {
+            }
+
+            // makes room for `size` bytes at Position()
+            bool Reserve(size_t size)
+            {
+                return _used + size <= _capacity || Grow(size);
+            }
+
+            char *Position() const
+            {
+                return _buffer + _used;
+            }
+
+            void Advance(const char *position)
+            {
+                _used = static_cast<size_t>(position - _buffer);
+            }
+
+            bool Write(const char *data, size_t size)
+            {
+                if (_output != nullptr)
+                {
+                    if (!Reserve(size))
+                    {
+                        return false;
+                    }
+                    memcpy(Position(), data, size);
+                    _used += size;
+                    return true;
+                }
+                // long strings are streamed through the buffer in pieces
+                while (true)
+                {
+                    const size_t part = std::min(size, _capacity - _used);
+                    memcpy(Position(), data, part);
+                    _used += part;
+                    data += part;
+                    size -= part;
+                    if (size == 0)
+                    {
+                        return true;
+                    }
+                    if (!Grow(1))
+                    {
+                        return false;
+                    }
+                }
+            }
+
+            bool Finish()
+            {
+                if (_output != nullptr)
+                {
+                    _output->resize(_used);
+                    return true;
+                }
+                return _sink == nullptr || Flush();
+            }
+
+            size_t Written() const
+            {
+                return _flushed + _used - _start;
+            }
+
+            SerializeStatus Status() const
+            {
+                return _status;
+            }
+
+        private:
+            bool Grow(size_t size)
+            {
+                if (_output != nullptr)
+                {
+                    _output->resize(std::max({_capacity * 2, _used + size, size_t{256}}));
+                    _buffer = _output->data();
+                    _capacity = _output->size();
+                    return true;
+                }
+                if (_sink == nullptr || size > _capacity)
+                {
+                    _status = SerializeStatus::BufferTooSmall;
+                    return false;
+                }
+                return Flush();
+            }
+
+            bool Flush()
+            {
+                if (_used != 0 && !(*_sink)(_buffer, _used))
+                {
+                    _status = SerializeStatus::SinkFailed;
+                    return false;
+                }
+                _flushed += _used;
+                _used = 0;
+                return true;
+            }
+
+            char *_buffer;
+            size_t _capacity;
+            size_t _used = 0;
+            size_t _start = 0;
+            size_t _flushed = 0;
+            const SerializeSink *_sink = nullptr;
+            std::string *_output = nullptr;
+            SerializeStatus _status = SerializeStatus::Ok;
+        };
+
+        // strings and tables already written are remembered in two scratch tables (value -> index),
+        // tables are registered before their contents, so cycles end in a TableRef
+        class Serializer
+        {
+        public:
+            Serializer(lua_State *L, SerialWriter &writer, const SerializeOptions &options) :
+                L(L), _writer(writer), _options(options)
+            {
+            }
+
+            SerializeStatus Run(int index)
+            {
+                index = lua_absindex(L, index);
+                const int base = lua_gettop(L);
+                if (!lua_checkstack(L, 8))
+                {
+                    return SerializeStatus::TooDeep;
+                }
+                lua_createtable(L, 0, 0);
+                _tables = base + 1;
+                lua_createtable(L, 0, 0);
+                _strings = base + 2;
+                const bool success = Value(index, 0) && _writer.Finish();
+                lua_settop(L, base);
+                if (!success)
+                {
+                    return _status != SerializeStatus::Ok ? _status : _writer.Status();
+                }
+                return SerializeStatus::Ok;
+            }
+
+        private:
+            bool Fail(SerializeStatus status)
+            {
+                _status = status;
+                return false;
+            }
+
+            bool Tag(SerialTag tag)
+            {
+                if (!_writer.Reserve(1))
+                {
+                    return false;
+                }
+                char *out = _writer.Position();
+                *out++ = static_cast<char>(tag);
+                _writer.Advance(out);
+                return true;
+            }
+
+            bool TagVarint(SerialTag tag, std::uint64_t value)
+            {
+                if (!_writer.Reserve(1 + MaxVarintSize))
+                {
+                    return false;
+                }
+                char *out = _writer.Position();
+                *out++ = static_cast<char>(tag);
+                _writer.Advance(WriteVarint(out, value));
+                return true;
+            }
+
+            bool Integer(lua_Integer value)
+            {
+                if (value >= 0 && value < 0x80)
+                {
+                    return Tag(static_cast<SerialTag>(static_cast<std::uint8_t>(SerialTag::SmallInteger) | value));
+                }
+                const auto bits = static_cast<std::uint64_t>(value);
+                return TagVarint(SerialTag::Integer, (bits << 1) ^ static_cast<std::uint64_t>(value >> 63));
+            }
+
+            bool Number(lua_Number value)
+            {
+                if (!_writer.Reserve(1 + sizeof(std::uint64_t)))
+                {
+                    return false;
+                }
+                char *out = _writer.Position();
+                *out++ = static_cast<char>(SerialTag::Number);
+                auto bits = std::bit_cast<std::uint64_t>(static_cast<double>(value));
+                for (size_t i = 0; i < sizeof(bits); ++i, bits >>= 8)
+                {
+                    *out++ = static_cast<char>(bits);
+                }
+                _writer.Advance(out);
+                return true;
+            }
+
+            bool String(int index)
+            {
+                size_t length;
+                const char *data = lua_tolstring(L, index, &length);
+                SerialTag tag = SerialTag::String;
+                if (length >= _options.minDedupLength)
+                {
+                    lua_pushvalue(L, index);
+                    if (lua_rawget(L, _strings) == LUA_TNUMBER)
+                    {
+                        const auto id = static_cast<std::uint64_t>(lua_tointeger(L, -1));
+                        lua_pop(L, 1);
+                        return TagVarint(SerialTag::StringRef, id);
+                    }
+                    lua_pop(L, 1);
+                    lua_pushvalue(L, index);
+                    lua_pushinteger(L, _stringCount++);
+                    lua_rawset(L, _strings);
+                    tag = SerialTag::SharedString;
+                }
+                return TagVarint(tag, length) && _writer.Write(data, length);
+            }
+
+            bool IsArrayKey(int index, lua_Integer arrayCount) const
+            {
+                if (!lua_isinteger(L, index))
+                {
+                    return false;
+                }
+                const lua_Integer key = lua_tointeger(L, index);
+                return key >= 1 && key <= arrayCount;
+            }
+
+            bool Table(int index, size_t depth)
+            {
+                lua_pushvalue(L, index);
+                if (lua_rawget(L, _tables) == LUA_TNUMBER)
+                {
+                    const auto id = static_cast<std::uint64_t>(lua_tointeger(L, -1));
+                    lua_pop(L, 1);
+                    return TagVarint(SerialTag::TableRef, id);
+                }
+                lua_pop(L, 1);
+                if (depth >= _options.maxDepth || !lua_checkstack(L, 4))
+                {
+                    return Fail(SerializeStatus::TooDeep);
+                }
+                lua_pushvalue(L, index);
+                lua_pushinteger(L, _tableCount++);
+                lua_rawset(L, _tables);
+
+                // the array part is the sequence up to the border, holes in it are written as nils
+                const auto arrayCount = static_cast<lua_Integer>(lua_rawlen(L, index));
+                std::uint64_t hashCount = 0;
+                lua_pushnil(L);
+                while (lua_next(L, index) != 0)
+                {
+                    hashCount += !IsArrayKey(-2, arrayCount);
+                    lua_pop(L, 1);
+                }
+                if (!_writer.Reserve(MaxTableHeaderSize))
+                {
+                    return false;
+                }
+                char *out = _writer.Position();
+                *out++ = static_cast<char>(SerialTag::Table);
+                out = WriteVarint(out, static_cast<std::uint64_t>(arrayCount));
+                _writer.Advance(WriteVarint(out, hashCount));
+
+                for (lua_Integer i = 1; i <= arrayCount; ++i)
+                {
+                    lua_rawgeti(L, index, i);
+                    if (!Value(lua_gettop(L), depth + 1))
+                    {
+                        return false;
+                    }
+                    lua_pop(L, 1);
+                }
+                lua_pushnil(L);
+                while (lua_next(L, index) != 0)
+                {
+                    const int value = lua_gettop(L);
+                    if (!IsArrayKey(value - 1, arrayCount) &&
+                        (!Value(value - 1, depth + 1) || !Value(value, depth + 1)))
+                    {
+                        return false;
+                    }
+                    lua_pop(L, 1);
+                }
+                return true;
+            }
+
+            bool Value(int index, size_t depth)
+            {
+                switch (lua_type(L, index))
+                {
+                    case LUA_TNIL:
+                        return Tag(SerialTag::Nil);
+                    case LUA_TBOOLEAN:
+                        return Tag(lua_toboolean(L, index) ? SerialTag::True : SerialTag::False);
+                    case LUA_TNUMBER:
+                        return lua_isinteger(L, index)
+                                   ? Integer(lua_tointeger(L, index))
+                                   : Number(lua_tonumber(L, index));
+                    case LUA_TSTRING:
+                        return String(index);
+                    case LUA_TTABLE:
+                        return Table(index, depth);
+                    default:
+                        return Fail(SerializeStatus::UnsupportedValue);
+                }
+            }
+
+            lua_State *L;
+            SerialWriter &_writer;
+            const SerializeOptions &_options;
+            SerializeStatus _status = SerializeStatus::Ok;
+            int _tables = 0;
+            int _strings = 0;
+            lua_Integer _tableCount = 0;
+            lua_Integer _stringCount = 0;
+        };
+
+        // strings and tables that can be referenced are kept in two scratch sequences,
+        // every read is bounds checked so malformed data never reads past the end or raises lua errors
+        class Deserializer
+        {
+        public:
+            Deserializer(lua_State *L, std::string_view data, const SerializeOptions &options) :
+                L(L), _begin(data.data()), _position(data.data()), _end(data.data() + data.size()),
+                _options(options)
+            {
+            }
+
+            SerializeStatus Run(size_t *consumed)
+            {
+                const int base = lua_gettop(L);
+                if (!lua_checkstack(L, 8))
+                {
+                    return SerializeStatus::TooDeep;
+                }
+                lua_createtable(L, 0, 0);
+                _tables = base + 1;
+                lua_createtable(L, 0, 0);
+                _strings = base + 2;
+                if (!Value(0))
+                {
+                    lua_settop(L, base);
+                    return _status;
+                }
+                lua_replace(L, base + 1);
+                lua_settop(L, base + 1);
+                if (consumed != nullptr)
+                {
+                    *consumed = static_cast<size_t>(_position - _begin);
+                }
+                return SerializeStatus::Ok;
+            }
+
+        private:
+            bool Fail(SerializeStatus status)
+            {
+                _status = status;
+                return false;
+            }
+
+            size_t Remaining() const
+            {
+                return static_cast<size_t>(_end - _position);
+            }
+
+            bool Varint(std::uint64_t &value)
+            {
+                value = 0;
+                for (int shift = 0; shift < 64; shift += 7)
+                {
+                    if (_position == _end)
+                    {
+                        return Fail(SerializeStatus::Malformed);
+                    }
+                    const auto byte = static_cast<unsigned char>(*_position++);
+                    value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+                    if ((byte & 0x80) == 0)
+                    {
+                        return true;
+                    }
+                }
+                return Fail(SerializeStatus::Malformed);
+            }
+
+            bool String(bool shared)
+            {
+                std::uint64_t length;
+                if (!Varint(length))
+                {
+                    return false;
+                }
+                if (length > Remaining())
+                {
+                    return Fail(SerializeStatus::Malformed);
+                }
+                lua_pushlstring(L, _position, length);
+                _position += length;
+                if (shared)
+                {
+                    lua_pushvalue(L, -1);
+                    lua_rawseti(L, _strings, ++_stringCount);
+                }
+                return true;
+            }
+
+            bool Reference(int scratch, lua_Integer count)
+            {
+                std::uint64_t id;
+                if (!Varint(id))
+                {
+                    return false;
+                }
+                if (id >= static_cast<std::uint64_t>(count))
+                {
+                    return Fail(SerializeStatus::Malformed);
+                }
+                lua_rawgeti(L, scratch, static_cast<lua_Integer>(id) + 1);
+                return true;
+            }
+
+            bool Number()
+            {
+                if (Remaining() < sizeof(std::uint64_t))
+                {
+                    return Fail(SerializeStatus::Malformed);
+                }
+                std::uint64_t bits = 0;
+                for (size_t i = 0; i < sizeof(bits); ++i)
+                {
+                    bits |= static_cast<std::uint64_t>(static_cast<unsigned char>(*_position++)) << (8 * i);
+                }
+                lua_pushnumber(L, static_cast<lua_Number>(std::bit_cast<double>(bits)));
+                return true;
+            }
+
+            // rawset raises errors for nil and NaN keys
+            bool IsValidKey(int index) const
+            {
+                switch (lua_type(L, index))
+                {
+                    case LUA_TNIL:
+                        return false;
+                    case LUA_TNUMBER:
+                    {
+                        const lua_Number number = lua_tonumber(L, index);
+                        return lua_isinteger(L, index) || number == number;
+                    }
+                    default:
+                        return true;
+                }
+            }
+
+            bool Table(size_t depth)
+            {
+                std::uint64_t arrayCount;
+                std::uint64_t hashCount;
+                if (!Varint(arrayCount) || !Varint(hashCount))
+                {
+                    return false;
+                }
+                // every value takes at least a byte, so the counts can't promise more than the remaining data
+                if (arrayCount > Remaining() || hashCount > Remaining() / 2)
+                {
+                    return Fail(SerializeStatus::Malformed);
+                }
+                if (depth >= _options.maxDepth || !lua_checkstack(L, 4))
+                {
+                    return Fail(SerializeStatus::TooDeep);
+                }
+                lua_createtable(L, static_cast<int>(std::min<std::uint64_t>(arrayCount, INT_MAX)),
+                                static_cast<int>(std::min<std::uint64_t>(hashCount, INT_MAX)));
+                const int table = lua_gettop(L);
+                lua_pushvalue(L, table);
+                lua_rawseti(L, _tables, ++_tableCount);
+                for (std::uint64_t i = 1; i <= arrayCount; ++i)
+                {
+                    if (!Value(depth + 1))
+                    {
+                        return false;
+                    }
+                    lua_rawseti(L, table, static_cast<lua_Integer>(i));
+                }
+                for (std::uint64_t i = 0; i < hashCount; ++i)
+                {
+                    if (!Value(depth + 1))
+                    {
+                        return false;
+                    }
+                    if (!IsValidKey(-1))
+                    {
+                        return Fail(SerializeStatus::Malformed);
+                    }
+                    if (!Value(depth + 1))
+                    {
+                        return false;
+                    }
+                    lua_rawset(L, table);
+                }
+                return true;
+            }
+
+            bool Value(size_t depth)
+            {
+                if (_position == _end)
+                {
+                    return Fail(SerializeStatus::Malformed);
+                }
+                const auto tag = static_cast<std::uint8_t>(*_position++);
+                if ((tag & static_cast<std::uint8_t>(SerialTag::SmallInteger)) != 0)
+                {
+                    lua_pushinteger(L, tag & 0x7f);
+                    return true;
+                }
+                switch (static_cast<SerialTag>(tag))
+                {
+                    case SerialTag::Nil:
+                        lua_pushnil(L);
+                        return true;
+                    case SerialTag::False:
+                    case SerialTag::True:
+                        lua_pushboolean(L, static_cast<SerialTag>(tag) == SerialTag::True);
+                        return true;
+                    case SerialTag::Integer:
+                    {
+                        std::uint64_t bits;
+                        if (!Varint(bits))
+                        {
+                            return false;
+                        }
+                        lua_pushinteger(L, static_cast<lua_Integer>((bits >> 1) ^ (~(bits & 1) + 1)));
+                        return true;
+                    }
+                    case SerialTag::Number:
+                        return Number();
+                    case SerialTag::String:
+                        return String(false);
+                    case SerialTag::SharedString:
+                        return String(true);
+                    case SerialTag::StringRef:
+                        return Reference(_strings, _stringCount);
+                    case SerialTag::Table:
+                        return Table(depth);
+                    case SerialTag::TableRef:
+                        return Reference(_tables, _tableCount);
+                    default:
+                        return Fail(SerializeStatus::Malformed);
+                }
+            }
+
+            lua_State *L;
+            const char *_begin;
+            const char *_position;
+            const char *_end;
+            const SerializeOptions &_options;
+            SerializeStatus _status = SerializeStatus::Ok;
+            int _tables = 0;
+            int _strings = 0;
+            lua_Integer _tableCount = 0;
+            lua_Integer _stringCount = 0;
+        };
+    }
+
+    SerializeStatus Serialize(lua_State *L, int index, std::span<char> buffer, const SerializeSink &sink,
+                              size_t *written, const SerializeOptions &options)
+    {
+        Internal::SerialWriter writer(buffer, sink);
+        const SerializeStatus status = Internal::Serializer(L, writer, options).Run(index);
+        if (written != nullptr)
+        {
+            *written = writer.Written();
+        }
+        return status;
+    }
+
+    SerializeStatus Serialize(lua_State *L, int index, std::string &output, const SerializeOptions &options)
+    {
+        const size_t size = output.size();
+        Internal::SerialWriter writer(output);
+        const SerializeStatus status = Internal::Serializer(L, writer, options).Run(index);
+        if (status != SerializeStatus::Ok)
+        {
+            output.resize(size);
+        }
+        return status;
+    }
+
+    SerializeStatus Deserialize(lua_State *L, std::string_view data, size_t *consumed,
+                                const SerializeOptions &options)
+    {
+        return Internal::Deserializer(L, data, options).Run(consumed);
+    }
+}
@@ -0,0 +1,567 @@
+// Copyright (c) Mateusz Raczynski 2025.
+// The software is provided AS IS, with no guarantees for it to work correctly.
+// The author doesn't take any responsibility for any damages done.
+
+#include <luavar/shared_table.h>
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace LuaVar
+{
+    namespace Internal
+    {
+        static const char *SharedTableMetaName = "LuaVar::SharedTable";
+        // address used as registry key of the per-state cache of root userdata
+        static const char SharedTableCacheKey = 0;
+
+        // userdata of tables pushed from C++, owns the table
+        // nested tables are pushed as bare `const SharedTable *` userdata that reference their parent userdata
+        // through a user value instead, so they don't need a finalizer
+        // all metamethods get metatable of the nested tables as the upvalue
+        struct SharedTableRoot
+        {
+            const SharedTable *table;
+            std::shared_ptr<const SharedTable> owner;
+        };
+
+        // user values of both root and nested userdata
+        // children - table caching userdata of nested tables of the root, shared by the whole hierarchy
+        // parent - only for nested tables, keeps the root alive
+        static constexpr int ChildrenUserValue = 1;
+        static constexpr int ParentUserValue = 2;
+
+        struct SharedTableAccess
+        {
+            static const SharedTable &Get(lua_State *L, int index)
+            {
+                return **static_cast<const SharedTable *const *>(lua_touserdata(L, index));
+            }
+
+            static const SharedTable::Value *Find(const SharedTable &table, lua_State *L, int index)
+            {
+                switch (lua_type(L, index))
+                {
+                    case LUA_TSTRING:
+                    {
+                        size_t len = 0;
+                        const char *str = lua_tolstring(L, index, &len);
+                        return table.Find(std::string_view(str, len));
+                    }
+                    case LUA_TNUMBER:
+                    {
+                        int isInteger = 0;
+                        lua_Integer key = lua_tointegerx(L, index, &isInteger);
+                        return isInteger ? table.Find(key) : nullptr;
+                    }
+                    default:
+                        return nullptr;
+                }
+            }
+
+            // pushes key and value at given position of the iteration order (array part first, then hash part)
+            // returns false if there are no more entries
+            static bool PushEntry(lua_State *L, int parent, const SharedTable &table, size_t position)
+            {
+                if (position < table._array.size())
+                {
+                    lua_pushinteger(L, static_cast<lua_Integer>(position + 1));
+                    PushValue(L, parent, table._array[position]);
+                    return true;
+                }
+                for (size_t i = position - table._array.size(); i < table._slots.size(); ++i)
+                {
+                    const auto &slot = table._slots[i];
+                    if (slot.keyType == SharedTable::KeyType::Integer)
+                    {
+                        lua_pushinteger(L, slot.integerKey);
+                    } else if (slot.keyType == SharedTable::KeyType::String)
+                    {
+                        lua_pushlstring(L, slot.stringKey.data(), slot.stringKey.size());
+                    } else
+                    {
+                        continue;
+                    }
+                    PushValue(L, parent, slot.value);
+                    return true;
+                }
+                return false;
+            }
+
+            // finds position following the given key in the iteration order
+            static bool NextPosition(lua_State *L, const SharedTable &table, int index, size_t &position)
+            {
+                if (lua_isnil(L, index))
+                {
+                    position = 0;
+                    return true;
+                }
+                int isInteger = 0;
+                lua_Integer integerKey = lua_tointegerx(L, index, &isInteger);
+                if (isInteger && lua_type(L, index) == LUA_TNUMBER && integerKey >= 1 &&
+                    static_cast<size_t>(integerKey) <= table._array.size())
+                {
+                    position = static_cast<size_t>(integerKey);
+                    return true;
+                }
+
+                const SharedTable::Slot *slot = nullptr;
+                if (lua_type(L, index) == LUA_TSTRING)
+                {
+                    size_t len = 0;
+                    const char *str = lua_tolstring(L, index, &len);
+                    std::string_view key(str, len);
+                    slot = table.FindSlot(SharedTable::Hash(key), SharedTable::KeyType::String, 0, key);
+                } else if (isInteger)
+                {
+                    slot = table.FindSlot(SharedTable::Hash(integerKey), SharedTable::KeyType::Integer, integerKey, {});
+                }
+                if (slot == nullptr)
+                {
+                    return false;
+                }
+                position = table._array.size() + static_cast<size_t>(slot - table._slots.data()) + 1;
+                return true;
+            }
+
+            // only callable from metamethods, relies on their upvalues
+            static void PushValue(lua_State *L, int parent, const SharedTable::Value &value)
+            {
+                switch (value.type)
+                {
+                    case SharedTable::Type::Boolean:
+                        lua_pushboolean(L, value.boolean);
+                        break;
+                    case SharedTable::Type::Integer:
+                        lua_pushinteger(L, value.integer);
+                        break;
+                    case SharedTable::Type::Number:
+                        lua_pushnumber(L, value.number);
+                        break;
+                    case SharedTable::Type::String:
+                        lua_pushlstring(L, value.string.data(), value.string.size());
+                        break;
+                    case SharedTable::Type::Table:
+                        PushNested(L, parent, value.table);
+                        break;
+                    default:
+                        lua_pushnil(L);
+                        break;
+                }
+            }
+
+            static void PushNested(lua_State *L, int parent, const SharedTable *table)
+            {
+                lua_getiuservalue(L, parent, ChildrenUserValue);
+                if (lua_rawgetp(L, -1, table) == LUA_TUSERDATA)
+                {
+                    lua_remove(L, -2);
+                    return;
+                }
+                lua_pop(L, 1);
+
+                auto **ud = static_cast<const SharedTable **>(lua_newuserdatauv(L, sizeof(const SharedTable *), 2));
+                *ud = table;
+                lua_pushvalue(L, lua_upvalueindex(1));
+                lua_setmetatable(L, -2);
+                lua_pushvalue(L, -2);
+                lua_setiuservalue(L, -2, ChildrenUserValue);
+                // nested table is owned by the root, keep the parent userdata alive
+                lua_pushvalue(L, parent);
+                lua_setiuservalue(L, -2, ParentUserValue);
+
+                lua_pushvalue(L, -1);
+                lua_rawsetp(L, -3, table);
+                lua_remove(L, -2);
+            }
+
+            static void PushRoot(lua_State *L, const std::shared_ptr<const SharedTable> &table)
+            {
+                if (luaL_newmetatable(L, SharedTableMetaName))
+                {
+                    // Ensure metatables are created only once
+                    const luaL_Reg methods[] = {
+                        {"__index", Index},
+                        {"__newindex", NewIndex},
+                        {"__len", Len},
+                        {"__pairs", Pairs},
+                        {nullptr, nullptr}
+                    };
+                    lua_createtable(L, 0, 5); // nested metatable
+                    // stack: root metatable, nested metatable
+                    for (int metatable: {-2, -1})
+                    {
+                        lua_pushvalue(L, metatable);
+                        lua_pushvalue(L, -2);
+                        luaL_setfuncs(L, methods, 1);
+                        // prevent scripts from replacing the metatable
+                        lua_pushstring(L, SharedTableMetaName);
+                        lua_setfield(L, -2, "__metatable");
+                        lua_pop(L, 1);
+                    }
+                    lua_pop(L, 1);
+                    lua_pushcfunction(L, Clear);
+                    lua_setfield(L, -2, "__gc");
+
+                    // cache of pushed roots, weak so unused userdata can be collected
+                    lua_createtable(L, 0, 0);
+                    lua_createtable(L, 0, 1);
+                    lua_pushstring(L, "v");
+                    lua_setfield(L, -2, "__mode");
+                    lua_setmetatable(L, -2);
+                    lua_rawsetp(L, LUA_REGISTRYINDEX, &SharedTableCacheKey);
+                }
+
+                lua_rawgetp(L, LUA_REGISTRYINDEX, &SharedTableCacheKey);
+                if (lua_rawgetp(L, -1, table.get()) == LUA_TUSERDATA)
+                {
+                    lua_replace(L, -3);
+                    lua_pop(L, 1);
+                    return;
+                }
+                lua_pop(L, 1);
+
+                void *memory = lua_newuserdatauv(L, sizeof(SharedTableRoot), 1);
+                new(memory) SharedTableRoot{table.get(), table};
+                lua_pushvalue(L, -3);
+                lua_setmetatable(L, -2);
+                lua_createtable(L, 0, 0);
+                lua_setiuservalue(L, -2, ChildrenUserValue);
+
+                lua_pushvalue(L, -1);
+                lua_rawsetp(L, -3, table.get());
+                lua_replace(L, -3);
+                lua_pop(L, 1);
+            }
+
+            static int Index(lua_State *L)
+            {
+                const SharedTable::Value *value = Find(Get(L, 1), L, 2);
+                if (value == nullptr)
+                {
+                    lua_pushnil(L);
+                } else
+                {
+                    PushValue(L, 1, *value);
+                }
+                return 1;
+            }
+
+            static int NewIndex(lua_State *L)
+            {
+                return luaL_error(L, "attempt to modify read-only SharedTable");
+            }
+
+            static int Len(lua_State *L)
+            {
+                lua_pushinteger(L, static_cast<lua_Integer>(Get(L, 1).ArraySize()));
+                return 1;
+            }
+
+            static int Next(lua_State *L)
+            {
+                luaL_checktype(L, 1, LUA_TUSERDATA);
+                bool valid = lua_getmetatable(L, 1) &&
+                             (lua_rawequal(L, -1, lua_upvalueindex(1)) ||
+                              (luaL_getmetatable(L, SharedTableMetaName) == LUA_TTABLE && lua_rawequal(L, -1, -2)));
+                lua_settop(L, 2);
+                luaL_argexpected(L, valid, 1, SharedTableMetaName);
+
+                const SharedTable &table = Get(L, 1);
+                size_t position = 0;
+                if (!NextPosition(L, table, 2, position))
+                {
+                    return luaL_error(L, "invalid key to 'next'");
+                }
+                if (!PushEntry(L, 1, table, position))
+                {
+                    lua_pushnil(L);
+                    return 1;
+                }
+                return 2;
+            }
+
+            static int Pairs(lua_State *L)
+            {
+                lua_pushvalue(L, lua_upvalueindex(1));
+                lua_pushcclosure(L, Next, 1);
+                lua_pushvalue(L, 1);
+                lua_pushnil(L);
+                return 3;
+            }
+
+            static int Clear(lua_State *L)
+            {
+                auto *root = static_cast<SharedTableRoot *>(lua_touserdata(L, 1));
+                root->~SharedTableRoot();
+                return 0;
+            }
+        };
+
+        struct SharedTableConversion
+        {
+            std::unordered_map<const void *, std::shared_ptr<const SharedTable> > converted;
+            std::unordered_set<const void *> inProgress;
+        };
+
+        template<typename K>
+        static bool AddLuaValue(lua_State *L, SharedTable::Builder &builder, const K &key, SharedTableConversion &conversion);
+
+        static std::shared_ptr<const SharedTable> ConvertLuaTable(lua_State *L, int index, SharedTableConversion &conversion)
+        {
+            index = lua_absindex(L, index);
+            const void *address = lua_topointer(L, index);
+            if (auto it = conversion.converted.find(address); it != conversion.converted.end())
+            {
+                return it->second;
+            }
+            if (!conversion.inProgress.insert(address).second || !lua_checkstack(L, 3))
+            {
+                // cycle detected or nesting too deep
+                return nullptr;
+            }
+
+            SharedTable::Builder builder;
+            lua_pushnil(L);
+            while (lua_next(L, index) != 0)
+            {
+                bool added = false;
+                if (lua_type(L, -2) == LUA_TSTRING)
+                {
+                    size_t len = 0;
+                    const char *str = lua_tolstring(L, -2, &len);
+                    added = AddLuaValue(L, builder, std::string_view(str, len), conversion);
+                } else if (lua_isinteger(L, -2))
+                {
+                    added = AddLuaValue(L, builder, lua_tointeger(L, -2), conversion);
+                }
+                lua_pop(L, 1);
+                if (!added)
+                {
+                    lua_pop(L, 1);
+                    return nullptr;
+                }
+            }
+
+            auto table = builder.Build();
+            conversion.inProgress.erase(address);
+            conversion.converted.emplace(address, table);
+            return table;
+        }
+
+        template<typename K>
+        static bool AddLuaValue(lua_State *L, SharedTable::Builder &builder, const K &key, SharedTableConversion &conversion)
+        {
+            switch (lua_type(L, -1))
+            {
+                case LUA_TBOOLEAN:
+                    builder.Set(key, static_cast<bool>(lua_toboolean(L, -1)));
+                    return true;
+                case LUA_TNUMBER:
+                    if (lua_isinteger(L, -1))
+                        builder.Set(key, lua_tointeger(L, -1));
+                    else
+                        builder.Set(key, lua_tonumber(L, -1));
+                    return true;
+                case LUA_TSTRING:
+                {
+                    size_t len = 0;
+                    const char *str = lua_tolstring(L, -1, &len);
+                    builder.Set(key, std::string_view(str, len));
+                    return true;
+                }
+                case LUA_TTABLE:
+                {
+                    auto nested = ConvertLuaTable(L, -1, conversion);
+                    if (!nested)
+                        return false;
+                    builder.Set(key, std::move(nested));
+                    return true;
+                }
+                default:
+                    return false;
+            }
+        }
+    }
+
+    std::uint64_t SharedTable::Hash(std::string_view key)
+    {
+        // FNV-1a
+        std::uint64_t hash = 0xcbf29ce484222325ull;
+        for (char c: key)
+        {
+            hash ^= static_cast<unsigned char>(c);
+            hash *= 0x100000001b3ull;
+        }
+        return hash;
+    }
+
+    std::uint64_t SharedTable::Hash(lua_Integer key)
+    {
+        std::uint64_t hash = static_cast<std::uint64_t>(key) * 0x9e3779b97f4a7c15ull;
+        return hash ^ (hash >> 32);
+    }
+
+    const SharedTable::Slot *SharedTable::FindSlot(std::uint64_t hash, KeyType keyType, lua_Integer integerKey,
+                                                   std::string_view stringKey) const
+    {
+        if (_slots.empty())
+        {
+            return nullptr;
+        }
+        const size_t mask = _slots.size() - 1;
+        for (size_t i = hash & mask;; i = (i + 1) & mask)
+        {
+            const Slot &slot = _slots[i];
+            if (slot.keyType == KeyType::Empty)
+            {
+                return nullptr;
+            }
+            if (slot.hash == hash && slot.keyType == keyType)
+            {
+                if (keyType == KeyType::Integer ? slot.integerKey == integerKey : slot.stringKey == stringKey)
+                {
+                    return &slot;
+                }
+            }
+        }
+    }
+
+    const SharedTable::Value *SharedTable::Find(std::string_view key) const
+    {
+        const Slot *slot = FindSlot(Hash(key), KeyType::String, 0, key);
+        return slot ? &slot->value : nullptr;
+    }
+
+    const SharedTable::Value *SharedTable::Find(lua_Integer key) const
+    {
+        if (key >= 1 && static_cast<size_t>(key) <= _array.size())
+        {
+            return &_array[static_cast<size_t>(key - 1)];
+        }
+        const Slot *slot = FindSlot(Hash(key), KeyType::Integer, key, {});
+        return slot ? &slot->value : nullptr;
+    }
+
+    std::shared_ptr<const SharedTable> SharedTable::Builder::Build() const
+    {
+        std::shared_ptr<SharedTable> table(new SharedTable());
+
+        // array part covers integer keys 1..n without holes
+        std::vector<lua_Integer> integerKeys;
+        for (const auto &entry: _entries)
+        {
+            if (entry.keyType == KeyType::Integer && entry.integerKey >= 1)
+                integerKeys.push_back(entry.integerKey);
+        }
+        std::sort(integerKeys.begin(), integerKeys.end());
+        integerKeys.erase(std::unique(integerKeys.begin(), integerKeys.end()), integerKeys.end());
+        size_t arraySize = 0;
+        while (arraySize < integerKeys.size() && integerKeys[arraySize] == static_cast<lua_Integer>(arraySize + 1))
+        {
+            ++arraySize;
+        }
+        table->_array.resize(arraySize);
+
+        size_t hashEntries = 0;
+        size_t stringBytes = 0;
+        for (const auto &entry: _entries)
+        {
+            if (entry.keyType == KeyType::String)
+                stringBytes += entry.stringKey.size();
+            if (entry.value.type == Type::String)
+                stringBytes += entry.stringValue.size();
+            if (entry.keyType == KeyType::String || entry.integerKey < 1 ||
+                static_cast<size_t>(entry.integerKey) > arraySize)
+                ++hashEntries;
+        }
+
+        if (hashEntries > 0)
+        {
+            // keep the load factor at or below 0.5 so probe sequences stay short
+            size_t capacity = 2;
+            while (capacity < hashEntries * 2)
+                capacity *= 2;
+            table->_slots.resize(capacity);
+        }
+
+        table->_strings = std::make_unique<char[]>(stringBytes + 1);
+        char *stringsEnd = table->_strings.get();
+        auto storeString = [&stringsEnd](const std::string &str)
+        {
+            std::memcpy(stringsEnd, str.data(), str.size());
+            std::string_view stored(stringsEnd, str.size());
+            stringsEnd += str.size();
+            return stored;
+        };
+
+        for (const auto &entry: _entries)
+        {
+            Value value = entry.value;
+            if (value.type == Type::String)
+            {
+                value.string = storeString(entry.stringValue);
+            } else if (value.type == Type::Table)
+            {
+                value.table = entry.table.get();
+                table->_children.push_back(entry.table);
+            }
+
+            if (entry.keyType == KeyType::Integer && entry.integerKey >= 1 &&
+                static_cast<size_t>(entry.integerKey) <= arraySize)
+            {
+                table->_array[static_cast<size_t>(entry.integerKey - 1)] = value;
+                continue;
+            }
+
+            const std::uint64_t hash = entry.keyType == KeyType::String ? Hash(entry.stringKey) : Hash(entry.integerKey);
+            const Slot *existing = table->FindSlot(hash, entry.keyType, entry.integerKey, entry.stringKey);
+            if (existing != nullptr)
+            {
+                // repeated key, last value wins
+                const_cast<Slot *>(existing)->value = value;
+                continue;
+            }
+
+            const size_t mask = table->_slots.size() - 1;
+            size_t i = hash & mask;
+            while (table->_slots[i].keyType != KeyType::Empty)
+                i = (i + 1) & mask;
+            Slot &slot = table->_slots[i];
+            slot.hash = hash;
+            slot.keyType = entry.keyType;
+            if (entry.keyType == KeyType::String)
+                slot.stringKey = storeString(entry.stringKey);
+            else
+                slot.integerKey = entry.integerKey;
+            slot.value = value;
+            ++table->_hashCount;
+        }
+
+        return table;
+    }
+
+    std::shared_ptr<const SharedTable> SharedTable::FromLua(lua_State *L, int index)
+    {
+        if (!lua_istable(L, index))
+        {
+            return nullptr;
+        }
+        Internal::SharedTableConversion conversion;
+        return Internal::ConvertLuaTable(L, index, conversion);
+    }
+
+    void SharedTable::Push(lua_State *L, const std::shared_ptr<const SharedTable> &table)
+    {
+        Internal::SharedTableAccess::PushRoot(L, table);
+    }
+
+    void SharedTable::Bind(lua_State *L, const char *name, const std::shared_ptr<const SharedTable> &table)
+    {
+        Push(L, table);
+        lua_setglobal(L, name);
+    }
+}
@@ -4,15 +4,541 @@
 
 #include <luavar/state.h>
 
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
 namespace LuaVar
 {
-    LuaState::LuaState()
+    namespace Internal
+    {
+        struct GcCounters
+        {
+            size_t collections = 0;
+            size_t explicitRuns = 0;
+            std::chrono::nanoseconds lastPause{0};
+            std::chrono::nanoseconds maxPause{0};
+            std::chrono::nanoseconds totalPause{0};
+            GcMode mode = GcMode::Incremental;
+            bool closing = false;
+        };
+
+        struct MemoryCounters
+        {
+            size_t used = 0;
+            size_t peak = 0;
+            size_t limit = 0;
+            size_t failed = 0;
+            // usage at which onThreshold is called next, SIZE_MAX when disabled or already crossed
+            size_t nextThreshold = SIZE_MAX;
+            size_t threshold = 0;
+            MemoryThresholdCallback onThreshold;
+        };
+
+        // same as the allocator of luaL_newstate, with accounting; blocks allocated before it was installed
+        // are compatible, since both use realloc/free
+        static void *CountingAlloc(void *ud, void *ptr, size_t osize, size_t nsize)
+        {
+            auto *memory = static_cast<MemoryCounters *>(ud);
+            // for new blocks osize holds type of the object instead of size
+            const size_t oldSize = ptr != nullptr ? osize : 0;
+            if (nsize == 0)
+            {
+                free(ptr);
+                memory->used -= oldSize;
+                if (memory->used < memory->threshold)
+                {
+                    memory->nextThreshold = memory->threshold;
+                }
+                return nullptr;
+            }
+            const size_t used = memory->used - oldSize + nsize;
+            if (nsize > oldSize && memory->limit != 0 && used > memory->limit)
+            {
+                // lua runs an emergency collection and retries before raising memory error
+                ++memory->failed;
+                return nullptr;
+            }
+            void *res = realloc(ptr, nsize);
+            if (res == nullptr)
+            {
+                return nullptr;
+            }
+            memory->used = used;
+            if (nsize > oldSize)
+            {
+                memory->peak = std::max(memory->peak, used);
+                if (used >= memory->nextThreshold)
+                {
+                    memory->nextThreshold = SIZE_MAX;
+                    memory->onThreshold(used);
+                }
+            } else if (used < memory->threshold)
+            {
+                memory->nextThreshold = memory->threshold;
+            }
+            return res;
+        }
+
+        struct BudgetCounters
+        {
+            ExecutionBudget defaults;
+            // budget of the running call
+            ExecutionBudget active;
+            uint64_t executed = 0;
+            std::chrono::steady_clock::time_point deadline;
+            // nesting of Run and PCall calls, only the outermost one sets up the budget
+            int depth = 0;
+            bool exceeded = false;
+            // coroutine.resume and the C function of closures made by coroutine.wrap, nullptr until the
+            // coroutine library is found
+            lua_CFunction resume = nullptr;
+            lua_CFunction wrapped = nullptr;
+            // calls are watched only when there are coroutine functions to recognize
+            int hookMask = LUA_MASKCOUNT;
+        };
+
+        // address used as registry key of BudgetCounters of the state
+        static const char BudgetKey = 0;
+
+        // looks up functions resuming coroutines, they are compared by identity so replacing them in the
+        // coroutine table doesn't matter once they were found
+        static void FindCoroutineFunctions(lua_State *L, BudgetCounters *budget)
+        {
+            const int top = lua_gettop(L);
+            lua_getfield(L, LUA_REGISTRYINDEX, LUA_LOADED_TABLE);
+            if (lua_getfield(L, -1, LUA_COLIBNAME) == LUA_TTABLE)
+            {
+                lua_getfield(L, -1, "resume");
+                budget->resume = lua_tocfunction(L, -1);
+                // all closures made by coroutine.wrap share the same C function, any function can be wrapped
+                if (lua_getfield(L, -2, "wrap") == LUA_TFUNCTION)
+                {
+                    lua_pushvalue(L, -2);
+                    if (lua_pcall(L, 1, 1, 0) == LUA_OK)
+                    {
+                        budget->wrapped = lua_tocfunction(L, -1);
+                    }
+                }
+            }
+            lua_settop(L, top);
+            budget->hookMask = budget->resume != nullptr || budget->wrapped != nullptr
+                                   ? LUA_MASKCOUNT | LUA_MASKCALL
+                                   : LUA_MASKCOUNT;
+        }
+
+        static void BudgetHook(lua_State *L, lua_Debug *ar);
+
+        // coroutines created before the hook was set don't have it, it is set when they are resumed:
+        // coroutine.resume gets the thread as its first argument, closures made by coroutine.wrap keep it
+        // as their first upvalue
+        static void LimitResumedThread(lua_State *L, lua_Debug *ar, const BudgetCounters *budget)
+        {
+            lua_getinfo(L, "f", ar);
+            const lua_CFunction function = lua_tocfunction(L, -1);
+            lua_State *thread = nullptr;
+            // lua functions have no C function, it must not match a coroutine function that wasn't found
+            if (function != nullptr && function == budget->resume && lua_getlocal(L, ar, 1) != nullptr)
+            {
+                thread = lua_tothread(L, -1);
+                lua_pop(L, 1);
+            } else if (function != nullptr && function == budget->wrapped && lua_getupvalue(L, -1, 1) != nullptr)
+            {
+                thread = lua_tothread(L, -1);
+                lua_pop(L, 1);
+            }
+            lua_pop(L, 1);
+            // threads that already have the hook keep their instruction count
+            if (thread != nullptr && thread != L && lua_gethook(thread) != BudgetHook)
+            {
+                const int interval = budget->exceeded ? 1 : budget->active.checkInterval;
+                lua_sethook(thread, BudgetHook, budget->hookMask, interval);
+            }
+        }
+
+        static void BudgetHook(lua_State *L, lua_Debug *ar)
+        {
+            lua_rawgetp(L, LUA_REGISTRYINDEX, &BudgetKey);
+            auto *budget = static_cast<BudgetCounters *>(lua_touserdata(L, -1));
+            lua_pop(L, 1);
+            if (budget->depth == 0)
+            {
+                // coroutine created during a limited call and resumed after it finished
+                lua_sethook(L, nullptr, 0, 0);
+                return;
+            }
+            if (ar->event == LUA_HOOKCALL)
+            {
+                LimitResumedThread(L, ar, budget);
+                return;
+            }
+            if (!budget->exceeded)
+            {
+                budget->executed += static_cast<uint64_t>(budget->active.checkInterval);
+                const bool outOfInstructions = budget->active.instructions != 0 &&
+                                               budget->executed >= budget->active.instructions;
+                const bool outOfTime = budget->active.wallTime.count() != 0 &&
+                                       std::chrono::steady_clock::now() >= budget->deadline;
+                if (!outOfInstructions && !outOfTime)
+                {
+                    return;
+                }
+                budget->exceeded = true;
+                // fail on the very next instruction, so pcall inside the script doesn't help; the main thread
+                // may be waiting for this coroutine and would otherwise run until its own next check
+                lua_sethook(L, BudgetHook, budget->hookMask, 1);
+                lua_rawgeti(L, LUA_REGISTRYINDEX, LUA_RIDX_MAINTHREAD);
+                lua_State *mainThread = lua_tothread(L, -1);
+                lua_pop(L, 1);
+                if (mainThread != L)
+                {
+                    lua_sethook(mainThread, BudgetHook, budget->hookMask, 1);
+                }
+            }
+            luaL_error(L, "execution budget exceeded");
+        }
+
+        struct LibraryInfo
+        {
+            LuaLibrary library;
+            const char *name;
+            lua_CFunction open;
+        };
+
+        // same order as luaL_openlibs
+        static const LibraryInfo Libraries[] = {
+            {LuaLibraryBase, LUA_GNAME, luaopen_base},
+            {LuaLibraryPackage, LUA_LOADLIBNAME, luaopen_package},
+            {LuaLibraryCoroutine, LUA_COLIBNAME, luaopen_coroutine},
+            {LuaLibraryTable, LUA_TABLIBNAME, luaopen_table},
+            {LuaLibraryIo, LUA_IOLIBNAME, luaopen_io},
+            {LuaLibraryOs, LUA_OSLIBNAME, luaopen_os},
+            {LuaLibraryString, LUA_STRLIBNAME, luaopen_string},
+            {LuaLibraryMath, LUA_MATHLIBNAME, luaopen_math},
+            {LuaLibraryUtf8, LUA_UTF8LIBNAME, luaopen_utf8},
+            {LuaLibraryDebug, LUA_DBLIBNAME, luaopen_debug},
+        };
+
+        // `__index` of the global table, upvalue 1 holds bitmask of libraries that are not loaded yet
+        static int LoadLazyLibrary(lua_State *L)
+        {
+            if (lua_type(L, 2) != LUA_TSTRING)
+            {
+                return 0;
+            }
+            const char *key = lua_tostring(L, 2);
+            auto pending = static_cast<unsigned>(lua_tointeger(L, lua_upvalueindex(1)));
+            for (const auto &library: Libraries)
+            {
+                // `require` is defined by the package library
+                const bool requested = strcmp(key, library.name) == 0 ||
+                                       (library.library == LuaLibraryPackage && strcmp(key, "require") == 0);
+                if ((pending & library.library) == 0 || !requested)
+                {
+                    continue;
+                }
+                pending &= ~library.library;
+                lua_pushinteger(L, pending);
+                lua_replace(L, lua_upvalueindex(1));
+                if (pending == 0)
+                {
+                    lua_pushnil(L);
+                    lua_setmetatable(L, 1);
+                }
+                luaL_requiref(L, library.name, library.open, 1);
+                lua_pop(L, 1);
+                lua_pushvalue(L, 2);
+                lua_rawget(L, 1);
+                return 1;
+            }
+            return 0;
+        }
+
+        // `__index` of strings until the string library is loaded, opening it replaces the metatable of strings
+        static int LoadLazyStringMethod(lua_State *L)
+        {
+            if (lua_getglobal(L, LUA_STRLIBNAME) != LUA_TTABLE)
+            {
+                return 0;
+            }
+            lua_pushvalue(L, 2);
+            lua_gettable(L, -2);
+            return 1;
+        }
+
+        static void OpenLibraries(lua_State *L, unsigned libraries, unsigned lazyLibraries)
+        {
+            // the base library sets globals directly, there is no single global to trigger loading it
+            libraries |= lazyLibraries & LuaLibraryBase;
+            lazyLibraries &= ~(libraries | LuaLibraryBase);
+            for (const auto &library: Libraries)
+            {
+                if (libraries & library.library)
+                {
+                    luaL_requiref(L, library.name, library.open, 1);
+                    lua_pop(L, 1);
+                }
+            }
+            if (lazyLibraries != 0)
+            {
+                lua_pushglobaltable(L);
+                lua_createtable(L, 0, 1);
+                lua_pushinteger(L, lazyLibraries);
+                lua_pushcclosure(L, LoadLazyLibrary, 1);
+                lua_setfield(L, -2, "__index");
+                lua_setmetatable(L, -2);
+                lua_pop(L, 1);
+            }
+            if (lazyLibraries & LuaLibraryString)
+            {
+                // method calls like ('abc'):upper() don't go through the global table
+                lua_pushliteral(L, "");
+                lua_createtable(L, 0, 1);
+                lua_pushcfunction(L, LoadLazyStringMethod);
+                lua_setfield(L, -2, "__index");
+                lua_setmetatable(L, -2);
+                lua_pop(L, 1);
+            }
+        }
+
+        static void CreateGcCanary(lua_State *L, GcCounters *counters);
+
+        // finalizer of an unreachable object runs once per collection cycle, count it and set up another one
+        static int GcCanary(lua_State *L)
+        {
+            auto *counters = *static_cast<GcCounters **>(lua_touserdata(L, 1));
+            ++counters->collections;
+            if (!counters->closing)
+            {
+                CreateGcCanary(L, counters);
+            }
+            return 0;
+        }
+
+        static void CreateGcCanary(lua_State *L, GcCounters *counters)
+        {
+            auto **ud = static_cast<GcCounters **>(lua_newuserdatauv(L, sizeof(GcCounters *), 0));
+            *ud = counters;
+            if (luaL_newmetatable(L, "LuaVar::GcCanary"))
+            {
+                // Ensure metatable is created only once
+                lua_pushcfunction(L, GcCanary);
+                lua_setfield(L, -2, "__gc");
+            }
+            lua_setmetatable(L, -2);
+            lua_pop(L, 1);
+        }
+    }
+
+    LuaState::LuaState() : LuaState(LuaStateOptions{})
+    {
+    }
+
+    LuaState::LuaState(const LuaStateOptions &options) : _gc(std::make_unique<Internal::GcCounters>()),
+                                                         _memory(std::make_unique<Internal::MemoryCounters>()),
+                                                         _budget(std::make_unique<Internal::BudgetCounters>())
     {
+        // luaL_newstate also installs panic and warning handlers, only the allocator is replaced
         L = luaL_newstate();
+        _memory->used = static_cast<size_t>(lua_gc(L, LUA_GCCOUNT, 0)) * 1024 +
+                        static_cast<size_t>(lua_gc(L, LUA_GCCOUNTB, 0));
+        _memory->peak = _memory->used;
+        _memory->limit = options.memoryLimit;
+        lua_setallocf(L, Internal::CountingAlloc, _memory.get());
+        SetMemoryThreshold(options.memoryThreshold, options.onMemoryThreshold);
+        Internal::CreateGcCanary(L, _gc.get());
+        Internal::OpenLibraries(L, options.libraries, options.lazyLibraries);
+        lua_pushlightuserdata(L, _budget.get());
+        lua_rawsetp(L, LUA_REGISTRYINDEX, &Internal::BudgetKey);
     }
 
     LuaVar::LuaState::~LuaState()
     {
+        _gc->closing = true;
         lua_close(L);
     }
-}
\ No newline at end of file
+
+    void LuaState::UseIncrementalGc(const IncrementalGcParams &params)
+    {
+        lua_gc(L, LUA_GCINC, params.pause, params.stepMultiplier, params.stepSize);
+        _gc->mode = GcMode::Incremental;
+    }
+
+    void LuaState::UseGenerationalGc(const GenerationalGcParams &params)
+    {
+        lua_gc(L, LUA_GCGEN, params.minorMultiplier, params.majorMultiplier);
+        _gc->mode = GcMode::Generational;
+    }
+
+    GcMode LuaState::GetGcMode() const
+    {
+        return _gc->mode;
+    }
+
+    void LuaState::SetGcRunning(bool running)
+    {
+        lua_gc(L, running ? LUA_GCRESTART : LUA_GCSTOP, 0);
+    }
+
+    bool LuaState::IsGcRunning() const
+    {
+        return lua_gc(L, LUA_GCISRUNNING, 0) != 0;
+    }
+
+    void LuaState::RecordPause(std::chrono::nanoseconds pause)
+    {
+        ++_gc->explicitRuns;
+        _gc->lastPause = pause;
+        _gc->maxPause = std::max(_gc->maxPause, pause);
+        _gc->totalPause += pause;
+    }
+
+    void LuaState::Collect()
+    {
+        const auto start = std::chrono::steady_clock::now();
+        lua_gc(L, LUA_GCCOLLECT, 0);
+        RecordPause(std::chrono::steady_clock::now() - start);
+    }
+
+    bool LuaState::StepGc(std::chrono::microseconds budget, int stepKb)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        const auto deadline = start + budget;
+        bool completed;
+        auto now = start;
+        do
+        {
+            completed = lua_gc(L, LUA_GCSTEP, stepKb) != 0;
+            now = std::chrono::steady_clock::now();
+        } while (!completed && now < deadline);
+        RecordPause(now - start);
+        return completed;
+    }
+
+    GcStats LuaState::GetGcStats() const
+    {
+        GcStats stats;
+        stats.heapBytes = static_cast<size_t>(lua_gc(L, LUA_GCCOUNT, 0)) * 1024 +
+                          static_cast<size_t>(lua_gc(L, LUA_GCCOUNTB, 0));
+        stats.collections = _gc->collections;
+        stats.explicitRuns = _gc->explicitRuns;
+        stats.lastPause = _gc->lastPause;
+        stats.maxPause = _gc->maxPause;
+        stats.totalPause = _gc->totalPause;
+        return stats;
+    }
+
+    void LuaState::SetMemoryLimit(size_t bytes)
+    {
+        _memory->limit = bytes;
+    }
+
+    void LuaState::SetMemoryThreshold(size_t bytes, MemoryThresholdCallback callback)
+    {
+        const bool enabled = bytes != 0 && callback;
+        _memory->threshold = enabled ? bytes : 0;
+        _memory->onThreshold = std::move(callback);
+        _memory->nextThreshold = enabled && _memory->used < bytes ? bytes : SIZE_MAX;
+    }
+
+    MemoryStats LuaState::GetMemoryStats() const
+    {
+        MemoryStats stats;
+        stats.usedBytes = _memory->used;
+        stats.peakBytes = _memory->peak;
+        stats.limitBytes = _memory->limit;
+        stats.failedAllocations = _memory->failed;
+        return stats;
+    }
+
+    void LuaState::ResetPeakMemory()
+    {
+        _memory->peak = _memory->used;
+    }
+
+    void LuaState::SetExecutionBudget(const ExecutionBudget &budget)
+    {
+        _budget->defaults = budget;
+    }
+
+    template<typename Call>
+    int LuaState::WithBudget(const ExecutionBudget *budget, Call &&call)
+    {
+        if (_budget->depth > 0)
+        {
+            ++_budget->depth;
+            const int status = call();
+            --_budget->depth;
+            return status;
+        }
+
+        const ExecutionBudget &active = budget != nullptr ? *budget : _budget->defaults;
+        const bool limited = active.instructions != 0 || active.wallTime.count() != 0;
+        _budget->active = active;
+        _budget->active.checkInterval = std::max(1, active.checkInterval);
+        _budget->executed = 0;
+        _budget->exceeded = false;
+        _budget->deadline = std::chrono::steady_clock::now() + active.wallTime;
+        // hook installed by the embedder (debugger, profiler) is suspended for the call
+        const lua_Hook savedHook = lua_gethook(L);
+        const int savedMask = lua_gethookmask(L);
+        const int savedCount = lua_gethookcount(L);
+        if (limited)
+        {
+            if (_budget->resume == nullptr && _budget->wrapped == nullptr)
+            {
+                Internal::FindCoroutineFunctions(L, _budget.get());
+            }
+            lua_sethook(L, Internal::BudgetHook, _budget->hookMask, _budget->active.checkInterval);
+        }
+        ++_budget->depth;
+        const int status = call();
+        --_budget->depth;
+        if (limited)
+        {
+            lua_sethook(L, savedHook, savedMask, savedCount);
+        }
+        return status;
+    }
+
+    int LuaState::Run(const char *script, const char *chunkName)
+    {
+        return WithBudget(nullptr, [this, script, chunkName]
+        {
+            const int status = luaL_loadbufferx(L, script, strlen(script), chunkName, nullptr);
+            return status != LUA_OK ? status : lua_pcall(L, 0, 0, 0);
+        });
+    }
+
+    int LuaState::Run(const char *script, const ExecutionBudget &budget, const char *chunkName)
+    {
+        return WithBudget(&budget, [this, script, chunkName]
+        {
+            const int status = luaL_loadbufferx(L, script, strlen(script), chunkName, nullptr);
+            return status != LUA_OK ? status : lua_pcall(L, 0, 0, 0);
+        });
+    }
+
+    int LuaState::PCall(int nargs, int nresults)
+    {
+        return WithBudget(nullptr, [this, nargs, nresults]
+        {
+            return lua_pcall(L, nargs, nresults, 0);
+        });
+    }
+
+    int LuaState::PCall(int nargs, int nresults, const ExecutionBudget &budget)
+    {
+        return WithBudget(&budget, [this, nargs, nresults]
+        {
+            return lua_pcall(L, nargs, nresults, 0);
+        });
+    }
+
+    bool LuaState::BudgetExceeded() const
+    {
+        return _budget->exceeded;
+    }
+}
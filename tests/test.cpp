@@ -34,11 +34,46 @@
 // #endif
 
 #include <catch2/catch_test_macros.hpp>
+#include <array>
+#include <atomic>
 #include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <unordered_map>
+#include <variant>
+#include <vector>
 
+#include <luavar/bundle.h>
+#include <luavar/channel.h>
+#include <luavar/environment.h>
 #include <luavar/luavar.h>
+#include <luavar/parallel.h>
+#include <luavar/property.h>
+#include <luavar/ref.h>
+#include <luavar/reload.h>
+#include <luavar/serialize.h>
+#include <luavar/shared_table.h>
 #include <luavar/state.h>
 
+// results of this type can't be pushed, used to test failure paths
+struct Unpushable
+{
+    bool operator<(const Unpushable &) const
+    {
+        return false;
+    }
+};
+
+template<>
+inline bool LuaVar::Internal::push_result(lua_State */*L*/, Unpushable &/*arg*/)
+{
+    return false;
+}
+
 void exec_lua(lua_State *L, std::string s)
 {
     if (luaL_dostring(L, s.c_str()) != LUA_OK)
@@ -299,6 +334,63 @@ struct IsValidCallable
     static constexpr bool value = requires { typename LuaVar::Callable<T>; };
 };
 
+// counts allocations, used to verify that bound functors are moved rather than copied
+static int CountedAllocations = 0;
+
+template<typename T>
+struct CountingAllocator
+{
+    using value_type = T;
+
+    CountingAllocator() = default;
+
+    template<typename U>
+    CountingAllocator(const CountingAllocator<U> &)
+    {
+    }
+
+    T *allocate(size_t n)
+    {
+        ++CountedAllocations;
+        return std::allocator<T>().allocate(n);
+    }
+
+    void deallocate(T *p, size_t n)
+    {
+        std::allocator<T>().deallocate(p, n);
+    }
+
+    template<typename U>
+    bool operator==(const CountingAllocator<U> &) const
+    {
+        return true;
+    }
+};
+
+// counts how many times it was copied and moved
+struct CopyCountingFunctor
+{
+    static inline int Copies = 0;
+    static inline int Moves = 0;
+
+    CopyCountingFunctor() = default;
+
+    CopyCountingFunctor(const CopyCountingFunctor &)
+    {
+        ++Copies;
+    }
+
+    CopyCountingFunctor(CopyCountingFunctor &&) noexcept
+    {
+        ++Moves;
+    }
+
+    int operator()() const
+    {
+        return 3;
+    }
+};
+
 TEST_CASE("Basic func")
 {
     auto LS = LuaVar::LuaState();
@@ -428,6 +520,18 @@ TEST_CASE("Basic func")
             lua_getglobal(L, "res");
             REQUIRE(lua_tonumber(L, -1) == 1);
         }
+        SECTION("arguments converted directly into parameters")
+        {
+            // integral floats are accepted for int parameters, strings keep embedded zeros both ways
+            auto f = [](int n, std::string s) -> std::string { return std::to_string(n) + s; };
+            LuaVar::CppFunction("concat", f).Bind(L);
+            exec_lua(L, "res = concat(3.0, 'a\\0b')");
+            lua_getglobal(L, "res");
+            size_t length = 0;
+            const char *res = lua_tolstring(L, -1, &length);
+            REQUIRE(res != nullptr);
+            CHECK(std::string(res, length) == std::string("3a\0b", 4));
+        }
         SECTION("integration of functions returning multiple types")
         {
             LuaVar::CppFunction<tupfoo>("foo_return_int_str").Bind(L);
@@ -624,6 +728,33 @@ TEST_CASE("Basic func")
                 luaL_dostring(L, "captwointslambda = nil");
                 lua_gc(L, LUA_GCCOLLECT, 0);
             }
+            SECTION("small trivially copyable capture is stored in upvalues")
+            {
+                std::int64_t a = 1, b = 2;
+                auto small = [=](int i) { return static_cast<int>(a + b + i); };
+                STATIC_CHECK(LuaVar::Internal::IsInlineFunctor<decltype(small)>);
+                LuaVar::CppFunction("small", small).Bind(L);
+                lua_getglobal(L, "small");
+                CHECK(lua_getupvalue(L, -1, 1) != nullptr);
+                CHECK(lua_type(L, -1) == LUA_TNUMBER);
+                lua_pop(L, 2);
+                exec_lua(L, "res = small(3) + small(4)");
+                lua_getglobal(L, "res");
+                REQUIRE(lua_tointeger(L, -1) == 13);
+
+                std::int64_t c = 3;
+                auto large = [=](int i) { return static_cast<int>(a + b + c + i); };
+                STATIC_CHECK_FALSE(LuaVar::Internal::IsInlineFunctor<decltype(large)>);
+                STATIC_CHECK_FALSE(LuaVar::Internal::IsInlineFunctor<decltype(some_struct)>);
+                LuaVar::CppFunction("large", large).Bind(L);
+                lua_getglobal(L, "large");
+                CHECK(lua_getupvalue(L, -1, 1) != nullptr);
+                CHECK(lua_type(L, -1) == LUA_TUSERDATA);
+                lua_pop(L, 2);
+                exec_lua(L, "res = large(4)");
+                lua_getglobal(L, "res");
+                REQUIRE(lua_tointeger(L, -1) == 10);
+            }
             SECTION("mutable lambda")
             {
                 int k = 10;
@@ -770,6 +901,83 @@ TEST_CASE("Basic func")
                 CHECK((ExampleStruct::DestructionCount()-destructions_before_gc) == 1);
             }
         }
+        SECTION("move-only and large captures")
+        {
+            CountedAllocations = 0;
+
+            SECTION("1MB buffer is moved, not copied")
+            {
+                std::vector<char, CountingAllocator<char> > buffer(1024 * 1024, 'x');
+                REQUIRE(CountedAllocations == 1);
+                LuaVar::CppFunction("buffer_size", [buffer = std::move(buffer)]()
+                {
+                    return static_cast<int>(buffer.size());
+                }).Bind(L);
+                CHECK(CountedAllocations == 1);
+                exec_lua(L, "res = buffer_size()");
+                lua_getglobal(L, "res");
+                CHECK(lua_tointeger(L, -1) == 1024 * 1024);
+                CHECK(CountedAllocations == 1);
+            }
+            SECTION("unique_ptr capture")
+            {
+                auto value = std::make_unique<int>(42);
+                auto *raw = value.get();
+                LuaVar::CppFunction("get_value", [value = std::move(value)](int add)
+                {
+                    return *value + add;
+                }).Bind(L);
+                *raw = 50;
+                exec_lua(L, "res = get_value(1)");
+                lua_getglobal(L, "res");
+                CHECK(lua_tointeger(L, -1) == 51);
+                exec_lua(L, "get_value = nil");
+                lua_gc(L, LUA_GCCOLLECT, 0);
+            }
+            SECTION("move-only CallableDyn")
+            {
+                auto value = std::make_unique<int>(7);
+                LuaVar::CppFunction("get_value", LuaVar::CallableDyn{[value = std::move(value)]()
+                {
+                    return *value;
+                }}).Bind(L);
+                exec_lua(L, "res = get_value()");
+                lua_getglobal(L, "res");
+                CHECK(lua_tointeger(L, -1) == 7);
+            }
+            SECTION("lvalue binding can be reused")
+            {
+                std::vector<char, CountingAllocator<char> > buffer(16, 'x');
+                auto binding = LuaVar::CppFunction("buffer_size", [buffer = std::move(buffer)]()
+                {
+                    return static_cast<int>(buffer.size());
+                });
+                binding.Bind(L);
+                binding.Bind(L);
+                exec_lua(L, "res = buffer_size()");
+                lua_getglobal(L, "res");
+                CHECK(lua_tointeger(L, -1) == 16);
+                lua_pop(L, 1);
+
+                // lvalue bindings copy the functor, temporary ones move it
+                CopyCountingFunctor::Copies = 0;
+                CopyCountingFunctor::Moves = 0;
+                auto counted = LuaVar::CppFunction("counted", CopyCountingFunctor{});
+                const int moves = CopyCountingFunctor::Moves;
+                counted.Bind(L);
+                counted.Bind(L);
+                CHECK(CopyCountingFunctor::Copies == 2);
+                CHECK(CopyCountingFunctor::Moves == moves);
+                std::move(counted).Bind(L);
+                CHECK(CopyCountingFunctor::Copies == 2);
+                CHECK(CopyCountingFunctor::Moves == moves + 1);
+                LuaVar::CppFunction("counted", CopyCountingFunctor{}).Bind(L);
+                CHECK(CopyCountingFunctor::Copies == 2);
+                exec_lua(L, "res = counted()");
+                lua_getglobal(L, "res");
+                CHECK(lua_tointeger(L, -1) == 3);
+            }
+        }
         SECTION("custom callable objects") // this case is really same as mutable lambda
         {
             class CustomFunctor
@@ -878,10 +1086,2175 @@ TEST_CASE("Basic func")
             REQUIRE(std::get<1>(res) == 10);
             REQUIRE(std::get<2>(res) == 15);
         }
+        SECTION("repeated calls read their own results and keep the stack balanced")
+        {
+            auto func = LuaVar::LuaFunction<int(*)(int)>("func");
+            luaL_dostring(L, "function func(x) return x * 2; end");
+            lua_pushinteger(L, 1000);
+            CHECK(func(L, 1) == 2);
+            CHECK(func(L, 2) == 4);
+            CHECK(lua_gettop(L) == 1);
+            CHECK(lua_tointeger(L, -1) == 1000);
+        }
         //todo: create test cases that test erroring out if soft errors are not enabled - if returned value count doesn't match expected - fail
     }
 }
 
+TEST_CASE("Optional and variant values")
+{
+    auto LS = LuaVar::LuaState();
+    lua_State *L = LS.Get();
+
+    SECTION("optional argument")
+    {
+        auto greet = [](std::string name, std::optional<int> times) -> std::string
+        {
+            std::string res;
+            for (int i = 0; i < times.value_or(1); ++i)
+                res += name;
+            return res;
+        };
+        LuaVar::CppFunction("greet", greet).Bind(L);
+        exec_lua(L, "a = greet('x') b = greet('x', nil) c = greet('x', 3) d = greet('x', 'y')");
+        lua_getglobal(L, "a");
+        CHECK(std::string(lua_tostring(L, -1)) == "x");
+        lua_getglobal(L, "b");
+        CHECK(std::string(lua_tostring(L, -1)) == "x");
+        lua_getglobal(L, "c");
+        CHECK(std::string(lua_tostring(L, -1)) == "xxx");
+        lua_getglobal(L, "d");
+        CHECK(std::string(lua_tostring(L, -1)) == "Invalid arguments");
+    }
+    SECTION("optional result")
+    {
+        auto find = [](int key) -> std::optional<std::string>
+        {
+            if (key == 1)
+                return "one";
+            return std::nullopt;
+        };
+        LuaVar::CppFunction("find", find).Bind(L);
+        exec_lua(L, "a = find(1) b = find(2)");
+        lua_getglobal(L, "a");
+        CHECK(std::string(lua_tostring(L, -1)) == "one");
+        CHECK(lua_getglobal(L, "b") == LUA_TNIL);
+    }
+    SECTION("variant argument picks alternative by lua type")
+    {
+        using Value = std::variant<std::monostate, bool, int, double, std::string>;
+        auto describe = [](Value v) -> int { return static_cast<int>(v.index()); };
+        LuaVar::CppFunction("describe", describe).Bind(L);
+        exec_lua(L, "a = describe() b = describe(true) c = describe(5) d = describe(5.5) e = describe('s') "
+                    "f = describe({})");
+        const std::pair<const char *, int> expected[] = {{"a", 0}, {"b", 1}, {"c", 2}, {"d", 3}, {"e", 4}};
+        for (auto [name, index]: expected)
+        {
+            lua_getglobal(L, name);
+            CHECK(lua_tointeger(L, -1) == index);
+        }
+        lua_getglobal(L, "f");
+        CHECK(lua_type(L, -1) == LUA_TSTRING);
+    }
+    SECTION("variant falls back to convertible alternative")
+    {
+        auto half = [](std::variant<double, std::string> v) -> double
+        {
+            return std::holds_alternative<double>(v) ? std::get<double>(v) / 2 : -1.0;
+        };
+        LuaVar::CppFunction("half", half).Bind(L);
+        exec_lua(L, "a = half(3) b = half('3')");
+        lua_getglobal(L, "a");
+        CHECK(lua_tonumber(L, -1) == 1.5);
+        lua_getglobal(L, "b");
+        CHECK(lua_tonumber(L, -1) == -1.0);
+    }
+    SECTION("variant and nil results")
+    {
+        auto make = [](int kind) -> std::variant<std::nullptr_t, int, std::string>
+        {
+            if (kind == 0)
+                return nullptr;
+            if (kind == 1)
+                return 42;
+            return "text";
+        };
+        LuaVar::CppFunction("make", make).Bind(L);
+        exec_lua(L, "a = make(0) b = make(1) c = make(2)");
+        CHECK(lua_getglobal(L, "a") == LUA_TNIL);
+        lua_getglobal(L, "b");
+        CHECK(lua_tointeger(L, -1) == 42);
+        lua_getglobal(L, "c");
+        CHECK(std::string(lua_tostring(L, -1)) == "text");
+    }
+    SECTION("lua function results")
+    {
+        exec_lua(L, "function maybe(x) if x > 0 then return x end end");
+        auto maybe = LuaVar::LuaFunction<std::optional<int>(*)(int)>("maybe");
+        CHECK(maybe(L, 5) == 5);
+        CHECK(maybe(L, -5) == std::nullopt);
+        auto any = LuaVar::LuaFunction<std::variant<int, std::string>(*)(std::variant<int, std::string>)>("tostring");
+        luaL_openlibs(L);
+        CHECK(std::get<std::string>(any(L, 10)) == "10");
+        CHECK(lua_gettop(L) == 0);
+    }
+}
+
+TEST_CASE("Map values")
+{
+    auto LS = LuaVar::LuaState();
+    lua_State *L = LS.Get();
+
+    SECTION("flat map")
+    {
+        LuaVar::FlatMap<int, std::string> map(std::vector<std::pair<int, std::string> >{{3, "c"}, {1, "a"}, {3, "d"}, {2, "b"}});
+        REQUIRE(map.size() == 3);
+        CHECK(map.at(3) == "d");
+        CHECK(map.begin()->first == 1);
+        CHECK(map.emplace(0, "z").second);
+        CHECK_FALSE(map.emplace(0, "y").second);
+        CHECK(map.begin()->second == "z");
+        map[5] = "e";
+        CHECK(map.contains(5));
+        CHECK(map.erase(1) == 1);
+        CHECK(map.find(1) == map.end());
+        CHECK(map.size() == 4);
+    }
+    SECTION("table arguments")
+    {
+        auto sum = [](std::unordered_map<std::string, int> values) -> int
+        {
+            int res = 0;
+            for (auto &[key, value]: values)
+                res += value * static_cast<int>(key.size());
+            return res;
+        };
+        auto keys = [](std::map<int, std::string> values) -> std::string
+        {
+            std::string res;
+            for (auto &[key, value]: values)
+                res += std::to_string(key) + value;
+            return res;
+        };
+        auto lookup = [](LuaVar::FlatMap<std::string, double> values, std::string key) -> double
+        {
+            return values.at(key);
+        };
+        LuaVar::CppFunction("sum", sum).Bind(L);
+        LuaVar::CppFunction("keys", keys).Bind(L);
+        LuaVar::CppFunction("lookup", lookup).Bind(L);
+        exec_lua(L, "a = sum({ a = 1, bb = 2, ccc = 3 }) b = keys({ 'x', 'y', [10] = 'z' }) "
+                    "c = lookup({ speed = 1.5, [7] = 2.5 }, '7') d = sum({ a = 'text' }) e = sum(5)");
+        lua_getglobal(L, "a");
+        CHECK(lua_tointeger(L, -1) == 14);
+        lua_getglobal(L, "b");
+        CHECK(std::string(lua_tostring(L, -1)) == "1x2y10z");
+        lua_getglobal(L, "c");
+        CHECK(lua_tonumber(L, -1) == 2.5);
+        lua_getglobal(L, "d");
+        CHECK(std::string(lua_tostring(L, -1)) == "Invalid arguments");
+        lua_getglobal(L, "e");
+        CHECK(std::string(lua_tostring(L, -1)) == "Invalid arguments");
+    }
+    SECTION("nested maps")
+    {
+        using Nested = std::map<std::string, std::map<std::string, int> >;
+        auto count = [](Nested values) -> int
+        {
+            return static_cast<int>(values.size() * 10 + values["b"].size());
+        };
+        LuaVar::CppFunction("count", count).Bind(L);
+        exec_lua(L, "res = count({ a = { x = 1 }, b = { x = 1, y = 2 } })");
+        lua_getglobal(L, "res");
+        CHECK(lua_tointeger(L, -1) == 22);
+    }
+    SECTION("map results")
+    {
+        auto make = [](int n) -> std::unordered_map<int, std::string>
+        {
+            std::unordered_map<int, std::string> res;
+            for (int i = 1; i <= n; ++i)
+                res[i] = std::string(i, 'x');
+            return res;
+        };
+        LuaVar::CppFunction("make", make).Bind(L);
+        exec_lua(L, "local t = make(3) res = #t .. t[3]");
+        lua_getglobal(L, "res");
+        CHECK(std::string(lua_tostring(L, -1)) == "3xxx");
+    }
+    SECTION("failed results leave nothing on the stack")
+    {
+        std::map<int, Unpushable> values{{1, {}}};
+        CHECK_FALSE(LuaVar::Internal::push_result(L, values));
+        CHECK(lua_gettop(L) == 0);
+        std::map<Unpushable, int> keys{{{}, 1}};
+        CHECK_FALSE(LuaVar::Internal::push_result(L, keys));
+        CHECK(lua_gettop(L) == 0);
+        std::map<int, std::map<int, Unpushable> > nested{{1, values}};
+        CHECK_FALSE(LuaVar::Internal::push_result(L, nested));
+        CHECK(lua_gettop(L) == 0);
+    }
+    SECTION("lua function round trip")
+    {
+        luaL_openlibs(L);
+        exec_lua(L, "function invert(t) local r = {} for k, v in pairs(t) do r[v] = k end return r end");
+        auto invert = LuaVar::LuaFunction<std::map<std::string, int>(*)(LuaVar::FlatMap<int, std::string>)>("invert");
+        LuaVar::FlatMap<int, std::string> map;
+        map[1] = "one";
+        map[2] = "two";
+        auto res = invert(L, map);
+        CHECK(res == std::map<std::string, int>{{"one", 1}, {"two", 2}});
+        CHECK(lua_gettop(L) == 0);
+    }
+}
+
+TEST_CASE("Lua value handles")
+{
+    auto LS = LuaVar::LuaState();
+    lua_State *L = LS.Get();
+    luaL_openlibs(L);
+    exec_lua(L, "config = { width = 800, title = 'game', 10, 20, 30 } function add(a, b) return a + b end");
+
+    SECTION("ref keeps value alive")
+    {
+        LuaVar::Ref ref;
+        CHECK_FALSE(ref);
+        {
+            lua_pushstring(L, "kept");
+            ref = LuaVar::Ref::Pop(L);
+        }
+        lua_gc(L, LUA_GCCOLLECT, 0);
+        CHECK(ref.Type() == LUA_TSTRING);
+        CHECK(ref.As<std::string>() == "kept");
+        CHECK(ref.As<bool>() == std::nullopt);
+        CHECK(lua_gettop(L) == 0);
+
+        LuaVar::Ref moved = std::move(ref);
+        CHECK_FALSE(ref);
+        CHECK(moved);
+        moved.Reset();
+        CHECK_FALSE(moved);
+    }
+    SECTION("table accessors")
+    {
+        auto config = LuaVar::Table::Global(L, "config");
+        REQUIRE(config);
+        CHECK(config.Get<int>("width") == 800);
+        CHECK(config.Get<std::string>("title") == "game");
+        CHECK(config.Get<int>("missing") == std::nullopt);
+        CHECK(config.Get<bool>("width") == std::nullopt);
+        CHECK(config.Get<int>(2) == 20);
+        CHECK(config.Length() == 3);
+
+        config.Set("height", 600);
+        config.Set(4, 40);
+        config.Set(std::string("name"), std::string("player"));
+        exec_lua(L, "res = config.height + config[4] .. config.name");
+        lua_getglobal(L, "res");
+        CHECK(std::string(lua_tostring(L, -1)) == "640player");
+        lua_pop(L, 1);
+
+        int sum = 0;
+        config.ForEach<int, int>([&sum](int key, int value) { sum += key * value; });
+        CHECK(sum == 10 + 40 + 90 + 160);
+        CHECK(lua_gettop(L) == 0);
+
+        CHECK_FALSE(LuaVar::Table::Global(L, "add"));
+        auto created = LuaVar::Table::Create(L, 0, 4);
+        created.Set("x", 1.5);
+        CHECK(created.Get<double>("x") == 1.5);
+    }
+    SECTION("function calls without global lookup")
+    {
+        auto add = LuaVar::Function::Global(L, "add");
+        REQUIRE(add);
+        exec_lua(L, "add = nil");
+        CHECK(add.Call<int>(2, 3) == 5);
+        CHECK(add.Call<double>(2.5, 3) == 5.5);
+        CHECK(lua_gettop(L) == 0);
+        CHECK_FALSE(LuaVar::Function::Global(L, "config"));
+    }
+    SECTION("handles as arguments and results")
+    {
+        auto apply = [](LuaVar::Function f, LuaVar::Table t) -> int
+        {
+            return f.Call<int>(t.Get<int>(1).value_or(0), t.Get<int>(2).value_or(0));
+        };
+        LuaVar::CppFunction("apply", apply).Bind(L);
+        exec_lua(L, "res = apply(function(a, b) return a * b end, { 6, 7 }) bad = apply(1, {})");
+        lua_getglobal(L, "res");
+        CHECK(lua_tointeger(L, -1) == 42);
+        lua_getglobal(L, "bad");
+        CHECK(std::string(lua_tostring(L, -1)) == "Invalid arguments");
+        lua_pop(L, 2);
+
+        auto config = LuaVar::Table::Global(L, "config");
+        exec_lua(L, "function first(t) return t[1] end");
+        auto first = LuaVar::Function::Global(L, "first");
+        CHECK(first.Call<int>(config) == 10);
+    }
+    SECTION("invalid handles")
+    {
+        auto config = LuaVar::Table::Global(L, "config");
+        auto moved = std::move(config);
+        CHECK(config.Get<int>("width") == std::nullopt);
+        CHECK(config.Get<int>(1) == std::nullopt);
+        CHECK(LuaVar::Table().Get<std::string>("title") == std::nullopt);
+        CHECK(config.Length() == 0);
+        config.Set("width", 1);
+        config.ForEach<int, int>([](int, int) { FAIL("invalid table has no entries"); });
+        CHECK(lua_gettop(L) == 0);
+        CHECK(moved.Get<int>("width") == 800);
+    }
+    SECTION("operations on the calling thread")
+    {
+        // errors raised by calls from bound functions unwind the coroutine that called them
+        LuaVar::Function stored;
+        LuaVar::Table settings = LuaVar::Table::Global(L, "config");
+        auto store = [&stored](LuaVar::Function f) { stored = std::move(f); };
+        auto fire = [&stored, &settings](int x, LuaVar::StackView rest)
+        {
+            return stored.Call<int>(rest.State(), x + settings.Get<int>(rest.State(), "width").value_or(0));
+        };
+        LuaVar::CppFunction("store", store).Bind(L);
+        LuaVar::CppFunction("fire", fire).Bind(L);
+        exec_lua(L, "store(function(x) if x < 0 then error('negative', 0) end return x end) "
+                 "co = coroutine.wrap(function() local ok, err = pcall(fire, -1000) caught = not ok and err "
+                 "coroutine.yield(fire(1)) return 'finished' end) first = co() second = co()");
+        lua_getglobal(L, "caught");
+        CHECK(std::string(lua_tostring(L, -1)) == "negative");
+        lua_getglobal(L, "first");
+        CHECK(lua_tointeger(L, -1) == 801);
+        lua_getglobal(L, "second");
+        CHECK(std::string(lua_tostring(L, -1)) == "finished");
+        lua_settop(L, 0);
+    }
+}
+
+TEST_CASE("Concurrent binding")
+{
+    // every thread owns its state, binding the same functor types concurrently must not interfere
+    auto worker = [](int seed, int *result)
+    {
+        auto LS = LuaVar::LuaState();
+        lua_State *L = LS.Get();
+        std::string text = "thread";
+        std::vector<int> padding(seed, seed);
+        for (int i = 0; i < 50; ++i)
+        {
+            LuaVar::CppFunction("with_string", [text, seed](int x) { return x + seed + static_cast<int>(text.size()); }).Bind(L);
+            LuaVar::CppFunction("with_vector", [padding](int x) { return x + static_cast<int>(padding.size()); }).Bind(L);
+        }
+        luaL_dostring(L, "res = with_string(1) + with_vector(1)");
+        lua_getglobal(L, "res");
+        *result = static_cast<int>(lua_tointeger(L, -1));
+        lua_gc(L, LUA_GCCOLLECT, 0);
+    };
+
+    constexpr int count = 8;
+    std::vector<std::thread> threads;
+    int results[count] = {};
+    for (int i = 0; i < count; ++i)
+    {
+        threads.emplace_back(worker, i, &results[i]);
+    }
+    for (auto &thread: threads)
+    {
+        thread.join();
+    }
+    for (int i = 0; i < count; ++i)
+    {
+        CHECK(results[i] == 1 + i + 6 + 1 + i);
+    }
+
+    SECTION("metatables are keyed by address, not by name")
+    {
+        auto LS = LuaVar::LuaState();
+        lua_State *L = LS.Get();
+        std::string text = "x";
+        auto f = [text]() { return static_cast<int>(text.size()); };
+        using Bind = LuaVar::Internal::DynamicBind<decltype(f), LuaVar::DefaultLuaVarFlags>;
+        LuaVar::CppFunction("f", f).Bind(L);
+        CHECK(lua_rawgetp(L, LUA_REGISTRYINDEX, LuaVar::Internal::GetTypeKey<Bind>()) == LUA_TTABLE);
+        CHECK(lua_getfield(L, LUA_REGISTRYINDEX, "Function#1") == LUA_TNIL);
+        lua_settop(L, 0);
+    }
+}
+
+TEST_CASE("Multiple results without tuples")
+{
+    auto LS = LuaVar::LuaState();
+    lua_State *L = LS.Get();
+
+    SECTION("bound function writes results")
+    {
+        auto minmax = [](int a, int b, LuaVar::Returns<int, int> out) { out(std::min(a, b), std::max(a, b)); };
+        LuaVar::CppFunction("minmax", minmax).Bind(L);
+        exec_lua(L, "lo, hi = minmax(7, 3)");
+        lua_getglobal(L, "lo");
+        lua_getglobal(L, "hi");
+        CHECK(lua_tointeger(L, -2) == 3);
+        CHECK(lua_tointeger(L, -1) == 7);
+        lua_settop(L, 0);
+    }
+    SECTION("mixed types and arguments passing through tuple path")
+    {
+        auto describe = [](std::map<std::string, int> values, LuaVar::Returns<std::string, int, bool> out)
+        {
+            out(values.begin()->first, values.begin()->second, values.size() > 1);
+        };
+        LuaVar::CppFunction("describe", describe).Bind(L);
+        exec_lua(L, "a, b, c = describe({ key = 5 })");
+        lua_getglobal(L, "a");
+        lua_getglobal(L, "b");
+        lua_getglobal(L, "c");
+        CHECK(std::string(lua_tostring(L, -3)) == "key");
+        CHECK(lua_tointeger(L, -2) == 5);
+        CHECK(lua_type(L, -1) == LUA_TBOOLEAN);
+        CHECK_FALSE(lua_toboolean(L, -1));
+        lua_settop(L, 0);
+    }
+    SECTION("results not written are nil")
+    {
+        auto maybe = [](int a, LuaVar::Returns<int, int> out)
+        {
+            if (a > 0)
+                out(a, a);
+        };
+        LuaVar::CppFunction("maybe", maybe).Bind(L);
+        luaL_openlibs(L);
+        exec_lua(L, "n = select('#', maybe(-1)) a, b = maybe(-1)");
+        lua_getglobal(L, "n");
+        CHECK(lua_tointeger(L, -1) == 2);
+        CHECK(lua_getglobal(L, "a") == LUA_TNIL);
+        CHECK(lua_getglobal(L, "b") == LUA_TNIL);
+        lua_settop(L, 0);
+    }
+    SECTION("lua results read into variables")
+    {
+        exec_lua(L, "function info(x) return x * 2, 'name', 1.5, true end");
+        auto info = LuaVar::LuaFunction<void(*)(int)>("info");
+        int doubled = 0;
+        std::string name;
+        double value = 0;
+        bool flag = false;
+        CHECK(info.CallInto(L, std::tie(doubled, name, value, flag), 21));
+        CHECK(doubled == 42);
+        CHECK(name == "name");
+        CHECK(value == 1.5);
+        CHECK(flag);
+        CHECK(lua_gettop(L) == 0);
+
+        bool wrong = false;
+        CHECK_FALSE(info.CallInto(L, std::tie(doubled, wrong), 1));
+        CHECK(lua_gettop(L) == 0);
+
+        auto handle = LuaVar::Function::Global(L, "info");
+        CHECK(handle.CallInto(std::tie(doubled, name), 5));
+        CHECK(doubled == 10);
+        CHECK(lua_gettop(L) == 0);
+    }
+}
+
+TEST_CASE("Variable number of arguments")
+{
+    auto LS = LuaVar::LuaState();
+    lua_State *L = LS.Get();
+
+    SECTION("varargs converted on access")
+    {
+        auto sum = [](LuaVar::Varargs<int> values)
+        {
+            int res = 0;
+            for (int value : values)
+                res += value;
+            return res;
+        };
+        LuaVar::CppFunction("sum", sum).Bind(L);
+        exec_lua(L, "a = sum(1, 2, 3, 4) b = sum() c = sum(1, 'x')");
+        lua_getglobal(L, "a");
+        CHECK(lua_tointeger(L, -1) == 10);
+        lua_getglobal(L, "b");
+        CHECK(lua_tointeger(L, -1) == 0);
+        lua_getglobal(L, "c");
+        CHECK(std::string(lua_tostring(L, -1)) == "Invalid arguments");
+        lua_settop(L, 0);
+    }
+    SECTION("varargs after fixed parameters")
+    {
+        auto join = [](std::string separator, LuaVar::Varargs<std::string> parts)
+        {
+            std::string res;
+            for (int i = 0; i < parts.size(); ++i)
+                res += (i > 0 ? separator : "") + parts[i];
+            return res;
+        };
+        LuaVar::CppFunction("join", join).Bind(L);
+        exec_lua(L, "n = 5 s = join(', ', 'a', n, 'c')");
+        lua_getglobal(L, "s");
+        CHECK(std::string(lua_tostring(L, -1)) == "a, 5, c");
+        lua_getglobal(L, "n");
+        CHECK(lua_type(L, -1) == LUA_TNUMBER);
+        lua_settop(L, 0);
+    }
+    SECTION("varargs of optional values and with results writer")
+    {
+        auto count = [](LuaVar::Varargs<std::optional<int> > values, LuaVar::Returns<int, int> out)
+        {
+            int present = 0;
+            for (auto value : values)
+                present += value.has_value();
+            out(values.size(), present);
+        };
+        LuaVar::CppFunction("count", count).Bind(L);
+        exec_lua(L, "total, present = count(1, nil, 3, nil)");
+        lua_getglobal(L, "total");
+        CHECK(lua_tointeger(L, -1) == 4);
+        lua_getglobal(L, "present");
+        CHECK(lua_tointeger(L, -1) == 2);
+        lua_settop(L, 0);
+    }
+    SECTION("long varargs and types read through the top of the stack")
+    {
+        // variants have no runtime index overloads, their values are copied to the top of the stack
+        auto total = [](LuaVar::Varargs<int> values)
+        {
+            int res = 0;
+            for (int value : values)
+                res += value;
+            return res;
+        };
+        LuaVar::CppFunction("total", total).Bind(L);
+        // variants have no runtime index overloads, their values are copied to the top of the stack
+        auto mixed = [](LuaVar::Varargs<std::variant<int, std::string> > values)
+        {
+            int res = 0;
+            for (const auto &value : values)
+                res += std::holds_alternative<int>(value) ? std::get<int>(value) : 1000;
+            return res;
+        };
+        LuaVar::CppFunction("mixed", mixed).Bind(L);
+        std::string script = "a = total(1";
+        for (int i = 2; i <= 100; ++i)
+            script += ", " + std::to_string(i);
+        script += ") b = mixed(1, 'x', 2, 'y') c = mixed(1, {})";
+        exec_lua(L, script);
+        lua_getglobal(L, "a");
+        CHECK(lua_tointeger(L, -1) == 5050);
+        lua_getglobal(L, "b");
+        CHECK(lua_tointeger(L, -1) == 2003);
+        lua_getglobal(L, "c");
+        CHECK(std::string(lua_tostring(L, -1)) == "Invalid arguments");
+        lua_settop(L, 0);
+    }
+    SECTION("raw stack view")
+    {
+        auto describe = [](int first, LuaVar::StackView rest)
+        {
+            std::string res = std::to_string(first);
+            for (int i = 0; i < rest.size(); ++i)
+            {
+                res += ' ';
+                res += lua_typename(rest.State(), rest.Type(i));
+            }
+            if (auto number = rest.Get<double>(0))
+                res += " " + std::to_string(static_cast<int>(*number));
+            return res;
+        };
+        LuaVar::CppFunction("describe", describe).Bind(L);
+        exec_lua(L, "a = describe(1, 2.5, {}, 'x') b = describe(7)");
+        lua_getglobal(L, "a");
+        CHECK(std::string(lua_tostring(L, -1)) == "1 number table string 2");
+        lua_getglobal(L, "b");
+        CHECK(std::string(lua_tostring(L, -1)) == "7");
+        lua_settop(L, 0);
+    }
+}
+
+TEST_CASE("Shared table")
+{
+    auto LS = LuaVar::LuaState();
+    lua_State *L = LS.Get();
+    luaL_openlibs(L);
+
+    auto stats = LuaVar::SharedTable::Builder()
+            .Set("damage", 12)
+            .Set("weight", 2.5)
+            .Build();
+    auto items = LuaVar::SharedTable::Builder()
+            .Set("name", "sword")
+            .Set("stats", stats)
+            .Set("rare", true)
+            .Set(1, "first")
+            .Set(2, "second")
+            .Set(10, "tenth")
+            .Build();
+
+    SECTION("C++ lookup")
+    {
+        REQUIRE(items->Size() == 6);
+        CHECK(items->ArraySize() == 2);
+        REQUIRE(items->Find("name") != nullptr);
+        CHECK(items->Find("name")->string == "sword");
+        REQUIRE(items->Find(10) != nullptr);
+        CHECK(items->Find(10)->string == "tenth");
+        CHECK(items->Find("missing") == nullptr);
+        CHECK(items->Find(3) == nullptr);
+    }
+    SECTION("lua lookup")
+    {
+        LuaVar::SharedTable::Bind(L, "items", items);
+        exec_lua(L, R"lua(
+        name = items.name
+        damage = items.stats.damage
+        weight = items["stats"]["weight"]
+        rare = items.rare
+        second = items[2]
+        tenth = items[10.0]
+        missing = items.missing
+        len = #items
+        same = items.stats == items.stats
+        )lua");
+        lua_getglobal(L, "name");
+        CHECK(std::string(lua_tostring(L, -1)) == "sword");
+        lua_getglobal(L, "damage");
+        CHECK(lua_tointeger(L, -1) == 12);
+        lua_getglobal(L, "weight");
+        CHECK(lua_tonumber(L, -1) == 2.5);
+        lua_getglobal(L, "rare");
+        CHECK(lua_toboolean(L, -1));
+        lua_getglobal(L, "second");
+        CHECK(std::string(lua_tostring(L, -1)) == "second");
+        lua_getglobal(L, "tenth");
+        CHECK(std::string(lua_tostring(L, -1)) == "tenth");
+        lua_getglobal(L, "missing");
+        CHECK(lua_isnil(L, -1));
+        lua_getglobal(L, "len");
+        CHECK(lua_tointeger(L, -1) == 2);
+        lua_getglobal(L, "same");
+        CHECK(lua_toboolean(L, -1));
+    }
+    SECTION("read only")
+    {
+        LuaVar::SharedTable::Bind(L, "items", items);
+        CHECK(luaL_dostring(L, "items.name = 'axe'") != LUA_OK);
+        CHECK(luaL_dostring(L, "setmetatable(items, {})") != LUA_OK);
+        CHECK(items->Find("name")->string == "sword");
+    }
+    SECTION("pairs")
+    {
+        LuaVar::SharedTable::Bind(L, "items", items);
+        exec_lua(L, R"lua(
+        count = 0
+        for k, v in pairs(items) do
+            count = count + 1
+            assert(items[k] == v)
+        end
+        )lua");
+        lua_getglobal(L, "count");
+        CHECK(lua_tointeger(L, -1) == 6);
+    }
+    SECTION("snapshot lua table")
+    {
+        exec_lua(L, R"lua(
+        defs = { sword = { damage = 10, tags = { "sharp", "metal" } }, count = 2 }
+        defs.axe = defs.sword
+        )lua");
+        lua_getglobal(L, "defs");
+        auto defs = LuaVar::SharedTable::FromLua(L, -1);
+        lua_pop(L, 1);
+        REQUIRE(defs != nullptr);
+        CHECK(defs->Find("sword")->table == defs->Find("axe")->table);
+
+        auto other = LuaVar::LuaState();
+        LuaVar::SharedTable::Bind(other, "defs", defs);
+        exec_lua(other, "res = defs.axe.tags[2]");
+        lua_getglobal(other, "res");
+        CHECK(std::string(lua_tostring(other, -1)) == "metal");
+    }
+    SECTION("snapshot unsupported values")
+    {
+        exec_lua(L, "cyclic = {} cyclic.self = cyclic");
+        lua_getglobal(L, "cyclic");
+        CHECK(LuaVar::SharedTable::FromLua(L, -1) == nullptr);
+        exec_lua(L, "withfunc = { f = print }");
+        lua_getglobal(L, "withfunc");
+        CHECK(LuaVar::SharedTable::FromLua(L, -1) == nullptr);
+        lua_pop(L, 2);
+        CHECK(lua_gettop(L) == 0);
+    }
+    SECTION("table outlives builder and states")
+    {
+        std::weak_ptr<const LuaVar::SharedTable> weak = stats;
+        {
+            auto other = LuaVar::LuaState();
+            LuaVar::SharedTable::Bind(other, "items", items);
+            exec_lua(other, "stats = items.stats items = nil");
+            stats.reset();
+            items.reset();
+            lua_gc(other, LUA_GCCOLLECT, 0);
+            exec_lua(other, "res = stats.damage");
+            lua_getglobal(other, "res");
+            CHECK(lua_tointeger(other, -1) == 12);
+            CHECK(!weak.expired());
+        }
+        CHECK(weak.expired());
+    }
+    SECTION("concurrent reads from multiple states")
+    {
+        std::vector<std::thread> threads;
+        std::vector<lua_Integer> results(4);
+        for (size_t t = 0; t < results.size(); ++t)
+        {
+            threads.emplace_back([&items, &results, t]()
+            {
+                auto state = LuaVar::LuaState();
+                LuaVar::SharedTable::Bind(state, "items", items);
+                luaL_dostring(state, "res = 0 for i = 1, 10000 do res = res + items.stats.damage end");
+                lua_getglobal(state, "res");
+                results[t] = lua_tointeger(state, -1);
+            });
+        }
+        for (auto &thread: threads)
+            thread.join();
+        for (auto res: results)
+            CHECK(res == 120000);
+    }
+}
+
+TEST_CASE("Environments")
+{
+    auto LS = LuaVar::LuaState();
+    lua_State *L = LS.Get();
+    luaL_openlibs(L);
+    REQUIRE(LuaVar::Environment::LoadTemplate(L, R"lua(
+        greeting = "hello"
+        function handle(id)
+            counter = (counter or 0) + 1
+            last_id = id
+            return counter
+        end
+        function get_greeting()
+            return greeting
+        end
+    )lua"));
+    auto handle = LuaVar::LuaFunction<int(*)(int)>("handle");
+    auto get_greeting = LuaVar::LuaFunction<std::string(*)()>("get_greeting");
+
+    SECTION("template globals are visible")
+    {
+        LuaVar::Environment env(L);
+        LuaVar::Environment::Scope scope(env);
+        CHECK(get_greeting(L) == "hello");
+        REQUIRE(env.Run("res = greeting .. ' world'"));
+        env.Push();
+        lua_getfield(L, -1, "res");
+        CHECK(std::string(lua_tostring(L, -1)) == "hello world");
+    }
+    SECTION("globals don't leak between environments")
+    {
+        LuaVar::Environment first(L);
+        LuaVar::Environment second(L);
+        {
+            LuaVar::Environment::Scope scope(first);
+            CHECK(handle(L, 1) == 1);
+            CHECK(handle(L, 2) == 2);
+        }
+        {
+            LuaVar::Environment::Scope scope(second);
+            CHECK(handle(L, 3) == 1);
+        }
+        lua_getglobal(L, "counter");
+        CHECK(lua_isnil(L, -1));
+        lua_getglobal(L, "last_id");
+        CHECK(lua_isnil(L, -1));
+        // template functions work directly on the template globals outside of any environment
+        CHECK(handle(L, 4) == 1);
+    }
+    SECTION("reset drops request local data")
+    {
+        LuaVar::Environment env(L);
+        {
+            LuaVar::Environment::Scope scope(env);
+            CHECK(handle(L, 1) == 1);
+            CHECK(handle(L, 2) == 2);
+        }
+        env.Reset();
+        {
+            LuaVar::Environment::Scope scope(env);
+            CHECK(handle(L, 3) == 1);
+        }
+        CHECK(env.Run("assert(_G == _ENV) assert(greeting == 'hello')"));
+    }
+    SECTION("environment can shadow but not overwrite template globals")
+    {
+        LuaVar::Environment env(L);
+        REQUIRE(env.Run("greeting = 'bye' _G.other = 1"));
+        {
+            LuaVar::Environment::Scope scope(env);
+            CHECK(get_greeting(L) == "bye");
+        }
+        CHECK(get_greeting(L) == "hello");
+        lua_getglobal(L, "other");
+        CHECK(lua_isnil(L, -1));
+        CHECK_FALSE(env.Run("setmetatable(_ENV, nil)"));
+    }
+    SECTION("failed templates are not remembered")
+    {
+        CHECK_FALSE(LuaVar::Environment::LoadTemplate(L, "function leaked() return greeting end error('broken')"));
+        CHECK(std::string(lua_tostring(L, -1)).find("broken") != std::string::npos);
+        lua_settop(L, 0);
+        LuaVar::Environment env(L);
+        REQUIRE(env.Run("greeting = 'bye'"));
+        LuaVar::Environment::Scope scope(env);
+        CHECK(get_greeting(L) == "bye");
+        // the function of the failed chunk keeps using the template globals
+        CHECK(LuaVar::LuaFunction<std::string(*)()>("leaked")(L) == "hello");
+        CHECK(lua_gettop(L) == 0);
+    }
+    SECTION("nested scopes restore the outer environment")
+    {
+        LuaVar::Environment outer(L);
+        LuaVar::Environment inner(L);
+        {
+            LuaVar::Environment::Scope outerScope(outer);
+            CHECK(handle(L, 1) == 1);
+            {
+                LuaVar::Environment::Scope innerScope(inner);
+                CHECK(handle(L, 2) == 1);
+            }
+            CHECK(handle(L, 3) == 2);
+            lua_getglobal(L, "counter");
+            CHECK(lua_isnil(L, -1));
+            lua_pop(L, 1);
+        }
+        CHECK(handle(L, 4) == 1);
+        CHECK(lua_gettop(L) == 0);
+    }
+    SECTION("moved environment keeps the table")
+    {
+        LuaVar::Environment env(L);
+        REQUIRE(env.Run("value = 5"));
+        LuaVar::Environment moved = std::move(env);
+        CHECK(moved.Run("assert(value == 5)"));
+    }
+}
+
+TEST_CASE("Garbage collector control")
+{
+    auto LS = LuaVar::LuaState();
+    lua_State *L = LS.Get();
+    const char *garbage = "for i = 1, 10000 do local t = { i, tostring(i) } end";
+    luaL_openlibs(L);
+
+    SECTION("mode switching")
+    {
+        CHECK(LS.GetGcMode() == LuaVar::GcMode::Incremental);
+        LS.UseGenerationalGc({20, 100});
+        CHECK(LS.GetGcMode() == LuaVar::GcMode::Generational);
+        CHECK(lua_gc(L, LUA_GCINC, 0, 0, 0) == LUA_GCGEN);
+        LS.UseIncrementalGc({150, 200, 10});
+        CHECK(LS.GetGcMode() == LuaVar::GcMode::Incremental);
+        CHECK(lua_gc(L, LUA_GCINC, 0, 0, 0) == LUA_GCINC);
+    }
+    SECTION("collections are counted")
+    {
+        auto before = LS.GetGcStats();
+        CHECK(before.heapBytes > 0);
+        LS.Collect();
+        LS.Collect();
+        auto after = LS.GetGcStats();
+        CHECK(after.collections >= before.collections + 2);
+        CHECK(after.explicitRuns == before.explicitRuns + 2);
+        CHECK(after.totalPause >= after.maxPause);
+        CHECK(after.maxPause >= after.lastPause);
+    }
+    SECTION("automatic collections are counted in both modes")
+    {
+        for (bool generational: {false, true})
+        {
+            if (generational)
+                LS.UseGenerationalGc();
+            auto before = LS.GetGcStats().collections;
+            exec_lua(L, garbage);
+            CHECK(LS.GetGcStats().collections > before);
+        }
+    }
+    SECTION("stepping stopped collector")
+    {
+        LS.SetGcRunning(false);
+        CHECK_FALSE(LS.IsGcRunning());
+        auto before = LS.GetGcStats();
+        exec_lua(L, garbage);
+        CHECK(LS.GetGcStats().collections == before.collections);
+        CHECK(LS.GetGcStats().heapBytes > before.heapBytes);
+
+        bool completed = false;
+        for (int i = 0; i < 10000 && !completed; ++i)
+        {
+            completed = LS.StepGc(std::chrono::microseconds(100));
+        }
+        CHECK(completed);
+        CHECK_FALSE(LS.IsGcRunning());
+        auto after = LS.GetGcStats();
+        CHECK(after.collections > before.collections);
+        CHECK(after.explicitRuns > before.explicitRuns);
+        LS.SetGcRunning(true);
+        CHECK(LS.IsGcRunning());
+    }
+}
+
+TEST_CASE("Memory limits")
+{
+    const char *hog = "local t = {} for i = 1, 1000000 do t[i] = tostring(i) end";
+
+    SECTION("usage and peak are tracked")
+    {
+        auto LS = LuaVar::LuaState();
+        lua_State *L = LS.Get();
+        luaL_openlibs(L);
+        auto before = LS.GetMemoryStats();
+        CHECK(before.usedBytes > 0);
+        CHECK(before.limitBytes == 0);
+        exec_lua(L, "local t = {} for i = 1, 10000 do t[i] = tostring(i) end");
+        LS.Collect();
+        auto after = LS.GetMemoryStats();
+        CHECK(after.peakBytes > before.peakBytes + 10000 * 16);
+        CHECK(after.usedBytes < after.peakBytes);
+        CHECK(after.usedBytes == LS.GetGcStats().heapBytes);
+        LS.ResetPeakMemory();
+        CHECK(LS.GetMemoryStats().peakBytes == after.usedBytes);
+    }
+    SECTION("exceeding the limit raises lua memory error")
+    {
+        auto LS = LuaVar::LuaState({.memoryLimit = 1024 * 1024});
+        lua_State *L = LS.Get();
+        luaL_openlibs(L);
+        REQUIRE(luaL_loadstring(L, hog) == LUA_OK);
+        CHECK(lua_pcall(L, 0, 0, 0) == LUA_ERRMEM);
+        lua_settop(L, 0);
+        auto stats = LS.GetMemoryStats();
+        CHECK(stats.failedAllocations > 0);
+        CHECK(stats.peakBytes <= 1024 * 1024);
+
+        // the state stays usable
+        LS.Collect();
+        exec_lua(L, "x = #tostring(12345)");
+        lua_getglobal(L, "x");
+        CHECK(lua_tointeger(L, -1) == 5);
+        lua_settop(L, 0);
+
+        LS.SetMemoryLimit(0);
+        exec_lua(L, hog);
+    }
+    SECTION("callback when usage crosses the threshold")
+    {
+        std::vector<size_t> crossings;
+        auto LS = LuaVar::LuaState({
+            .memoryThreshold = 4 * 1024 * 1024,
+            .onMemoryThreshold = [&crossings](size_t used) { crossings.push_back(used); }
+        });
+        lua_State *L = LS.Get();
+        luaL_openlibs(L);
+        exec_lua(L, "t = {} for i = 1, 200000 do t[i] = tostring(i) end");
+        REQUIRE(crossings.size() == 1);
+        CHECK(crossings[0] >= 4 * 1024 * 1024);
+
+        exec_lua(L, "t = nil");
+        LS.Collect();
+        CHECK(crossings.size() == 1);
+        exec_lua(L, "t = {} for i = 1, 200000 do t[i] = tostring(i) end");
+        CHECK(crossings.size() == 2);
+
+        LS.SetMemoryThreshold(0, nullptr);
+        exec_lua(L, "t = nil");
+        LS.Collect();
+        exec_lua(L, "t = {} for i = 1, 200000 do t[i] = tostring(i) end");
+        CHECK(crossings.size() == 2);
+    }
+}
+
+TEST_CASE("Execution budgets")
+{
+    auto LS = LuaVar::LuaState();
+    lua_State *L = LS.Get();
+    luaL_openlibs(L);
+
+    SECTION("unlimited by default")
+    {
+        CHECK(LS.Run("local s = 0 for i = 1, 100000 do s = s + i end result = s") == LUA_OK);
+        CHECK_FALSE(LS.BudgetExceeded());
+        CHECK(lua_gethook(L) == nullptr);
+    }
+    SECTION("instruction budget aborts infinite loop")
+    {
+        CHECK(LS.Run("while true do end", {.instructions = 100000}) == LUA_ERRRUN);
+        CHECK(std::string(lua_tostring(L, -1)).find("execution budget exceeded") != std::string::npos);
+        CHECK(LS.BudgetExceeded());
+        lua_settop(L, 0);
+        CHECK(lua_gethook(L) == nullptr);
+
+        // the next call starts with a fresh budget
+        CHECK(LS.Run("local s = 0 for i = 1, 1000 do s = s + i end", {.instructions = 100000}) == LUA_OK);
+        CHECK_FALSE(LS.BudgetExceeded());
+    }
+    SECTION("wall time budget")
+    {
+        auto start = std::chrono::steady_clock::now();
+        CHECK(LS.Run("while true do end", {.wallTime = std::chrono::milliseconds(20)}) == LUA_ERRRUN);
+        CHECK(LS.BudgetExceeded());
+        CHECK(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(20));
+        lua_settop(L, 0);
+    }
+    SECTION("script can't catch the budget error")
+    {
+        CHECK(LS.Run("while true do pcall(function() while true do end end) caught = true end",
+            {.instructions = 100000, .checkInterval = 100}) == LUA_ERRRUN);
+        CHECK(LS.BudgetExceeded());
+        lua_settop(L, 0);
+    }
+    SECTION("default budget applies to protected calls")
+    {
+        LS.SetExecutionBudget({.instructions = 50000});
+        exec_lua(L, "function spin(n) for i = 1, n do end return n end");
+        lua_getglobal(L, "spin");
+        lua_pushinteger(L, 100);
+        REQUIRE(LS.PCall(1, 1) == LUA_OK);
+        CHECK(lua_tointeger(L, -1) == 100);
+        lua_settop(L, 0);
+
+        lua_getglobal(L, "spin");
+        lua_pushinteger(L, 1000000);
+        CHECK(LS.PCall(1, 1) == LUA_ERRRUN);
+        CHECK(LS.BudgetExceeded());
+        lua_settop(L, 0);
+
+        // explicit budget overrides the default one
+        lua_getglobal(L, "spin");
+        lua_pushinteger(L, 1000000);
+        CHECK(LS.PCall(1, 1, {}) == LUA_OK);
+        lua_settop(L, 0);
+    }
+    SECTION("bound functions calling back into lua share the budget")
+    {
+        auto nested = [&LS](int n)
+        {
+            lua_State *L = LS.Get();
+            lua_getglobal(L, "spin");
+            lua_pushinteger(L, n);
+            const int status = LS.PCall(1, 0);
+            if (status != LUA_OK)
+                lua_pop(L, 1);
+            return status;
+        };
+        LuaVar::CppFunction("nested", nested).Bind(L);
+        exec_lua(L, "function spin(n) for i = 1, n do end end");
+        CHECK(LS.Run("status = nested(1000000) while true do end", {.instructions = 100000}) == LUA_ERRRUN);
+        lua_getglobal(L, "status");
+        CHECK(lua_isnil(L, -1));
+        lua_settop(L, 0);
+    }
+    SECTION("coroutines created before the call are limited")
+    {
+        CHECK(LS.Run("co = coroutine.wrap(function() while true do end end)") == LUA_OK);
+        CHECK(LS.Run("co()", {.instructions = 100000, .checkInterval = 100}) == LUA_ERRRUN);
+        CHECK(LS.BudgetExceeded());
+        lua_settop(L, 0);
+
+        CHECK(LS.Run("th = coroutine.create(function() while true do end end)") == LUA_OK);
+        CHECK(LS.Run("ok, err = coroutine.resume(th)", {.instructions = 100000, .checkInterval = 100}) ==
+              LUA_ERRRUN);
+        CHECK(LS.BudgetExceeded());
+        lua_settop(L, 0);
+    }
+    SECTION("hook of the embedder is restored")
+    {
+        static int calls = 0;
+        calls = 0;
+        lua_Hook counter = [](lua_State */*L*/, lua_Debug */*ar*/) { ++calls; };
+        lua_sethook(L, counter, LUA_MASKCOUNT, 1);
+        CHECK(LS.Run("while true do end", {.instructions = 100000}) == LUA_ERRRUN);
+        lua_settop(L, 0);
+        CHECK(lua_gethook(L) == counter);
+        CHECK(lua_gethookmask(L) == LUA_MASKCOUNT);
+        CHECK(lua_gethookcount(L) == 1);
+        calls = 0;
+        CHECK(LS.Run("local s = 0 for i = 1, 10 do s = s + i end") == LUA_OK);
+        CHECK(calls > 0);
+        lua_sethook(L, nullptr, 0, 0);
+    }
+    SECTION("only resumed threads get the hook")
+    {
+        CHECK(LS.Run("th = coroutine.create(function() end)") == LUA_OK);
+        CHECK(LS.Run("status = coroutine.status(th)", {.instructions = 100000}) == LUA_OK);
+        lua_getglobal(L, "th");
+        CHECK(lua_gethook(lua_tothread(L, -1)) == nullptr);
+        lua_settop(L, 0);
+    }
+    SECTION("coroutines resumed after the call are not limited")
+    {
+        CHECK(LS.Run("co = coroutine.wrap(function() for i = 1, 1000000 do end return 1 end)",
+            {.instructions = 1000, .checkInterval = 10}) == LUA_OK);
+        CHECK(LS.Run("value = co()") == LUA_OK);
+        lua_getglobal(L, "value");
+        CHECK(lua_tointeger(L, -1) == 1);
+        lua_settop(L, 0);
+    }
+}
+
+TEST_CASE("Standard libraries")
+{
+    auto global_type = [](lua_State *L, const char *name)
+    {
+        const int type = lua_getglobal(L, name);
+        lua_pop(L, 1);
+        return type;
+    };
+    // without triggering lazy loading
+    auto raw_global_type = [](lua_State *L, const char *name)
+    {
+        lua_pushglobaltable(L);
+        lua_pushstring(L, name);
+        const int type = lua_rawget(L, -2);
+        lua_pop(L, 2);
+        return type;
+    };
+
+    SECTION("bare state by default")
+    {
+        auto LS = LuaVar::LuaState();
+        CHECK(global_type(LS, "print") == LUA_TNIL);
+        CHECK(global_type(LS, "string") == LUA_TNIL);
+    }
+    SECTION("selected libraries")
+    {
+        auto LS = LuaVar::LuaState({.libraries = LuaVar::LuaLibraryBase | LuaVar::LuaLibraryString});
+        CHECK(global_type(LS, "print") == LUA_TFUNCTION);
+        CHECK(global_type(LS, "string") == LUA_TTABLE);
+        CHECK(global_type(LS, "math") == LUA_TNIL);
+        CHECK(global_type(LS, "io") == LUA_TNIL);
+        CHECK(LS.Run("x = ('%d'):format(5)") == LUA_OK);
+    }
+    SECTION("lazy libraries are opened on first access")
+    {
+        auto LS = LuaVar::LuaState({
+            .libraries = LuaVar::LuaLibraryBase,
+            .lazyLibraries = LuaVar::LuaLibraryMath | LuaVar::LuaLibraryPackage | LuaVar::LuaLibraryTable
+        });
+        lua_State *L = LS.Get();
+        CHECK(raw_global_type(L, "math") == LUA_TNIL);
+
+        CHECK(LS.Run("x = math.floor(2.5) y = math.pi") == LUA_OK);
+        lua_getglobal(L, "x");
+        CHECK(lua_tointeger(L, -1) == 2);
+        CHECK(raw_global_type(L, "math") == LUA_TTABLE);
+        lua_settop(L, 0);
+
+        CHECK(global_type(L, "require") == LUA_TFUNCTION);
+        CHECK(global_type(L, "undefined_global") == LUA_TNIL);
+        CHECK(global_type(L, "io") == LUA_TNIL);
+
+        // metatable is dropped once every lazy library is loaded
+        lua_pushglobaltable(L);
+        CHECK(lua_getmetatable(L, -1) == 1);
+        lua_settop(L, 0);
+        CHECK(global_type(L, "table") == LUA_TTABLE);
+        lua_pushglobaltable(L);
+        CHECK(lua_getmetatable(L, -1) == 0);
+        lua_settop(L, 0);
+    }
+    SECTION("string methods load the lazy string library")
+    {
+        auto LS = LuaVar::LuaState({.libraries = LuaVar::LuaLibraryBase, .lazyLibraries = LuaVar::LuaLibraryString});
+        lua_State *L = LS.Get();
+        CHECK(raw_global_type(L, "string") == LUA_TNIL);
+
+        REQUIRE(LS.Run("x = ('abc'):upper() y = ('%d'):format(5) z = string.rep('a', 2)") == LUA_OK);
+        lua_getglobal(L, "x");
+        CHECK(std::string(lua_tostring(L, -1)) == "ABC");
+        lua_getglobal(L, "y");
+        CHECK(std::string(lua_tostring(L, -1)) == "5");
+        lua_getglobal(L, "z");
+        CHECK(std::string(lua_tostring(L, -1)) == "aa");
+        CHECK(raw_global_type(L, "string") == LUA_TTABLE);
+        lua_settop(L, 0);
+    }
+    SECTION("fewer libraries use less memory")
+    {
+        auto minimal = LuaVar::LuaState({.libraries = LuaVar::LuaLibraryBase});
+        auto full = LuaVar::LuaState({.libraries = LuaVar::LuaLibraryAll});
+        CHECK(minimal.GetMemoryStats().usedBytes < full.GetMemoryStats().usedBytes);
+        CHECK(global_type(full, "debug") == LUA_TTABLE);
+    }
+}
+
+struct Entity
+{
+    static inline int alive = 0;
+    int id;
+
+    explicit Entity(int id) : id(id)
+    {
+        ++alive;
+    }
+
+    ~Entity()
+    {
+        --alive;
+    }
+};
+
+TEST_CASE("Objects passed by pointer")
+{
+    auto LS = LuaVar::LuaState();
+    lua_State *L = LS.Get();
+    Entity::alive = 0;
+
+    SECTION("raw pointers keep identity")
+    {
+        Entity first(1), second(2);
+        auto find = [&first, &second](int id) { return id == 1 ? &first : id == 2 ? &second : nullptr; };
+        auto id_of = [](Entity *entity) { return entity != nullptr ? entity->id : -1; };
+        LuaVar::CppFunction("find", find).Bind(L);
+        LuaVar::CppFunction("id_of", id_of).Bind(L);
+        exec_lua(L, "same = find(1) == find(1) different = find(1) ~= find(2) "
+                 "a = id_of(find(2)) b = id_of(nil) missing = find(3) bad = id_of(5)");
+        for (const char *name: {"same", "different"})
+        {
+            lua_getglobal(L, name);
+            CHECK(lua_toboolean(L, -1));
+        }
+        lua_getglobal(L, "a");
+        CHECK(lua_tointeger(L, -1) == 2);
+        lua_getglobal(L, "b");
+        CHECK(lua_tointeger(L, -1) == -1);
+        CHECK(lua_getglobal(L, "missing") == LUA_TNIL);
+        lua_getglobal(L, "bad");
+        CHECK(std::string(lua_tostring(L, -1)) == "Invalid arguments");
+        lua_settop(L, 0);
+
+        // objects of other types are rejected
+        auto text = std::make_shared<std::string>("text");
+        auto get_text = [text] { return text; };
+        LuaVar::CppFunction("get_text", get_text).Bind(L);
+        exec_lua(L, "wrong = id_of(get_text())");
+        lua_getglobal(L, "wrong");
+        CHECK(std::string(lua_tostring(L, -1)) == "Invalid arguments");
+        lua_settop(L, 0);
+    }
+    SECTION("shared ownership")
+    {
+        auto session = std::make_shared<Entity>(7);
+        std::shared_ptr<Entity> received;
+        auto get = [session] { return session; };
+        auto keep = [&received](std::shared_ptr<Entity> entity) { received = std::move(entity); };
+        LuaVar::CppFunction("get", get).Bind(L);
+        LuaVar::CppFunction("keep", keep).Bind(L);
+        exec_lua(L, "held = get() same = held == get()");
+        lua_getglobal(L, "same");
+        CHECK(lua_toboolean(L, -1));
+        lua_settop(L, 0);
+        // the lambda, its copy bound to lua and the userdata held by the script
+        CHECK(session.use_count() == 4);
+
+        exec_lua(L, "keep(held) held = nil");
+        CHECK(received == session);
+        LS.Collect();
+        LS.Collect();
+        CHECK(session.use_count() == 4);
+        received.reset();
+        CHECK(session.use_count() == 3);
+    }
+    SECTION("unique ownership is transferred")
+    {
+        std::unique_ptr<Entity> adopted;
+        auto make = [](int id) { return std::make_unique<Entity>(id); };
+        auto adopt = [&adopted](std::unique_ptr<Entity> entity) { adopted = std::move(entity); };
+        auto id_of = [](Entity *entity) { return entity != nullptr ? entity->id : -1; };
+        LuaVar::CppFunction("make", make).Bind(L);
+        LuaVar::CppFunction("adopt", adopt).Bind(L);
+        LuaVar::CppFunction("id_of", id_of).Bind(L);
+
+        exec_lua(L, "make(1) kept = make(2) taken = make(3)");
+        LS.Collect();
+        LS.Collect();
+        CHECK(Entity::alive == 2);
+
+        exec_lua(L, "adopt(taken) after = id_of(taken) again = adopt(taken)");
+        REQUIRE(adopted != nullptr);
+        CHECK(adopted->id == 3);
+        // the userdata left behind is no longer a valid object, not even for raw pointer parameters
+        lua_getglobal(L, "after");
+        CHECK(std::string(lua_tostring(L, -1)) == "Invalid arguments");
+        lua_getglobal(L, "again");
+        CHECK(std::string(lua_tostring(L, -1)) == "Invalid arguments");
+        lua_settop(L, 0);
+
+        exec_lua(L, "kept = nil taken = nil");
+        LS.Collect();
+        LS.Collect();
+        CHECK(Entity::alive == 1);
+        adopted.reset();
+        CHECK(Entity::alive == 0);
+    }
+}
+
+TEST_CASE("Function validation")
+{
+    auto LS = LuaVar::LuaState();
+    lua_State *L = LS.Get();
+    exec_lua(L, "function add(a, b) return a + b end "
+             "function sum(...) local s = 0 for _, v in ipairs({...}) do s = s + v end return s end "
+             "not_function = 5");
+
+    constexpr auto Add = LuaVar::LuaFunction<int(*)(int, int)>("add");
+    auto AddArity = LuaVar::LuaFunction<int(*)(int, int)>("add").Flags(LuaVar::LuaFlags<LuaVar::LuaCallCheckArity>{});
+    auto WrongArity = LuaVar::LuaFunction<int(*)(int)>("add").Flags(LuaVar::LuaFlags<LuaVar::LuaCallCheckArity>{});
+    auto Sum = LuaVar::LuaFunction<int(*)(int, int, int)>("sum").Flags(LuaVar::LuaFlags<LuaVar::LuaCallCheckArity>{});
+    constexpr auto Missing = LuaVar::LuaFunction<void(*)()>("missing");
+    constexpr auto NotFunction = LuaVar::LuaFunction<void(*)()>("not_function");
+
+    SECTION("problems are reported")
+    {
+        auto errors = LuaVar::ValidateFunctions(L, Add, AddArity, WrongArity, Sum, Missing, NotFunction);
+        REQUIRE(errors.size() == 3);
+        CHECK(errors[0] == "add takes 2 parameters, declared with 1");
+        CHECK(errors[1] == "missing is not defined");
+        CHECK(errors[2] == "not_function is not a function");
+        CHECK(LuaVar::ValidateFunctions(L, Add, AddArity, Sum).empty());
+        CHECK(lua_gettop(L) == 0);
+    }
+    SECTION("validated functions are cached")
+    {
+        auto add = LuaVar::LuaFunction<int(*)(int, int)>("add").Flags(LuaVar::LuaFlags<LuaVar::LuaCallValidated>{});
+        REQUIRE(LuaVar::ValidateFunctions(L, Add, add).empty());
+        CHECK(add(L, 2, 3) == 5);
+
+        // the cached function is called even after the global changes
+        exec_lua(L, "add = nil");
+        CHECK(add(L, 4, 3) == 7);
+        int res = 0;
+        CHECK(add.CallInto(L, std::tie(res), 1, 1));
+        CHECK(res == 2);
+        CHECK(lua_gettop(L) == 0);
+
+        add.Invalidate(L);
+        CHECK(LuaVar::ValidateFunctions(L, add).size() == 1);
+        exec_lua(L, "function add(a, b) return a * b end");
+        CHECK(LuaVar::ValidateFunctions(L, add).empty());
+        CHECK(add(L, 4, 3) == 12);
+    }
+    SECTION("functions without LuaCallValidated call the global")
+    {
+        REQUIRE(LuaVar::ValidateFunctions(L, Add).empty());
+        exec_lua(L, "function add(a, b) return a - b end");
+        CHECK(Add(L, 4, 3) == 1);
+        CHECK(lua_gettop(L) == 0);
+    }
+}
+
+TEST_CASE("Hot reload")
+{
+    auto LS = LuaVar::LuaState({.libraries = LuaVar::LuaLibraryBase});
+    lua_State *L = LS.Get();
+    constexpr auto Handle = LuaVar::LuaFunction<int(*)(int)>("handle").Flags(
+        LuaVar::LuaFlags<LuaVar::LuaCallValidated>{});
+    auto Version = LuaVar::LuaFunction<int(*)()>("version").Flags(
+        LuaVar::LuaFlags<LuaVar::LuaCallCheckArity | LuaVar::LuaCallValidated>{});
+    LuaVar::HotReload scripts(L, Handle, Version);
+    const char *v1 = "function handle(x) return x + 1 end function version() return 1 end";
+    const char *v2 = "function handle(x) return x + 2 end function version() return 2 end";
+
+    REQUIRE(scripts.Load(v1).empty());
+    CHECK(scripts.Epoch() == 1);
+    CHECK(Handle(L, 10) == 11);
+    CHECK(Version(L) == 1);
+    // script globals stay in the environment of the version
+    CHECK(lua_getglobal(L, "handle") == LUA_TNIL);
+    lua_pop(L, 1);
+
+    SECTION("swap waits for the end of the request")
+    {
+        {
+            LuaVar::HotReload::Request request(scripts);
+            CHECK(Handle(L, 10) == 11);
+            REQUIRE(scripts.Load(v2).empty());
+            CHECK(scripts.HasPending());
+            CHECK(Handle(L, 10) == 11);
+            CHECK(Version(L) == 1);
+        }
+        CHECK_FALSE(scripts.HasPending());
+        CHECK(scripts.Epoch() == 2);
+        CHECK(Handle(L, 10) == 12);
+        CHECK(Version(L) == 2);
+    }
+    SECTION("calls in flight finish on the old version")
+    {
+        auto reload = [&scripts, v2] { return scripts.Load(v2).empty(); };
+        LuaVar::CppFunction("reload", reload).Bind(L);
+        REQUIRE(scripts.Load("function handle(x) reload() return version() * 100 + x end "
+                             "function version() return 1 end").empty());
+        // the caller's chunk keeps its own `version`, the swapped function is used only by the next call
+        CHECK(Handle(L, 5) == 105);
+        CHECK(Handle(L, 5) == 7);
+    }
+    SECTION("invalid versions are rejected")
+    {
+        auto errors = scripts.Load("function handle(x) return x end");
+        REQUIRE(errors.size() == 1);
+        CHECK(errors[0] == "version is not defined");
+        errors = scripts.Load("function handle(x) return x end function version(a) return a end");
+        REQUIRE(errors.size() == 1);
+        CHECK(errors[0] == "version takes 1 parameters, declared with 0");
+        CHECK(scripts.Load("function handle(").size() == 1);
+        CHECK(scripts.Load("error('failed to start')").size() == 1);
+        errors = scripts.Load("function handle(x) return x end error({})");
+        REQUIRE(errors.size() == 1);
+        CHECK(errors[0] == "error object is not a string");
+        CHECK(lua_gettop(L) == 0);
+        CHECK(scripts.Epoch() == 1);
+        CHECK(Handle(L, 10) == 11);
+    }
+    SECTION("environment of the active version")
+    {
+        REQUIRE(scripts.Load("counter = 5 function handle(x) counter = counter + x return counter end "
+                             "function version() return tonumber('3') end").empty());
+        CHECK(Handle(L, 1) == 6);
+        CHECK(Version(L) == 3);
+        scripts.PushEnvironment();
+        lua_getfield(L, -1, "counter");
+        CHECK(lua_tointeger(L, -1) == 6);
+        lua_settop(L, 0);
+    }
+}
+
+enum class Direction
+{
+    North,
+    East = 5,
+    South,
+    West
+};
+
+template<>
+struct LuaVar::EnumNames<Direction>
+{
+    static constexpr std::array Values{
+        std::pair{Direction::North, std::string_view("north")},
+        std::pair{Direction::East, std::string_view("east")},
+        std::pair{Direction::South, std::string_view("south")},
+        std::pair{Direction::West, std::string_view("a_direction_with_a_name_longer_than_forty_characters")}
+    };
+};
+
+enum Permission : unsigned
+{
+    PermissionRead = 1,
+    PermissionWrite = 2,
+    PermissionExecute = 4
+};
+
+template<>
+struct LuaVar::EnumNames<Permission>
+{
+    static constexpr bool Flags = true;
+    static constexpr std::array Values{
+        std::pair{PermissionRead, "read"},
+        std::pair{PermissionWrite, "write"},
+        std::pair{PermissionExecute, "execute"}
+    };
+};
+
+enum class Unnamed
+{
+    First = 1,
+    Second = 2
+};
+
+TEST_CASE("Enum values")
+{
+    auto LS = LuaVar::LuaState();
+    lua_State *L = LS.Get();
+
+    SECTION("named enums accept names and integers")
+    {
+        auto turn = [](Direction direction)
+        {
+            switch (direction)
+            {
+                case Direction::North:
+                    return Direction::East;
+                case Direction::East:
+                    return Direction::South;
+                case Direction::South:
+                    return Direction::West;
+                default:
+                    return Direction::North;
+            }
+        };
+        LuaVar::CppFunction("turn", turn).Bind(L);
+        exec_lua(L, "a = turn('north') b = turn(6) c = turn('a_direction_with_a_name_longer_than_forty_characters') "
+                 "d = turn('up') e = turn(3)");
+        lua_getglobal(L, "a");
+        CHECK(std::string(lua_tostring(L, -1)) == "east");
+        lua_getglobal(L, "b");
+        CHECK(lua_type(L, -1) == LUA_TSTRING);
+        CHECK(std::string(lua_tostring(L, -1)) == "a_direction_with_a_name_longer_than_forty_characters");
+        lua_getglobal(L, "c");
+        CHECK(std::string(lua_tostring(L, -1)) == "north");
+        for (const char *invalid: {"d", "e"})
+        {
+            lua_getglobal(L, invalid);
+            CHECK(std::string(lua_tostring(L, -1)) == "Invalid arguments");
+        }
+        lua_settop(L, 0);
+    }
+    SECTION("flags")
+    {
+        auto describe = [](Permission permission) { return static_cast<int>(permission); };
+        LuaVar::CppFunction("describe", describe).Bind(L);
+        exec_lua(L, "a = describe('write') b = describe({'read', 'execute'}) c = describe(3) d = describe({}) "
+                 "e = describe({'read', 'delete'})");
+        lua_getglobal(L, "a");
+        CHECK(lua_tointeger(L, -1) == 2);
+        lua_getglobal(L, "b");
+        CHECK(lua_tointeger(L, -1) == 5);
+        lua_getglobal(L, "c");
+        CHECK(lua_tointeger(L, -1) == 3);
+        lua_getglobal(L, "d");
+        CHECK(lua_tointeger(L, -1) == 0);
+        lua_getglobal(L, "e");
+        CHECK(std::string(lua_tostring(L, -1)) == "Invalid arguments");
+        lua_settop(L, 0);
+
+        auto all = [] { return static_cast<Permission>(PermissionRead | PermissionWrite); };
+        LuaVar::CppFunction("all", all).Bind(L);
+        exec_lua(L, "f = all()");
+        lua_getglobal(L, "f");
+        CHECK(lua_tointeger(L, -1) == 3);
+        lua_settop(L, 0);
+    }
+    SECTION("enums without names are integers")
+    {
+        auto next = [](Unnamed value) { return value == Unnamed::First ? Unnamed::Second : Unnamed::First; };
+        LuaVar::CppFunction("next", next).Bind(L);
+        exec_lua(L, "a = next(1) b = next('First')");
+        lua_getglobal(L, "a");
+        CHECK(lua_tointeger(L, -1) == 2);
+        lua_getglobal(L, "b");
+        CHECK(std::string(lua_tostring(L, -1)) == "Invalid arguments");
+        lua_settop(L, 0);
+    }
+    SECTION("optional and handles")
+    {
+        auto table = LuaVar::Table::Create(L);
+        table.Set("heading", Direction::South);
+        CHECK(table.Get<std::string>("heading") == "south");
+        CHECK(table.Get<Direction>("heading") == Direction::South);
+        auto pick = [](std::optional<Direction> direction) { return direction.value_or(Direction::East); };
+        LuaVar::CppFunction("pick", pick).Bind(L);
+        exec_lua(L, "a = pick()");
+        lua_getglobal(L, "a");
+        CHECK(std::string(lua_tostring(L, -1)) == "east");
+        lua_settop(L, 0);
+    }
+}
+
+TEST_CASE("Properties")
+{
+    auto LS = LuaVar::LuaState();
+    lua_State *L = LS.Get();
+    int frame = 7;
+    double gravity = 9.81;
+    std::string level = "intro";
+    const int version = 3;
+    LuaVar::PropertyTable tunables("tunables", {
+                                       LuaVar::Property("frame", &frame).ReadOnly(),
+                                       LuaVar::Property("gravity", &gravity),
+                                       LuaVar::Property("level", &level),
+                                       LuaVar::Property("version", &version)
+                                   });
+    tunables.Bind(L);
+
+    SECTION("fields read and write the variables")
+    {
+        exec_lua(L, "a = tunables.frame b = tunables.gravity tunables.gravity = 1.5 tunables.level = 'cave' "
+                 "c = tunables.missing tunables.custom = 'x' d = tunables.custom");
+        lua_getglobal(L, "a");
+        CHECK(lua_tointeger(L, -1) == 7);
+        lua_getglobal(L, "b");
+        CHECK(lua_tonumber(L, -1) == 9.81);
+        lua_getglobal(L, "c");
+        CHECK(lua_isnil(L, -1));
+        lua_getglobal(L, "d");
+        CHECK(std::string(lua_tostring(L, -1)) == "x");
+        lua_settop(L, 0);
+        CHECK(gravity == 1.5);
+        CHECK(level == "cave");
+
+        frame = 8;
+        exec_lua(L, "e = tunables.frame");
+        lua_getglobal(L, "e");
+        CHECK(lua_tointeger(L, -1) == 8);
+        lua_settop(L, 0);
+    }
+    SECTION("invalid assignments raise errors")
+    {
+        for (const char *script: {"tunables.frame = 1", "tunables.version = 4", "tunables.gravity = 'high'",
+                                  "setmetatable(tunables, nil)"})
+        {
+            luaL_openlibs(L);
+            REQUIRE(luaL_dostring(L, script) != LUA_OK);
+            lua_settop(L, 0);
+        }
+        CHECK(frame == 7);
+        CHECK(gravity == 9.81);
+    }
+    SECTION("long names are matched by content")
+    {
+        int limit = 1;
+        LuaVar::PropertyTable limits("limits", {
+                                         LuaVar::Property("maximum_number_of_simultaneously_active_particles", &limit)
+                                     });
+        limits.Bind(L);
+        exec_lua(L, "limits.maximum_number_of_simultaneously_active_particles = 500 "
+                 "a = limits['maximum_number_of_' .. 'simultaneously_active_particles']");
+        CHECK(limit == 500);
+        lua_getglobal(L, "a");
+        CHECK(lua_tointeger(L, -1) == 500);
+        lua_settop(L, 0);
+    }
+    SECTION("snapshots")
+    {
+        tunables.PushSnapshot(L);
+        lua_setglobal(L, "snapshot");
+        exec_lua(L, "a = snapshot.gravity + snapshot.version snapshot.gravity = 0");
+        CHECK(gravity == 9.81);
+        lua_getglobal(L, "a");
+        CHECK(lua_tonumber(L, -1) == 9.81 + 3);
+        lua_settop(L, 0);
+
+        gravity = 2.0;
+        level = "boss";
+        lua_getglobal(L, "snapshot");
+        tunables.UpdateSnapshot(L, -1);
+        lua_pop(L, 1);
+        exec_lua(L, "b = snapshot.gravity c = snapshot.level");
+        lua_getglobal(L, "b");
+        CHECK(lua_tonumber(L, -1) == 2.0);
+        lua_getglobal(L, "c");
+        CHECK(std::string(lua_tostring(L, -1)) == "boss");
+        lua_settop(L, 0);
+    }
+}
+
+TEST_CASE("Lua callbacks")
+{
+    auto LS = LuaVar::LuaState();
+    lua_State *L = LS.Get();
+    std::vector<LuaVar::Callback<int(int)> > handlers;
+    auto register_handler = [&handlers](LuaVar::Callback<int(int)> handler)
+    {
+        handlers.push_back(handler);
+        return static_cast<int>(handlers.size());
+    };
+    LuaVar::CppFunction("register_handler", register_handler).Bind(L);
+
+    SECTION("callbacks are stored and called later")
+    {
+        exec_lua(L, "total = 0 register_handler(function(x) total = total + x return x * 2 end) "
+                 "register_handler(function(x) return x + 1 end)");
+        REQUIRE(handlers.size() == 2);
+        CHECK(handlers[0](5) == 10);
+        CHECK(handlers[1](5) == 6);
+        auto copy = handlers[0];
+        handlers.clear();
+        lua_gc(L, LUA_GCCOLLECT);
+        CHECK(copy(1) == 2);
+        lua_getglobal(L, "total");
+        CHECK(lua_tointeger(L, -1) == 6);
+        lua_settop(L, 0);
+    }
+    SECTION("nil and invalid values")
+    {
+        exec_lua(L, "a = register_handler(nil) b = register_handler(42)");
+        REQUIRE(handlers.size() == 1);
+        CHECK_FALSE(handlers[0]);
+        lua_getglobal(L, "b");
+        CHECK(std::string(lua_tostring(L, -1)) == "Invalid arguments");
+        lua_settop(L, 0);
+
+        LuaVar::Callback<void()> empty;
+        empty.Push(L);
+        CHECK(lua_isnil(L, -1));
+        lua_settop(L, 0);
+    }
+    SECTION("errors unwind the calling coroutine")
+    {
+        luaL_openlibs(L);
+        auto fire = [&handlers](int x, LuaVar::StackView rest) { return handlers[0](rest.State(), x); };
+        LuaVar::CppFunction("fire", fire).Bind(L);
+        exec_lua(L, "register_handler(function(x) if x < 0 then error('negative', 0) end return x * 3 end) "
+                 "co = coroutine.wrap(function() local ok, err = pcall(fire, -1) caught = not ok and err "
+                 "coroutine.yield(fire(2)) return 'finished' end) first = co() second = co()");
+        lua_getglobal(L, "caught");
+        CHECK(std::string(lua_tostring(L, -1)) == "negative");
+        lua_getglobal(L, "first");
+        CHECK(lua_tointeger(L, -1) == 6);
+        lua_getglobal(L, "second");
+        CHECK(std::string(lua_tostring(L, -1)) == "finished");
+        lua_settop(L, 0);
+    }
+}
+
+TEST_CASE("Parallel map")
+{
+    const char *script = "offset = 0 function score(x) if x < 0 then error('negative input') end "
+            "return x * 2 + offset end "
+            "function is_even(x) return x % 2 == 0 end";
+    constexpr auto Score = LuaVar::LuaFunction<int (*)(int)>("score");
+    std::vector<int> input(10000);
+    for (size_t i = 0; i < input.size(); ++i)
+    {
+        input[i] = static_cast<int>(i);
+    }
+
+    SECTION("results are gathered in order")
+    {
+        for (size_t chunkSize: {size_t(0), size_t(1), size_t(333)})
+        {
+            LuaVar::ParallelOptions options;
+            options.threads = 3;
+            options.chunkSize = chunkSize;
+            LuaVar::ParallelMap scoring(script, Score, options);
+            REQUIRE(scoring.IsValid());
+            CHECK(scoring.Threads() == 3);
+            for (int run = 0; run < 2; ++run)
+            {
+                std::vector<int> results;
+                REQUIRE(scoring.Map(input, results));
+                REQUIRE(results.size() == input.size());
+                bool ordered = true;
+                for (size_t i = 0; i < input.size(); ++i)
+                {
+                    ordered = ordered && results[i] == input[i] * 2;
+                }
+                CHECK(ordered);
+            }
+        }
+    }
+    SECTION("boolean results and setup of worker states")
+    {
+        LuaVar::ParallelOptions options;
+        options.threads = 2;
+        options.setup = [](lua_State *L)
+        {
+            lua_pushinteger(L, 100);
+            lua_setglobal(L, "base");
+        };
+        LuaVar::ParallelMap evens("function is_even(x) return (x + base) % 2 == 0 end",
+                                  LuaVar::LuaFunction<bool (*)(int)>("is_even"), options);
+        std::vector<bool> results;
+        REQUIRE(evens.Map(std::vector<int>{1, 2, 3, 4}, results));
+        CHECK(results == std::vector<bool>{false, true, false, true});
+    }
+    SECTION("errors")
+    {
+        LuaVar::ParallelOptions options;
+        options.threads = 2;
+        options.state.libraries = LuaVar::LuaLibraryBase;
+        LuaVar::ParallelMap scoring(script, Score, options);
+        std::vector<int> results;
+        input[5000] = -1;
+        CHECK_FALSE(scoring.Map(input, results));
+        CHECK(scoring.Error().find("negative input") != std::string::npos);
+        input[5000] = 5000;
+        CHECK(scoring.Map(input, results));
+        CHECK(scoring.Error().empty());
+
+        LuaVar::ParallelMap broken("function score(x) return x", Score, options);
+        CHECK_FALSE(broken.IsValid());
+        CHECK_FALSE(broken.Error().empty());
+        CHECK_FALSE(broken.Map(input, results));
+
+        LuaVar::ParallelMap missing("function other(x) return x end", Score, options);
+        CHECK_FALSE(missing.IsValid());
+        CHECK(missing.Error().find("score") != std::string::npos);
+    }
+    SECTION("results of unexpected types")
+    {
+        LuaVar::ParallelOptions options;
+        options.threads = 2;
+        LuaVar::ParallelMap text("function score(x) if x == 2 then return 'oops' end return x * 2 end", Score,
+                                 options);
+        std::vector<int> results;
+        CHECK_FALSE(text.Map(std::vector<int>{1, 2, 3, 4}, results));
+        CHECK(text.Error().find("bad result of score") != std::string::npos);
+
+        LuaVar::ParallelMap fraction("function score(x) if x == 2 then return 1.5 end return x * 2 end", Score,
+                                     options);
+        CHECK_FALSE(fraction.Map(std::vector<int>{1, 2, 3, 4}, results));
+        CHECK(fraction.Error().find("bad result of score") != std::string::npos);
+
+        // numbers with integer representation are still accepted
+        LuaVar::ParallelMap whole("function score(x) return x * 2.0 end", Score, options);
+        REQUIRE(whole.Map(std::vector<int>{1, 2, 3, 4}, results));
+        CHECK(results == std::vector<int>{2, 4, 6, 8});
+    }
+}
+
+TEST_CASE("Channels")
+{
+    auto LS = LuaVar::LuaState();
+    lua_State *L = LS.Get();
+    luaL_openlibs(L);
+    auto channel = LuaVar::Channel::Create(3);
+    CHECK(channel->Capacity() == 4);
+    LuaVar::Channel::Bind(L, "channel", channel);
+
+    SECTION("values keep their types")
+    {
+        exec_lua(L, "channel:send(42) channel:send(1.5) channel:send('text') "
+                 "channel:send({1, 2, name = 'x', [2.5] = true, flag = false})");
+        exec_lua(L, "a = channel:recv() b = channel:recv() c = channel:recv() d = channel:recv() "
+                 "e, f = channel:try_recv()");
+        lua_getglobal(L, "a");
+        CHECK(lua_isinteger(L, -1));
+        CHECK(lua_tointeger(L, -1) == 42);
+        lua_getglobal(L, "b");
+        CHECK(lua_tonumber(L, -1) == 1.5);
+        lua_getglobal(L, "c");
+        CHECK(std::string(lua_tostring(L, -1)) == "text");
+        lua_getglobal(L, "e");
+        CHECK(lua_toboolean(L, -1) == 0);
+        lua_getglobal(L, "f");
+        CHECK(lua_isnil(L, -1));
+        lua_settop(L, 0);
+        exec_lua(L, "ok = d[1] == 1 and d[2] == 2 and d.name == 'x' and d[2.5] == true and d.flag == false "
+                 "and #d == 2");
+        lua_getglobal(L, "ok");
+        CHECK(lua_toboolean(L, -1));
+        lua_settop(L, 0);
+    }
+    SECTION("unsupported values")
+    {
+        for (const char *script: {"channel:send({{}})", "channel:send(print)", "channel:send({[{}] = 1})"})
+        {
+            REQUIRE(luaL_dostring(L, script) != LUA_OK);
+            lua_settop(L, 0);
+        }
+        lua_pushcfunction(L, lua_gettop);
+        CHECK_FALSE(LuaVar::Channel::IsSupported(L, -1));
+        CHECK_FALSE(channel->TrySend(L, -1));
+        lua_settop(L, 0);
+        CHECK_FALSE(channel->TryReceive(L));
+    }
+    SECTION("full and empty channels suspend coroutines")
+    {
+        exec_lua(L, "consumer = coroutine.create(function() received = channel:recv() end) "
+                 "producer = coroutine.create(function() for i = 1, 6 do channel:send(i) end done = true end)");
+        exec_lua(L, "coroutine.resume(consumer) a = coroutine.status(consumer)");
+        lua_getglobal(L, "a");
+        CHECK(std::string(lua_tostring(L, -1)) == "suspended");
+        lua_settop(L, 0);
+
+        exec_lua(L, "coroutine.resume(producer) b = coroutine.status(producer)");
+        lua_getglobal(L, "b");
+        CHECK(std::string(lua_tostring(L, -1)) == "suspended");
+        lua_settop(L, 0);
+
+        exec_lua(L, "coroutine.resume(consumer) c = coroutine.status(consumer) coroutine.resume(producer)");
+        lua_getglobal(L, "c");
+        CHECK(std::string(lua_tostring(L, -1)) == "dead");
+        lua_getglobal(L, "received");
+        CHECK(lua_tointeger(L, -1) == 1);
+        lua_getglobal(L, "done");
+        CHECK(lua_isnil(L, -1));
+        lua_settop(L, 0);
+
+        CHECK(channel->TryReceive(L));
+        CHECK(lua_tointeger(L, -1) == 2);
+        lua_settop(L, 0);
+        exec_lua(L, "coroutine.resume(producer)");
+        lua_getglobal(L, "done");
+        CHECK(lua_toboolean(L, -1));
+        lua_settop(L, 0);
+    }
+    SECTION("states on different threads")
+    {
+        auto results = LuaVar::Channel::Create(512);
+        std::atomic<int> failures = 0;
+        std::vector<std::thread> workers;
+        for (int worker = 0; worker < 3; ++worker)
+        {
+            workers.emplace_back([channel, results, &failures]
+            {
+                auto WS = LuaVar::LuaState();
+                lua_State *W = WS.Get();
+                LuaVar::Channel::Bind(W, "jobs", channel);
+                LuaVar::Channel::Bind(W, "results", results);
+                if (luaL_dostring(W, "while true do local job = jobs:recv() if job.stop then break end "
+                                     "results:send(job.value * 2) end") != LUA_OK)
+                {
+                    ++failures;
+                }
+            });
+        }
+        LuaVar::Channel::Bind(L, "results", results);
+        exec_lua(L, "for i = 1, 300 do channel:send({value = i}) end "
+                 "for i = 1, 3 do channel:send({stop = true}) end");
+        for (auto &worker: workers)
+        {
+            worker.join();
+        }
+        CHECK(failures == 0);
+        exec_lua(L, "sum = 0 while true do local ok, v = results:try_recv() if not ok then break end sum = sum + v end");
+        lua_getglobal(L, "sum");
+        CHECK(lua_tointeger(L, -1) == 300 * 301);
+        lua_settop(L, 0);
+    }
+}
+
+TEST_CASE("Serialization")
+{
+    auto LS = LuaVar::LuaState();
+    lua_State *L = LS.Get();
+    luaL_openlibs(L);
+    exec_lua(L, "function same(a, b, seen) "
+             "  if type(a) ~= 'table' or type(b) ~= 'table' then "
+             "    return a == b and math.type(a) == math.type(b) end "
+             "  seen = seen or {} if seen[a] then return seen[a] == b end seen[a] = b "
+             "  for k, v in pairs(a) do if type(k) ~= 'table' and not same(v, b[k], seen) then return false end end "
+             "  for k in pairs(b) do if type(k) ~= 'table' and a[k] == nil then return false end end "
+             "  return true end "
+             "value = {1, 2, nil, 4, -7, 127, 128, math.maxinteger, math.mininteger, 0.5, -1e300, 'text', "
+             "  name = 'player', [true] = false, [2.5] = 'half', nested = {deep = {deeper = {'x'}}}, "
+             "  [''] = '', long = string.rep('abc', 1000)}");
+    std::string data;
+
+    SECTION("values keep their types")
+    {
+        for (const char *expression: {"nil", "true", "false", "0", "-1", "1e100", "0/0 ~= 0/0", "'x'", "value"})
+        {
+            exec_lua(L, (std::string("original = ") + expression).c_str());
+            lua_getglobal(L, "original");
+            data.clear();
+            REQUIRE(LuaVar::Serialize(L, -1, data) == LuaVar::SerializeStatus::Ok);
+            CHECK(lua_gettop(L) == 1);
+            size_t consumed = 0;
+            REQUIRE(LuaVar::Deserialize(L, data, &consumed) == LuaVar::SerializeStatus::Ok);
+            CHECK(consumed == data.size());
+            lua_setglobal(L, "copy");
+            lua_settop(L, 0);
+            exec_lua(L, "ok = same(original, copy)");
+            lua_getglobal(L, "ok");
+            CHECK(lua_toboolean(L, -1));
+            lua_settop(L, 0);
+        }
+        exec_lua(L, "ok = #copy == 12 and copy[3] == nil and copy.long == value.long");
+        lua_getglobal(L, "ok");
+        CHECK(lua_toboolean(L, -1));
+        lua_settop(L, 0);
+    }
+    SECTION("shared tables, cycles and repeated strings")
+    {
+        exec_lua(L, "local shared = {1} original = {a = shared, b = shared, [shared] = 'key'} original.self = original "
+                 "original.words = {string.rep('w', 100), string.rep('w', 100), string.rep('w', 100)}");
+        lua_getglobal(L, "original");
+        REQUIRE(LuaVar::Serialize(L, -1, data) == LuaVar::SerializeStatus::Ok);
+        CHECK(data.size() < 150);
+        REQUIRE(LuaVar::Deserialize(L, data) == LuaVar::SerializeStatus::Ok);
+        lua_setglobal(L, "copy");
+        lua_settop(L, 0);
+        exec_lua(L, "ok = copy.self == copy and copy.a == copy.b and copy[copy.a] == 'key' and copy.a[1] == 1 "
+                 "and copy.words[3] == original.words[1] and copy ~= original");
+        lua_getglobal(L, "ok");
+        CHECK(lua_toboolean(L, -1));
+        lua_settop(L, 0);
+    }
+    SECTION("streaming through a small buffer")
+    {
+        lua_getglobal(L, "value");
+        REQUIRE(LuaVar::Serialize(L, -1, data) == LuaVar::SerializeStatus::Ok);
+
+        std::array<char, 32> buffer{};
+        std::string streamed;
+        size_t written = 0;
+        size_t flushes = 0;
+        CHECK(LuaVar::Serialize(L, -1, buffer, [&streamed, &flushes](const char *part, size_t size)
+        {
+            streamed.append(part, size);
+            ++flushes;
+            return true;
+        }, &written) == LuaVar::SerializeStatus::Ok);
+        CHECK(streamed == data);
+        CHECK(written == data.size());
+        CHECK(flushes > 1);
+
+        CHECK(LuaVar::Serialize(L, -1, buffer, {}) == LuaVar::SerializeStatus::BufferTooSmall);
+        CHECK(LuaVar::Serialize(L, -1, buffer, [](const char *, size_t) { return false; })
+            == LuaVar::SerializeStatus::SinkFailed);
+        std::array<char, 64> fits{};
+        lua_pushinteger(L, 1000);
+        CHECK(LuaVar::Serialize(L, -1, fits, {}, &written) == LuaVar::SerializeStatus::Ok);
+        CHECK(written == 3);
+        CHECK(lua_gettop(L) == 2);
+        lua_settop(L, 0);
+    }
+    SECTION("unsupported values and depth")
+    {
+        data = "prefix";
+        exec_lua(L, "original = {1, {print}}");
+        lua_getglobal(L, "original");
+        CHECK(LuaVar::Serialize(L, -1, data) == LuaVar::SerializeStatus::UnsupportedValue);
+        CHECK(data == "prefix");
+        CHECK(lua_gettop(L) == 1);
+        lua_settop(L, 0);
+
+        exec_lua(L, "original = {} local t = original for i = 1, 10 do t.next = {} t = t.next end");
+        lua_getglobal(L, "original");
+        LuaVar::SerializeOptions options;
+        options.maxDepth = 5;
+        CHECK(LuaVar::Serialize(L, -1, data, options) == LuaVar::SerializeStatus::TooDeep);
+        data.clear();
+        REQUIRE(LuaVar::Serialize(L, -1, data) == LuaVar::SerializeStatus::Ok);
+        CHECK(LuaVar::Deserialize(L, data, nullptr, options) == LuaVar::SerializeStatus::TooDeep);
+        CHECK(lua_gettop(L) == 1);
+        lua_settop(L, 0);
+    }
+    SECTION("malformed data")
+    {
+        lua_getglobal(L, "value");
+        REQUIRE(LuaVar::Serialize(L, -1, data) == LuaVar::SerializeStatus::Ok);
+        lua_settop(L, 0);
+        for (size_t size = 0; size < data.size(); size += 7)
+        {
+            CHECK(LuaVar::Deserialize(L, std::string_view(data).substr(0, size)) ==
+                LuaVar::SerializeStatus::Malformed);
+            CHECK(lua_gettop(L) == 0);
+        }
+        // references to strings and tables not seen yet, a nil key, a table claiming more entries than there are
+        using namespace std::string_view_literals;
+        for (std::string_view malformed: {"\x07\x00"sv, "\x09\x00"sv, "\x08\x00\x01\x00\x80"sv, "\x08\xff\x01\x80"sv,
+                                          "\x0b"sv})
+        {
+            CHECK(LuaVar::Deserialize(L, malformed) == LuaVar::SerializeStatus::Malformed);
+            CHECK(lua_gettop(L) == 0);
+        }
+
+        std::string two;
+        lua_pushinteger(L, 300);
+        lua_pushstring(L, "second");
+        REQUIRE(LuaVar::Serialize(L, 1, two) == LuaVar::SerializeStatus::Ok);
+        REQUIRE(LuaVar::Serialize(L, 2, two) == LuaVar::SerializeStatus::Ok);
+        lua_settop(L, 0);
+        size_t consumed = 0;
+        REQUIRE(LuaVar::Deserialize(L, two, &consumed) == LuaVar::SerializeStatus::Ok);
+        CHECK(lua_tointeger(L, -1) == 300);
+        REQUIRE(LuaVar::Deserialize(L, std::string_view(two).substr(consumed)) == LuaVar::SerializeStatus::Ok);
+        CHECK(std::string(lua_tostring(L, -1)) == "second");
+        lua_settop(L, 0);
+    }
+}
+
+TEST_CASE("Script bundles")
+{
+    const auto directory = std::filesystem::temp_directory_path();
+    const std::string path = (directory / "luavar_test.bundle").string();
+    std::string error;
+
+    LuaVar::ScriptBundleBuilder builder;
+    REQUIRE(builder.Add("main", "local util = require('lib.util') result = util.double(21)", error));
+    REQUIRE(builder.Add("lib.util", "return {double = function(x) return x * 2 end}", error));
+    REQUIRE(builder.Add("fails", "\n error('failed')", error));
+    CHECK_FALSE(builder.Add("main", "return 1", error));
+    CHECK_FALSE(builder.Add("broken", "return +", error));
+    CHECK(error.find("broken") != std::string::npos);
+    CHECK(builder.Size() == 3);
+    REQUIRE(builder.Write(path, error));
+
+    auto bundle = LuaVar::ScriptBundle::Open(path, error);
+    REQUIRE(bundle != nullptr);
+    CHECK(bundle->Size() == 3);
+    CHECK(bundle->Name(0) == "fails");
+    CHECK(bundle->Name(1) == "lib.util");
+    CHECK(bundle->Name(2) == "main");
+    CHECK(bundle->Contains("main"));
+    CHECK_FALSE(bundle->Contains("mai"));
+    CHECK(bundle->Chunk("main").starts_with(LUA_SIGNATURE));
+    CHECK(bundle->Chunk("other").empty());
+
+    SECTION("states share the bundle")
+    {
+        for (int i = 0; i < 2; ++i)
+        {
+            auto LS = LuaVar::LuaState();
+            lua_State *L = LS.Get();
+            luaL_openlibs(L);
+            REQUIRE(LuaVar::ScriptBundle::AddSearcher(L, bundle));
+            REQUIRE(bundle->Load(L, "main") == LUA_OK);
+            REQUIRE(lua_pcall(L, 0, 0, 0) == LUA_OK);
+            lua_getglobal(L, "result");
+            CHECK(lua_tointeger(L, -1) == 42);
+            lua_settop(L, 0);
+
+            REQUIRE(bundle->Load(L, "fails") == LUA_OK);
+            REQUIRE(lua_pcall(L, 0, 0, 0) != LUA_OK);
+            CHECK(std::string(lua_tostring(L, -1)) == "fails:2: failed");
+            lua_settop(L, 0);
+
+            CHECK(bundle->Load(L, "missing") == LUA_ERRFILE);
+            CHECK(std::string(lua_tostring(L, -1)) == "no script 'missing' in the bundle");
+            lua_settop(L, 0);
+            CHECK(luaL_dostring(L, "require('missing')") != LUA_OK);
+            CHECK(std::string(lua_tostring(L, -1)).find("no script 'missing' in the bundle") != std::string::npos);
+            lua_settop(L, 0);
+        }
+        auto LS = LuaVar::LuaState();
+        CHECK_FALSE(LuaVar::ScriptBundle::AddSearcher(LS.Get(), bundle));
+    }
+    SECTION("stripped debug information")
+    {
+        LuaVar::ScriptBundleBuilder stripped(true);
+        REQUIRE(stripped.Add("fails", "\n error('failed')", error));
+        const std::string strippedPath = (directory / "luavar_test_stripped.bundle").string();
+        REQUIRE(stripped.Write(strippedPath, error));
+        auto small = LuaVar::ScriptBundle::Open(strippedPath, error);
+        REQUIRE(small != nullptr);
+        CHECK(small->Chunk("fails").size() < bundle->Chunk("fails").size());
+        small.reset();
+        std::filesystem::remove(strippedPath);
+    }
+    SECTION("invalid files")
+    {
+        CHECK(LuaVar::ScriptBundle::Open((directory / "luavar_missing.bundle").string(), error) == nullptr);
+        CHECK(error.find("cannot open") != std::string::npos);
+
+        std::string contents;
+        {
+            std::ifstream file(path, std::ios::binary);
+            contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        }
+        const std::string corruptPath = (directory / "luavar_test_corrupt.bundle").string();
+        auto write = [&corruptPath](const std::string &data)
+        {
+            std::ofstream file(corruptPath, std::ios::binary | std::ios::trunc);
+            file.write(data.data(), static_cast<std::streamsize>(data.size()));
+        };
+        write(contents.substr(0, 40));
+        CHECK(LuaVar::ScriptBundle::Open(corruptPath, error) == nullptr);
+        CHECK(error.find("truncated") != std::string::npos);
+        write(contents.substr(0, contents.size() - 8));
+        CHECK(LuaVar::ScriptBundle::Open(corruptPath, error) == nullptr);
+        CHECK(error.find("corrupted") != std::string::npos);
+        write("-- not a bundle, just some lua source");
+        CHECK(LuaVar::ScriptBundle::Open(corruptPath, error) == nullptr);
+        CHECK(error.find("not a script bundle") != std::string::npos);
+        std::filesystem::remove(corruptPath);
+    }
+    bundle.reset();
+    std::filesystem::remove(path);
+}
+
 TEST_CASE("Assumptions")
 {
     int k = 16;
@@ -0,0 +1,65 @@
+// Copyright (c) Mateusz Raczynski 2025.
+// The software is provided AS IS, with no guarantees for it to work correctly.
+// The author doesn't take any responsibility for any damages done.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include <luavar/bundle.h>
+
+// ai/pathfinding.lua -> ai.pathfinding, the name `require` uses for the module
+static std::string module_name(std::string path)
+{
+    if (path.starts_with("./"))
+    {
+        path.erase(0, 2);
+    }
+    if (path.ends_with(".lua"))
+    {
+        path.resize(path.size() - 4);
+    }
+    std::ranges::replace(path, '/', '.');
+    std::ranges::replace(path, '\\', '.');
+    return path;
+}
+
+int main(int argc, char **argv)
+{
+    int first = 1;
+    const bool strip = argc > 1 && strcmp(argv[1], "--strip") == 0;
+    if (strip)
+    {
+        ++first;
+    }
+    if (argc - first < 2)
+    {
+        fprintf(stderr, "usage: %s [--strip] <output> <script.lua | name=script.lua>...\n"
+                "  scripts are named after their paths (ai/path.lua is ai.path) unless named explicitly\n"
+                "  --strip drops debug information\n", argv[0]);
+        return 2;
+    }
+
+    LuaVar::ScriptBundleBuilder builder(strip);
+    std::string error;
+    for (int i = first + 1; i < argc; ++i)
+    {
+        const std::string argument = argv[i];
+        const size_t separator = argument.find('=');
+        const std::string path = separator != std::string::npos ? argument.substr(separator + 1) : argument;
+        const std::string name = separator != std::string::npos ? argument.substr(0, separator) : module_name(path);
+        if (!builder.AddFile(name, path, error))
+        {
+            fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+    }
+    if (!builder.Write(argv[first], error))
+    {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    printf("%zu scripts written to %s\n", builder.Size(), argv[first]);
+    return 0;
+}